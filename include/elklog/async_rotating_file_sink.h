@@ -0,0 +1,337 @@
+/*
+ * Copyright 2020-2023 Elk Audio AB
+ * ElkLog is free software: you can redistribute it and/or modify it under the terms
+ * of the GNU General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * Twine is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with Twine.
+ * If not, see http://www.gnu.org/licenses/ .
+ */
+
+/**
+ * @brief spdlog sink that rotates log files by size and/or by time, without
+ *        stalling the writer thread. On rotation, the full file is only
+ *        renamed, and a new file is opened. Shifting the older files and
+ *        compressing the full one is done by a background thread, with a low
+ *        priority by default.
+ *
+ *        Rotated files are named like those of spdlog's rotating_file_sink,
+ *        i.e. log.1.txt is the most recent, with a .gz suffix when compressed.
+ *        Compression requires ELKLOG_WITH_COMPRESSION, which links zlib.
+ *
+ * @copyright Copyright 2020-2023 Elk Audio AB, Stockholm
+ */
+
+#ifndef ELKLOG_ASYNC_ROTATING_FILE_SINK_H
+#define ELKLOG_ASYNC_ROTATING_FILE_SINK_H
+
+#include <chrono>
+#include <cstddef>
+
+#include "thread_config.h"
+
+namespace elklog {
+
+#ifdef ELKLOG_FILE_SIZE
+constexpr size_t DEFAULT_ROTATION_FILE_SIZE = ELKLOG_FILE_SIZE;
+#else
+constexpr size_t DEFAULT_ROTATION_FILE_SIZE = 10000000;
+#endif
+
+enum class Compression
+{
+    NONE,
+    GZIP
+};
+
+struct RotationConfig
+{
+    // Rotate when a message would make the file larger than this, 0 to only rotate by time
+    size_t max_file_size {DEFAULT_ROTATION_FILE_SIZE};
+    // Number of rotated files kept besides the current one
+    int max_files {1};
+    // Also rotate when the file is this old, 0 to only rotate by size
+    std::chrono::milliseconds rotation_interval {0};
+    Compression compression {Compression::NONE};
+    // 1 (fastest) to 9 (smallest)
+    int compression_level {6};
+    // For the thread that shifts and compresses rotated files
+    ThreadConfig thread_config {{}, std::nullopt, 0, 19, "elklog_rotate"};
+};
+
+} // namespace elklog
+
+#ifndef ELKLOG_DISABLE_LOGGING
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#ifdef ELKLOG_WITH_COMPRESSION
+#include <zlib.h>
+#endif
+
+#include "spdlog/common.h"
+#include "spdlog/details/file_helper.h"
+#include "spdlog/details/null_mutex.h"
+#include "spdlog/details/os.h"
+#include "spdlog/sinks/base_sink.h"
+
+namespace elklog {
+
+/**
+ * @brief Name of the rotated file with the given index, i.e. log.txt, 3 => log.3.txt
+ */
+inline std::string rotated_file_name(const std::string& path, int index, Compression compression)
+{
+    if (index == 0)
+    {
+        return path;
+    }
+    auto [base, extension] = spdlog::details::file_helper::split_by_extension(path);
+    return fmt::format("{}.{}{}{}", base, index, extension, compression == Compression::GZIP ? ".gz" : "");
+}
+
+/**
+ * @brief Compress source into target with gzip, the source is kept
+ * @return false on failure, or if built without ELKLOG_WITH_COMPRESSION
+ */
+inline bool gzip_file(const std::string& source, const std::string& target, int level)
+{
+#ifdef ELKLOG_WITH_COMPRESSION
+    std::FILE* input = std::fopen(source.c_str(), "rb");
+    if (input == nullptr)
+    {
+        return false;
+    }
+    gzFile output = gzopen(target.c_str(), fmt::format("wb{}", std::clamp(level, 1, 9)).c_str());
+    if (output == nullptr)
+    {
+        std::fclose(input);
+        return false;
+    }
+
+    static constexpr size_t CHUNK_SIZE = 64 * 1024;
+    std::vector<char> buffer(CHUNK_SIZE);
+    bool ok = true;
+    size_t read;
+    while (ok && (read = std::fread(buffer.data(), 1, buffer.size(), input)) > 0)
+    {
+        ok = gzwrite(output, buffer.data(), static_cast<unsigned>(read)) == static_cast<int>(read);
+    }
+    ok = std::ferror(input) == 0 && ok;
+    std::fclose(input);
+    ok = gzclose(output) == Z_OK && ok;
+    return ok;
+#else
+    (void) source;
+    (void) target;
+    (void) level;
+    return false;
+#endif
+}
+
+template<typename Mutex>
+class AsyncRotatingFileSink : public spdlog::sinks::base_sink<Mutex>
+{
+public:
+    /**
+     * @brief Open or append to the log file, throws spdlog::spdlog_ex on failure
+     *        like the spdlog file sinks
+     */
+    AsyncRotatingFileSink(const std::string& path, const RotationConfig& config) : _path(path),
+                                                                                  _config(config)
+    {
+#ifndef ELKLOG_WITH_COMPRESSION
+        if (config.compression != Compression::NONE)
+        {
+            spdlog::throw_spdlog_ex("Log compression requires ELKLOG_WITH_COMPRESSION");
+        }
+#endif
+        _file_helper.open(_path, false);
+        _file_size = _file_helper.size();
+        _next_rotation = spdlog::log_clock::now() + _config.rotation_interval;
+        _worker_thread = std::thread(&AsyncRotatingFileSink::_worker, this);
+    }
+
+    /**
+     * @brief Finishes the pending rotations before returning
+     */
+    ~AsyncRotatingFileSink() override
+    {
+        {
+            std::scoped_lock lock(_worker_lock);
+            _running = false;
+        }
+        _worker_notify.notify_one();
+        _worker_thread.join();
+    }
+
+    /**
+     * @brief Number of rotated files not yet shifted and compressed
+     */
+    size_t pending_rotations()
+    {
+        std::scoped_lock lock(_worker_lock);
+        return _pending.size() + _busy;
+    }
+
+protected:
+    void sink_it_(const spdlog::details::log_msg& msg) override
+    {
+        spdlog::memory_buf_t formatted;
+        this->formatter_->format(msg, formatted);
+        bool full = _config.max_file_size > 0 && _file_size + formatted.size() > _config.max_file_size;
+        bool expired = _config.rotation_interval.count() > 0 && msg.time >= _next_rotation;
+        if (_file_size > 0 && (full || expired))
+        {
+            _rotate(msg.time);
+        }
+        else if (expired)
+        {
+            // Nothing to rotate, the interval starts again with this message
+            _next_rotation = msg.time + _config.rotation_interval;
+        }
+        _file_helper.write(formatted);
+        _file_size += formatted.size();
+    }
+
+    void flush_() override
+    {
+        _file_helper.flush();
+    }
+
+private:
+    /**
+     * @brief Only renames the file, anything slower is left to the worker
+     */
+    void _rotate(spdlog::log_clock::time_point now)
+    {
+        _file_helper.close();
+        // Files left pending by an earlier process are not overwritten
+        std::string pending;
+        do
+        {
+            pending = fmt::format("{}.{}.rotated", _path, ++_rotations);
+        } while (spdlog::details::os::path_exists(pending));
+        bool renamed = std::rename(_path.c_str(), pending.c_str()) == 0;
+        // If the file could not be renamed, keep appending to it rather than losing it
+        _file_helper.open(_path, renamed);
+        _file_size = renamed ? 0 : _file_helper.size();
+        _next_rotation = now + _config.rotation_interval;
+        if (renamed)
+        {
+            {
+                std::scoped_lock lock(_worker_lock);
+                _pending.push_back(std::move(pending));
+            }
+            _worker_notify.notify_one();
+        }
+    }
+
+    void _worker()
+    {
+        apply_thread_config(_config.thread_config);
+        std::unique_lock lock(_worker_lock);
+        while (true)
+        {
+            _worker_notify.wait(lock, [this]() { return _pending.empty() == false || _running == false; });
+            if (_pending.empty())
+            {
+                return;
+            }
+            auto file = std::move(_pending.front());
+            _pending.pop_front();
+            _busy = true;
+            lock.unlock();
+            _store_rotated(file);
+            lock.lock();
+            _busy = false;
+        }
+    }
+
+    /**
+     * @brief Shift the rotated files by one, and store file as the most recent
+     */
+    void _store_rotated(const std::string& file)
+    {
+        if (_config.max_files <= 0)
+        {
+            std::remove(file.c_str());
+            return;
+        }
+        _shift_rotated(_config.compression);
+        if (_config.compression != Compression::NONE)
+        {
+            // Files kept uncompressed when compression failed
+            _shift_rotated(Compression::NONE);
+        }
+
+        auto target = rotated_file_name(_path, 1, _config.compression);
+        if (_config.compression == Compression::GZIP)
+        {
+            // Written under a temporary name, so that a partly written file is never left as log.1.txt.gz
+            auto compressed = file + ".gz";
+            if (gzip_file(file, compressed, _config.compression_level) &&
+                std::rename(compressed.c_str(), target.c_str()) == 0)
+            {
+                std::remove(file.c_str());
+                return;
+            }
+            // Keep the log uncompressed rather than losing it
+            std::remove(compressed.c_str());
+            target = rotated_file_name(_path, 1, Compression::NONE);
+        }
+        std::rename(file.c_str(), target.c_str());
+    }
+
+    /**
+     * @brief Rename the rotated files with the given compression to the next
+     *        index, and remove the oldest one
+     */
+    void _shift_rotated(Compression compression)
+    {
+        std::remove(rotated_file_name(_path, _config.max_files, compression).c_str());
+        for (int i = _config.max_files - 1; i > 0; --i)
+        {
+            auto source = rotated_file_name(_path, i, compression);
+            if (spdlog::details::os::path_exists(source))
+            {
+                std::rename(source.c_str(), rotated_file_name(_path, i + 1, compression).c_str());
+            }
+        }
+    }
+
+    std::string _path;
+    RotationConfig _config;
+    spdlog::details::file_helper _file_helper;
+    size_t _file_size {0};
+    uint64_t _rotations {0};
+    spdlog::log_clock::time_point _next_rotation;
+
+    std::mutex _worker_lock;
+    std::condition_variable _worker_notify;
+    std::deque<std::string> _pending;
+    bool _busy {false};
+    bool _running {true};
+    std::thread _worker_thread;
+};
+
+using async_rotating_file_sink_mt = AsyncRotatingFileSink<std::mutex>;
+using async_rotating_file_sink_st = AsyncRotatingFileSink<spdlog::details::null_mutex>;
+
+} // namespace elklog
+
+#endif // ELKLOG_DISABLE_LOGGING
+
+#endif // ELKLOG_ASYNC_ROTATING_FILE_SINK_H
@@ -0,0 +1,552 @@
+/*
+ * Copyright 2020-2023 Elk Audio AB
+ * ElkLog is free software: you can redistribute it and/or modify it under the terms
+ * of the GNU General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * Twine is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with Twine.
+ * If not, see http://www.gnu.org/licenses/ .
+ */
+
+/**
+ * @brief Compact binary log record format, used by ElkLogger::Type::BINARY
+ *        and decoded offline by the elklog_decode tool.
+ *
+ *        A stream starts with a header, followed by records:
+ *
+ *        Header:  "ELKLOGB" '\0', u32 version, u32 process id,
+ *                 u32 name length, name
+ *        Format:  u8 FORMAT, u32 id, u32 length, format string
+ *        Message: u8 MESSAGE, u8 level, i64 timestamp in ns, u32 format id,
+ *                 u8 arg count, u8 type for each arg, packed args
+ *
+ *        Each format string is written once, before the first message that
+ *        refers to it. Numeric args are stored in native byte order with
+ *        their native size and strings as u32 length followed by the bytes,
+ *        so streams must be decoded on a machine with the same byte order.
+ *        Levels are spdlog level values.
+ *
+ * @copyright Copyright 2020-2023 Elk Audio AB, Stockholm
+ */
+
+#ifndef ELKLOG_BINARY_FORMAT_H
+#define ELKLOG_BINARY_FORMAT_H
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include <spdlog/fmt/bundled/format.h>
+
+namespace elklog {
+namespace binary {
+
+constexpr char MAGIC[8] = "ELKLOGB";
+constexpr uint32_t VERSION = 1;
+
+enum class RecordType : uint8_t
+{
+    FORMAT = 1,
+    MESSAGE = 2
+};
+
+enum class ArgType : uint8_t
+{
+    NONE = 0,
+    BOOL,
+    CHAR,
+    INT8,
+    UINT8,
+    INT16,
+    UINT16,
+    INT32,
+    UINT32,
+    INT64,
+    UINT64,
+    FLOAT,
+    DOUBLE,
+    STRING
+};
+
+/**
+ * @brief Returns the binary type of a numeric argument, or ArgType::NONE if
+ *        T can not be stored as raw bytes. Enums are stored as their
+ *        underlying type.
+ */
+template<typename T>
+constexpr ArgType numeric_arg_type()
+{
+    if constexpr (std::is_enum_v<T>)
+    {
+        return numeric_arg_type<std::underlying_type_t<T>>();
+    }
+    else if constexpr (std::is_same_v<T, bool>)
+    {
+        return ArgType::BOOL;
+    }
+    else if constexpr (std::is_same_v<T, char>)
+    {
+        return ArgType::CHAR;
+    }
+    else if constexpr (std::is_integral_v<T>)
+    {
+        constexpr bool is_signed = std::is_signed_v<T>;
+        switch (sizeof(T))
+        {
+            case 1: return is_signed ? ArgType::INT8 : ArgType::UINT8;
+            case 2: return is_signed ? ArgType::INT16 : ArgType::UINT16;
+            case 4: return is_signed ? ArgType::INT32 : ArgType::UINT32;
+            case 8: return is_signed ? ArgType::INT64 : ArgType::UINT64;
+            default: return ArgType::NONE;
+        }
+    }
+    else if constexpr (std::is_same_v<T, float>)
+    {
+        return ArgType::FLOAT;
+    }
+    else if constexpr (std::is_same_v<T, double>)
+    {
+        return ArgType::DOUBLE;
+    }
+    else
+    {
+        return ArgType::NONE;
+    }
+}
+
+template<typename T>
+constexpr bool is_string_arg()
+{
+    using Type = std::decay_t<T>;
+    return std::is_same_v<Type, const char*> || std::is_same_v<Type, char*> ||
+           std::is_same_v<Type, std::string> || std::is_same_v<Type, std::string_view>;
+}
+
+template<typename T>
+constexpr ArgType arg_type()
+{
+    if constexpr (is_string_arg<T>())
+    {
+        return ArgType::STRING;
+    }
+    else
+    {
+        return numeric_arg_type<std::decay_t<T>>();
+    }
+}
+
+/**
+ * @brief Null-terminated list of the types of a pack of numeric and string arguments
+ */
+template<typename... Args>
+struct ArgTypes
+{
+    static constexpr ArgType value[] = {arg_type<Args>()..., ArgType::NONE};
+};
+
+/**
+ * @brief Returns the size of a packed numeric argument or 0 for strings
+ */
+inline size_t arg_size(ArgType type)
+{
+    switch (type)
+    {
+        case ArgType::BOOL:
+        case ArgType::CHAR:
+        case ArgType::INT8:
+        case ArgType::UINT8:   return 1;
+        case ArgType::INT16:
+        case ArgType::UINT16:  return 2;
+        case ArgType::INT32:
+        case ArgType::UINT32:
+        case ArgType::FLOAT:   return 4;
+        case ArgType::INT64:
+        case ArgType::UINT64:
+        case ArgType::DOUBLE:  return 8;
+        default:               return 0;
+    }
+}
+
+/**
+ * @brief Appends binary records to a byte buffer, i.e. an fmt::memory_buffer
+ *        or std::string
+ */
+template<typename Buffer>
+class Encoder
+{
+public:
+    explicit Encoder(Buffer& buffer) : _buffer(buffer) {}
+
+    void header(uint32_t process_id, std::string_view name)
+    {
+        _append(MAGIC, sizeof(MAGIC));
+        _append_value(VERSION);
+        _append_value(process_id);
+        _append_string(name);
+    }
+
+    void format(uint32_t id, std::string_view format_str)
+    {
+        _append_value(RecordType::FORMAT);
+        _append_value(id);
+        _append_string(format_str);
+    }
+
+    /**
+     * @brief Encode a message with its arguments, all arguments must have a
+     *        binary type, i.e. arg_type<T>() != ArgType::NONE.
+     */
+    template<typename... Args>
+    void message(uint8_t level, int64_t timestamp, uint32_t format_id, const Args&... args)
+    {
+        static_assert(sizeof...(Args) <= UINT8_MAX);
+        _message_header(level, timestamp, format_id, sizeof...(Args));
+        (_append_value(arg_type<Args>()), ...);
+        (_append_arg(args), ...);
+    }
+
+    /**
+     * @brief Encode a message with arguments already packed back to back,
+     *        as done by RtLogMessage::set_deferred_message()
+     * @param types Null-terminated list of argument types
+     */
+    void packed_message(uint8_t level, int64_t timestamp, uint32_t format_id,
+                        const ArgType* types, const char* packed_args, size_t packed_size)
+    {
+        uint8_t count = 0;
+        while (types[count] != ArgType::NONE)
+        {
+            count++;
+        }
+        _message_header(level, timestamp, format_id, count);
+        _append(types, count);
+        _append(packed_args, packed_size);
+    }
+
+private:
+    void _message_header(uint8_t level, int64_t timestamp, uint32_t format_id, uint8_t count)
+    {
+        _append_value(RecordType::MESSAGE);
+        _append_value(level);
+        _append_value(timestamp);
+        _append_value(format_id);
+        _append_value(count);
+    }
+
+    template<typename T>
+    void _append_arg(const T& arg)
+    {
+        if constexpr (is_string_arg<T>())
+        {
+            _append_string(std::string_view(arg));
+        }
+        else if constexpr (std::is_enum_v<T>)
+        {
+            _append_value(static_cast<std::underlying_type_t<T>>(arg));
+        }
+        else
+        {
+            static_assert(numeric_arg_type<T>() != ArgType::NONE, "Argument type has no binary representation");
+            _append_value(arg);
+        }
+    }
+
+    void _append_string(std::string_view str)
+    {
+        _append_value(static_cast<uint32_t>(str.size()));
+        _append(str.data(), str.size());
+    }
+
+    template<typename T>
+    void _append_value(const T& value)
+    {
+        _append(&value, sizeof(T));
+    }
+
+    void _append(const void* data, size_t size)
+    {
+        auto bytes = static_cast<const char*>(data);
+        _buffer.append(bytes, bytes + size);
+    }
+
+    Buffer& _buffer;
+};
+
+/**
+ * @brief A decoded argument, numeric values are widened to 64 bits
+ */
+struct DecodedArg
+{
+    ArgType type {ArgType::NONE};
+    int64_t int_value {0};
+    uint64_t uint_value {0};
+    double float_value {0};
+    std::string_view string_value;
+};
+
+struct DecodedMessage
+{
+    uint8_t level {0};
+    int64_t timestamp {0};
+    uint32_t format_id {0};
+    std::vector<DecodedArg> args;
+};
+
+/**
+ * @brief Reads records from a complete binary stream in memory
+ */
+class Decoder
+{
+public:
+    Decoder(const char* data, size_t size) : _pos(data), _end(data + size) {}
+
+    /**
+     * @brief Read and verify the stream header
+     * @return false if the stream is not a valid binary log
+     */
+    bool header(uint32_t& process_id, std::string& name)
+    {
+        uint32_t version;
+        if (_remaining() < sizeof(MAGIC) || std::memcmp(_pos, MAGIC, sizeof(MAGIC)) != 0)
+        {
+            return false;
+        }
+        _pos += sizeof(MAGIC);
+        std::string_view name_view;
+        if (!_read_value(version) || version != VERSION || !_read_value(process_id) || !_read_string(name_view))
+        {
+            return false;
+        }
+        name = std::string(name_view);
+        return true;
+    }
+
+    /**
+     * @brief Read the next record. Format records are stored internally and
+     *        can be looked up with format().
+     * @return false at the end of the stream or if the stream is corrupt
+     */
+    bool next(DecodedMessage& message)
+    {
+        RecordType type;
+        while (_read_value(type))
+        {
+            if (type == RecordType::FORMAT)
+            {
+                uint32_t id;
+                std::string_view format_str;
+                if (!_read_value(id) || !_read_string(format_str))
+                {
+                    return false;
+                }
+                if (_formats.size() <= id)
+                {
+                    _formats.resize(id + 1);
+                }
+                _formats[id] = std::string(format_str);
+            }
+            else if (type == RecordType::MESSAGE)
+            {
+                return _read_message(message);
+            }
+            else
+            {
+                return false;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * @brief Returns the format string with the given id, or an empty string if not known
+     */
+    const std::string& format(uint32_t id) const
+    {
+        static const std::string empty;
+        return id < _formats.size() ? _formats[id] : empty;
+    }
+
+private:
+    bool _read_message(DecodedMessage& message)
+    {
+        uint8_t count;
+        if (!_read_value(message.level) || !_read_value(message.timestamp) ||
+            !_read_value(message.format_id) || !_read_value(count) || _remaining() < count)
+        {
+            return false;
+        }
+        message.args.resize(count);
+        for (auto& arg : message.args)
+        {
+            arg.type = static_cast<ArgType>(*_pos++);
+        }
+        for (auto& arg : message.args)
+        {
+            if (!_read_arg(arg))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool _read_arg(DecodedArg& arg)
+    {
+        switch (arg.type)
+        {
+            case ArgType::BOOL:    return _read_as<bool>(arg.uint_value);
+            case ArgType::CHAR:    return _read_as<char>(arg.int_value);
+            case ArgType::INT8:    return _read_as<int8_t>(arg.int_value);
+            case ArgType::UINT8:   return _read_as<uint8_t>(arg.uint_value);
+            case ArgType::INT16:   return _read_as<int16_t>(arg.int_value);
+            case ArgType::UINT16:  return _read_as<uint16_t>(arg.uint_value);
+            case ArgType::INT32:   return _read_as<int32_t>(arg.int_value);
+            case ArgType::UINT32:  return _read_as<uint32_t>(arg.uint_value);
+            case ArgType::INT64:   return _read_as<int64_t>(arg.int_value);
+            case ArgType::UINT64:  return _read_as<uint64_t>(arg.uint_value);
+            case ArgType::FLOAT:   return _read_as<float>(arg.float_value);
+            case ArgType::DOUBLE:  return _read_as<double>(arg.float_value);
+            case ArgType::STRING:  return _read_string(arg.string_value);
+            default:               return false;
+        }
+    }
+
+    template<typename T, typename Dest>
+    bool _read_as(Dest& dest)
+    {
+        T value;
+        if (!_read_value(value))
+        {
+            return false;
+        }
+        dest = static_cast<Dest>(value);
+        return true;
+    }
+
+    template<typename T>
+    bool _read_value(T& value)
+    {
+        if (_remaining() < sizeof(T))
+        {
+            return false;
+        }
+        std::memcpy(&value, _pos, sizeof(T));
+        _pos += sizeof(T);
+        return true;
+    }
+
+    bool _read_string(std::string_view& str)
+    {
+        uint32_t length;
+        if (!_read_value(length) || _remaining() < length)
+        {
+            return false;
+        }
+        str = std::string_view(_pos, length);
+        _pos += length;
+        return true;
+    }
+
+    size_t _remaining() const
+    {
+        return _end - _pos;
+    }
+
+    const char* _pos;
+    const char* _end;
+    std::vector<std::string> _formats;
+};
+
+/**
+ * @brief Format a single decoded argument using a format spec, i.e. what
+ *        follows ':' in a replacement field
+ */
+inline std::string format_arg(const DecodedArg& arg, const std::string& spec)
+{
+    std::string field = spec.empty() ? "{}" : "{:" + spec + "}";
+    switch (arg.type)
+    {
+        case ArgType::BOOL:    return fmt::format(field.c_str(), arg.uint_value != 0);
+        case ArgType::CHAR:    return fmt::format(field.c_str(), static_cast<char>(arg.int_value));
+        case ArgType::INT8:
+        case ArgType::INT16:
+        case ArgType::INT32:
+        case ArgType::INT64:   return fmt::format(field.c_str(), arg.int_value);
+        case ArgType::UINT8:
+        case ArgType::UINT16:
+        case ArgType::UINT32:
+        case ArgType::UINT64:  return fmt::format(field.c_str(), arg.uint_value);
+        // Format as float again to get the same shortest representation
+        case ArgType::FLOAT:   return fmt::format(field.c_str(), static_cast<float>(arg.float_value));
+        case ArgType::DOUBLE:  return fmt::format(field.c_str(), arg.float_value);
+        case ArgType::STRING:  return fmt::format(field.c_str(), arg.string_value);
+        default:               return "";
+    }
+}
+
+/**
+ * @brief Format a decoded message. Supports automatic and positional
+ *        replacement fields with format specs, but not nested fields.
+ *        Fields without a matching argument are kept as-is.
+ */
+inline std::string format_message(const std::string& format_str, const std::vector<DecodedArg>& args)
+{
+    std::string output;
+    size_t next_arg = 0;
+    size_t pos = 0;
+    while (pos < format_str.size())
+    {
+        char c = format_str[pos];
+        if ((c == '{' || c == '}') && pos + 1 < format_str.size() && format_str[pos + 1] == c)
+        {
+            output.push_back(c);
+            pos += 2;
+            continue;
+        }
+        if (c != '{')
+        {
+            output.push_back(c);
+            pos++;
+            continue;
+        }
+
+        size_t end = format_str.find('}', pos);
+        if (end == std::string::npos)
+        {
+            output.append(format_str, pos, std::string::npos);
+            break;
+        }
+        std::string field = format_str.substr(pos + 1, end - pos - 1);
+        std::string id = field.substr(0, field.find(':'));
+        std::string spec = id.size() < field.size() ? field.substr(id.size() + 1) : "";
+
+        size_t index = id.empty() ? next_arg++ : std::strtoul(id.c_str(), nullptr, 10);
+        try
+        {
+            if (index >= args.size())
+            {
+                throw fmt::format_error("missing argument");
+            }
+            output += format_arg(args[index], spec);
+        }
+        catch (const fmt::format_error&)
+        {
+            output.append(format_str, pos, end - pos + 1);
+        }
+        pos = end + 1;
+    }
+    return output;
+}
+
+} // namespace binary
+} // namespace elklog
+
+#endif // ELKLOG_BINARY_FORMAT_H
@@ -0,0 +1,230 @@
+/*
+ * Copyright 2020-2023 Elk Audio AB
+ * ElkLog is free software: you can redistribute it and/or modify it under the terms
+ * of the GNU General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * Twine is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with Twine.
+ * If not, see http://www.gnu.org/licenses/ .
+ */
+
+/**
+ * @brief Writes log messages as binary records, see binary_format.h, through
+ *        an spdlog logger so that the file writing is still asynchronous.
+ *        Arguments are packed instead of formatted, formatting is done
+ *        offline by the elklog_decode tool.
+ *
+ * @copyright Copyright 2020-2023 Elk Audio AB, Stockholm
+ */
+
+#ifndef ELKLOG_BINARY_LOGGER_H
+#define ELKLOG_BINARY_LOGGER_H
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include <unistd.h>
+
+#include "spdlog/spdlog.h"
+#include "spdlog/formatter.h"
+
+#include "binary_format.h"
+#include "format_string.h"
+#include "rtlogmessage.h"
+
+namespace elklog {
+
+/**
+ * @brief spdlog formatter that writes the payload of each message as-is,
+ *        without any pattern or line ending
+ */
+class BinaryFormatter : public spdlog::formatter
+{
+public:
+    void format(const spdlog::details::log_msg& msg, spdlog::memory_buf_t& dest) override
+    {
+        dest.append(msg.payload.data(), msg.payload.data() + msg.payload.size());
+    }
+
+    std::unique_ptr<spdlog::formatter> clone() const override
+    {
+        return std::make_unique<BinaryFormatter>();
+    }
+};
+
+class BinaryLogWriter
+{
+public:
+    /**
+     * @param logger The logger to pass records to, its formatter is replaced with a
+     *               BinaryFormatter. Should use a sink that does not rotate files,
+     *               as the stream header and format strings are only written once.
+     */
+    explicit BinaryLogWriter(std::shared_ptr<spdlog::logger> logger) :
+        _logger(std::move(logger)),
+        _static_format_ids(std::make_unique<std::atomic<uint32_t>[]>(ELKLOG_MAX_STATIC_FORMATS))
+    {
+        _logger->set_formatter(std::make_unique<BinaryFormatter>());
+    }
+
+    void write_header(const std::string& logger_name)
+    {
+        std::string buffer;
+        binary::Encoder encoder(buffer);
+        encoder.header(static_cast<uint32_t>(::getpid()), logger_name);
+        _submit(buffer);
+    }
+
+    /**
+     * @brief Write a message. format_str is either a plain string or a static
+     *        format created with ELKLOG_FORMAT, the latter skips the lookup of
+     *        the format string once its definition has been written.
+     */
+    template<typename Format, typename... Args>
+    void log(spdlog::level::level_enum level, const Format& format_str, const Args&... args)
+    {
+        if (_logger->should_log(level) == false)
+        {
+            return;
+        }
+
+        auto timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::system_clock::now().time_since_epoch());
+
+        if constexpr (((binary::arg_type<Args>() != binary::ArgType::NONE) && ...))
+        {
+            _write(format_c_str(format_str), format_id(format_str), [&](binary::Encoder<std::string>& encoder, uint32_t id)
+            {
+                encoder.message(level, timestamp.count(), id, args...);
+            });
+        }
+        else
+        {
+            // Types without a binary representation are formatted here instead
+            auto message = fmt::format(fmt_format(format_str), args...);
+            _write("{}", NO_FORMAT_ID, [&](binary::Encoder<std::string>& encoder, uint32_t id)
+            {
+                encoder.message(level, timestamp.count(), id, message);
+            });
+        }
+    }
+
+    /**
+     * @brief Write a message from the rt logger. Deferred messages are written
+     *        with their packed arguments, without formatting them. time is the
+     *        message timestamp converted to the system clock.
+     */
+    template<size_t message_len>
+    void log_rt(spdlog::level::level_enum level, const RtLogMessage<message_len>& msg,
+                spdlog::log_clock::time_point time)
+    {
+        if (_logger->should_log(level) == false)
+        {
+            return;
+        }
+        auto timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch());
+
+        if (msg.is_structured())
+        {
+            // Fields have no binary representation, so they are written as text
+            thread_local RtLogMessage<message_len> encoded;
+            encoded = msg;
+            encoded.format_deferred();
+            _write("{}", NO_FORMAT_ID, [&](binary::Encoder<std::string>& encoder, uint32_t id)
+            {
+                encoder.message(level, timestamp.count(), id, encoded.message());
+            });
+        }
+        else if (msg.is_deferred())
+        {
+            _write(msg.format_str(), msg.format_id(), [&](binary::Encoder<std::string>& encoder, uint32_t id)
+            {
+                encoder.packed_message(level, timestamp.count(), id, msg.arg_types(),
+                                       msg.packed_args(), msg.length());
+            });
+        }
+        else
+        {
+            _write("{}", NO_FORMAT_ID, [&](binary::Encoder<std::string>& encoder, uint32_t id)
+            {
+                encoder.message(level, timestamp.count(), id, msg.message());
+            });
+        }
+    }
+
+private:
+    /**
+     * @brief Encode a message and pass it to the logger. If the format string is
+     *        new, its definition is submitted in the same record, while holding the
+     *        lock to guarantee that no other thread can submit a message using
+     *        the format before its definition. Static formats that are already
+     *        defined are looked up by id without taking the lock.
+     */
+    template<typename Encode>
+    void _write(const char* format_str, uint32_t static_id, Encode&& encode)
+    {
+        thread_local std::string buffer;
+        buffer.clear();
+        binary::Encoder encoder(buffer);
+
+        if (static_id != NO_FORMAT_ID)
+        {
+            // Stored as id + 1 so that 0 means not yet defined
+            auto stored_id = _static_format_ids[static_id].load(std::memory_order_acquire);
+            if (stored_id > 0)
+            {
+                encode(encoder, stored_id - 1);
+                _submit(buffer);
+                return;
+            }
+        }
+
+        std::unique_lock lock(_format_lock);
+        auto [format, inserted] = _format_ids.try_emplace(format_str, static_cast<uint32_t>(_format_ids.size()));
+        uint32_t id = format->second;
+        if (inserted)
+        {
+            encoder.format(id, format_str);
+            encode(encoder, id);
+            _submit(buffer);
+        }
+        // Only published once the definition is submitted
+        if (static_id != NO_FORMAT_ID)
+        {
+            _static_format_ids[static_id].store(id + 1, std::memory_order_release);
+        }
+        if (inserted)
+        {
+            return;
+        }
+        lock.unlock();
+
+        encode(encoder, id);
+        _submit(buffer);
+    }
+
+    void _submit(const std::string& buffer)
+    {
+        // Level filtering is already done, all records are logged at the
+        // highest level so that they are never filtered by spdlog.
+        _logger->log(spdlog::level::critical, spdlog::string_view_t(buffer.data(), buffer.size()));
+    }
+
+    std::shared_ptr<spdlog::logger> _logger;
+
+    std::mutex _format_lock;
+    std::unordered_map<std::string, uint32_t> _format_ids;
+    std::unique_ptr<std::atomic<uint32_t>[]> _static_format_ids;
+};
+
+} // namespace elklog
+
+#endif // ELKLOG_BINARY_LOGGER_H
@@ -19,6 +19,15 @@
  *        Provides a unified logger abstraction that is safe to call in any context
  *        (either RT or non-RT).
  *
+ *        By default, messages from rt threads are passed on from the rt consumer
+ *        thread to an spdlog async logger, which writes them from its own thread
+ *        pool. If ELKLOG_SINGLE_WRITER_THREAD is defined, the spdlog logger is
+ *        synchronous and written to from the rt consumer thread only, and
+ *        messages from non-rt threads are put in the rt queue as well, waiting
+ *        for room if it is full. All messages are then written by one thread,
+ *        in timestamp order. Messages from non-rt threads are then limited to
+ *        ELKLOG_RT_MESSAGE_SIZE characters, like those from rt threads.
+ *
  * @copyright Copyright 2020-2023 Elk Audio AB, Stockholm
  */
 
@@ -31,10 +40,24 @@
 #include <algorithm>
 #include <variant>
 #include <iomanip>
+#include <optional>
 
 #include <future>
+#include <mutex>
+#include <new>
+#include <cstdint>
+#include <iterator>
+#include <thread>
 
 #include "log_return_code.h"
+#include "log_stats.h"
+#include "log_telemetry.h"
+#include "log_module.h"
+#include "trace_event.h"
+#include "structured.h"
+#include "log_backend.h"
+#include "thread_config.h"
+#include "async_rotating_file_sink.h"
 
 #ifndef ELKLOG_DISABLE_LOGGING
 #include "spdlog/spdlog.h"
@@ -46,23 +69,55 @@
 
 #include "spdlog/async.h"
 #include "spdlog/spdlog.h"
+#include "spdlog/sinks/basic_file_sink.h"
 
 #include "rtlogger.h"
+#include "binary_logger.h"
+#include "ring_file_sink.h"
+#include "flush_barrier_sink.h"
 
 namespace elklog {
 
 constexpr int RTLOG_MESSAGE_SIZE = ELKLOG_RT_MESSAGE_SIZE;
+#ifdef ELKLOG_RT_VARIABLE_LENGTH_QUEUE
+constexpr int RTLOG_QUEUE_SIZE = ELKLOG_RT_QUEUE_BYTES;   // In bytes
+// Room for ELKLOG_RT_ERROR_QUEUE_SIZE messages of max length
+constexpr int RTLOG_ERROR_QUEUE_SIZE = ELKLOG_RT_ERROR_QUEUE_SIZE * sizeof(RtLogMessage<RTLOG_MESSAGE_SIZE>);
+#else
 constexpr int RTLOG_QUEUE_SIZE = ELKLOG_RT_QUEUE_SIZE;
+constexpr int RTLOG_ERROR_QUEUE_SIZE = ELKLOG_RT_ERROR_QUEUE_SIZE;
+#endif
+constexpr int RTLOG_TRACE_QUEUE_SIZE = ELKLOG_RT_TRACE_QUEUE_SIZE;   // In events
 constexpr int MAX_LOG_FILE_SIZE = ELKLOG_FILE_SIZE;   // In bytes
 constexpr auto RT_CONSUMER_POLL_PERIOD = std::chrono::milliseconds(50);
+constexpr auto RT_CONSUMER_MAX_IDLE_PERIOD = std::chrono::milliseconds(1000);
+constexpr int RT_CONSUMER_WAKEUP_THRESHOLD = 256; // In number of queued messages
+constexpr auto CLOSE_DRAIN_TIMEOUT = std::chrono::milliseconds(1000);
+constexpr auto FLUSH_RETRY_PERIOD = std::chrono::microseconds(100);
+
+#ifdef ELKLOG_SINGLE_WRITER_THREAD
+using LoggerFactory = spdlog::synchronous_factory;
+#else
+using LoggerFactory = spdlog::async_factory;
+#endif
 
 class ElkLogger
 {
+    using RtLoggerType = RtLogger<RTLOG_MESSAGE_SIZE, RTLOG_QUEUE_SIZE, RTLOG_ERROR_QUEUE_SIZE, RTLOG_TRACE_QUEUE_SIZE>;
+
 public:
     enum class Type
     {
         TEXT,
-        JSON
+        JSON,
+        BINARY
+    };
+
+    enum class OverflowPolicy
+    {
+        BLOCK,
+        OVERRUN_OLDEST,
+        DISCARD_NEW
     };
 
     /**
@@ -72,16 +127,67 @@ public:
      *        error codes.
      *
      * @param min_log_level Minimum logging level (debug, info, warning, error)
-     * @param logger_type Choose between TYPE::TEXT (default), and JSON.
+     * @param logger_type Choose between TYPE::TEXT (default), JSON and BINARY.
+     *                    BINARY writes compact binary records that are decoded
+     *                    offline with the elklog_decode tool. Binary logs are
+     *                    not rotated.
+     * @param rt_poll_period How often the queue of messages from rt threads is checked
+     * @param rt_max_idle_period The poll period backs off up to this period when no
+     *                           messages are logged from rt threads
+     * @param rt_wakeup_threshold Wake up the rt message consumer early when this many
+     *                            messages are queued, 0 to disable.
+     * @param rt_collapse_repeated Log identical consecutive messages from rt threads once,
+     *                             followed by a line with the number of repeats.
+     *                             Off by default, so that every message is logged.
+     * @param rt_memory Optional memory region of at least rt_memory_size() bytes,
+     *                  aligned to rt_memory_alignment(), i.e. backed by huge pages,
+     *                  where the queues for rt threads are placed. Must outlive the
+     *                  logger. If nullptr or not aligned, they are allocated on the
+     *                  heap. With ELKLOG_RT_PER_THREAD_QUEUES, the fifos of each
+     *                  thread are always allocated on the heap.
+     * @param backend Optional backend shared with other loggers, see log_backend.h.
+     *                The rt queues are then consumed by the threads of the backend,
+     *                with its poll periods instead of rt_poll_period and
+     *                rt_max_idle_period, and the log file is written by its writer
+     *                threads.
      */
     ElkLogger(const std::string& min_log_level,
-              Type logger_type = Type::TEXT) :
+              Type logger_type = Type::TEXT,
+              std::chrono::milliseconds rt_poll_period = RT_CONSUMER_POLL_PERIOD,
+              std::chrono::milliseconds rt_max_idle_period = RT_CONSUMER_MAX_IDLE_PERIOD,
+              int rt_wakeup_threshold = RT_CONSUMER_WAKEUP_THRESHOLD,
+              bool rt_collapse_repeated = false,
+              void* rt_memory = nullptr,
+              std::shared_ptr<LogBackend> backend = nullptr) :
              _min_log_level(min_log_level),
+             _backend(std::move(backend)),
              _type(logger_type)
     {
-        _rt_logger = std::make_unique<RtLogger<RTLOG_MESSAGE_SIZE, RTLOG_QUEUE_SIZE>>(RT_CONSUMER_POLL_PERIOD,
-                std::bind(&ElkLogger::_rt_logger_callback, this, std::placeholders::_1),
-                min_log_level);
+        spdlog::level::level_enum level;
+        _level.store(_parse_level(min_log_level, level) ? level : spdlog::level::info);
+        for (auto& module_level : _module_levels)
+        {
+            module_level.store(NO_LEVEL_OVERRIDE);
+        }
+
+        bool use_rt_memory = rt_memory != nullptr &&
+                             reinterpret_cast<uintptr_t>(rt_memory) % rt_memory_alignment() == 0;
+        auto location = use_rt_memory ? rt_memory : ::operator new(rt_memory_size(), std::align_val_t(rt_memory_alignment()));
+        // Prefaults its memory, and locks it with ELKLOG_RT_LOCK_MEMORY, before starting the consumer
+        auto rt_logger = new (location) RtLoggerType(rt_poll_period,
+                [this](const RtLogBatch<RTLOG_MESSAGE_SIZE>& batch) { _rt_logger_callback(batch); },
+                min_log_level,
+                rt_wakeup_threshold,
+                rt_max_idle_period,
+                logger_type != Type::BINARY,
+                rt_collapse_repeated,
+                [this](const TraceEvent* events, size_t count) { _trace_callback(events, count); },
+                _backend ? &_backend->consumer_pool() : nullptr);
+        _rt_logger = std::unique_ptr<RtLoggerType, RtLoggerDeleter>(rt_logger, RtLoggerDeleter{use_rt_memory == false});
+        if (logger_type == Type::JSON)
+        {
+            _rt_logger->set_field_encoding(FieldEncoding::JSON);
+        }
     }
 
     virtual ~ElkLogger()
@@ -89,8 +195,15 @@ public:
         if (_logger_instance)
         {
             close_log();
+            if (_backend)
+            {
+                _backend->remove_flush(_logger_instance);
+            }
             spdlog::drop(_logger_instance->name());
         }
+        // Consumes what is left before the members used by its callbacks,
+        // declared after it, are destroyed
+        _rt_logger.reset();
 
         _closed_promise.set_value(_closed);
     }
@@ -99,6 +212,20 @@ public:
      * @brief Initialize logger
      *
      * @param log_file_path Log file (should be unique for each instance)
+     * @param ring_file_size If > 0, log to a memory-mapped ring file of this
+     *                       size in bytes instead of rotating files, see
+     *                       ring_file_sink.h. Not supported for binary logs.
+     * @param overflow_policy What log calls from non-rt threads do when the queue
+     *                        to the writer thread is full: BLOCK waits for room,
+     *                        OVERRUN_OLDEST replaces the oldest queued message and
+     *                        DISCARD_NEW drops the new message. Dropped messages
+     *                        are counted in stats(). With ELKLOG_SINGLE_WRITER_THREAD,
+     *                        non-rt messages go through the rt queue, where
+     *                        OVERRUN_OLDEST drops the new message.
+     * @param queue_size Size of the queue to the writer thread in messages, 0 for
+     *                   spdlog's default. Unless the default policy and size are
+     *                   used, the logger gets its own writer thread. With a
+     *                   backend, the writer queue of the backend is used instead.
      *
      * @return Error code. LogErrorCode::OK if all good.
      *         Can be passed straight to << stream operators
@@ -108,32 +235,24 @@ public:
                       const std::string& logger_name,
                       std::chrono::seconds flush_interval = std::chrono::seconds(0),
                       bool drop_logger_if_duplicate = false,
-                      int max_files = 1)
+                      int max_files = 1,
+                      size_t ring_file_size = 0,
+                      OverflowPolicy overflow_policy = OverflowPolicy::BLOCK,
+                      size_t queue_size = 0)
     {
-        std::map<std::string, spdlog::level::level_enum> level_map;
-        level_map["debug"] = spdlog::level::debug;
-        level_map["info"] = spdlog::level::info;
-        level_map["warning"] = spdlog::level::warn;
-        level_map["error"] = spdlog::level::err;
-        level_map["critical"] = spdlog::level::critical;
-
         _log_file_path = log_file_path;
-
-        std::string log_level_lowercase = _min_log_level;
-        std::transform(_min_log_level.begin(), _min_log_level.end(), log_level_lowercase.begin(), ::tolower);
-
-        if (flush_interval.count() > 0)
+        _overflow_policy = overflow_policy;
+        _writer_queue_size = queue_size;
+        if (ring_file_size > 0 && _type == Type::BINARY)
         {
-            spdlog::flush_every(std::chrono::seconds(flush_interval));
+            return Status::FAILED_TO_START_LOGGER;
         }
 
-        if (level_map.count(log_level_lowercase) <= 0)
+        spdlog::level::level_enum log_level;
+        if (_parse_level(_min_log_level, log_level) == false)
         {
             return Status::INVALID_LOG_LEVEL;
         }
-        auto log_level = level_map[log_level_lowercase];
-        spdlog::set_level(log_level);
-        spdlog::flush_on(log_level);
 
         // Check for already registered logger
         auto possible_logger = spdlog::get(logger_name);
@@ -148,11 +267,32 @@ public:
 
         try
         {
-            _logger_instance = spdlog::rotating_logger_mt<spdlog::async_factory>(logger_name,
-                                                                                 log_file_path,
-                                                                                 MAX_LOG_FILE_SIZE,
-                                                                                 max_files,
-                                                                                 false);
+            if (_type == Type::BINARY)
+            {
+                _logger_instance = _create_logger<spdlog::sinks::basic_file_sink_mt>(logger_name,
+                                                                                     log_file_path,
+                                                                                     true);
+            }
+            else if (ring_file_size > 0)
+            {
+                _logger_instance = _create_logger<ring_file_sink_mt>(logger_name,
+                                                                     log_file_path,
+                                                                     ring_file_size);
+            }
+            else if (_rotation)
+            {
+                _logger_instance = _create_logger<async_rotating_file_sink_mt>(logger_name,
+                                                                               log_file_path,
+                                                                               *_rotation);
+            }
+            else
+            {
+                _logger_instance = _create_logger<spdlog::sinks::rotating_file_sink_mt>(logger_name,
+                                                                                        log_file_path,
+                                                                                        MAX_LOG_FILE_SIZE,
+                                                                                        max_files,
+                                                                                        false);
+            }
         }
         catch (const std::exception &ex)
         {
@@ -164,128 +304,445 @@ public:
             return Status::FAILED_TO_START_LOGGER;
         }
 
-        if (_type == Type::JSON)
+        // Set on this logger only, so that other loggers keep their settings. Writes
+        // to a ring file should stay memcpys, it is synced to disk on flush_interval.
+        _logger_instance->flush_on(ring_file_size > 0 ? spdlog::level::off : log_level);
+        if (flush_interval.count() > 0)
         {
-            // We have some extra formatting on the log level %l below,
-            // to keep color coding when dumping json to the console,
-            // and we use a full ISO 8601 time/date format.
-
-            // "time" here is human-readable - there's another raw timestamp in the payload from wrappers.
-            _logger_instance->set_pattern(
-                "{\"time\": \"%Y-%m-%dT%H:%M:%S.%e%z\", "
-                "\"name\": \"%n\", "
-                "\"level\": \"%^%l%$\", "
-                "\"process\": %P, "
-                "\"thread\": %t, "
-                "\"data\": %v}");
+            if (_backend)
+            {
+                _backend->add_flush(_logger_instance, flush_interval);
+            }
+            else
+            {
+                spdlog::flush_every(std::chrono::seconds(flush_interval));
+            }
+        }
+        _update_passthrough_level();
 
-            _logger_instance->info("{}", R"({ "status": "Started" })");
+        if (_type == Type::JSON)
+        {
+            _logger_instance->set_pattern(JSON_PATTERN);
+            _log(spdlog::level::info, "", kv("status", "Started"));
+        }
+        else if (_type == Type::BINARY)
+        {
+            _binary_writer = std::make_unique<BinaryLogWriter>(_logger_instance);
+            _binary_writer->write_header(logger_name);
+            _binary_writer->log(spdlog::level::info, "Started logger: {}.", logger_name);
         }
         else
         {
-            _logger_instance->set_pattern("[%Y-%m-%d %T.%e] [%l] %v");
+            // With the thread id of the thread that logged the message, also for rt threads
+            _logger_instance->set_pattern("[%Y-%m-%d %T.%e] [%l] [%t] %v");
             _logger_instance->info("Started logger: {}.", logger_name);
         }
 
         return Status::OK;
     }
 
-    template<typename... Args>
-    void debug(const char* format_str, Args&&... args)
+    /**
+     * @brief Log a message from either an rt or a non-rt thread. The level of
+     *        module is used instead of the logger's level if one is set with
+     *        set_module_level(). This is used by the ELKLOG_LOG_* macros.
+     */
+    template<RtLogLevel level, typename Format, typename... Args>
+    void log(const LogModule* module, const Format& format_str, Args&&... args)
     {
-        if (_closed == true) return;
+        check_message<Format, Args...>();
+        if (ELKLOG_UNLIKELY(_closed == true || should_log(module, level) == false)) return;
 
         if (twine::is_current_thread_realtime())
         {
-            _rt_logger->log_debug(format_str, args...);
+            _rt_logger->log<level>(format_str, args...);
         }
         else
         {
-            _logger_instance->debug(format_str, args...);
+            _log_non_rt<level>(format_str, args...);
         }
     }
 
-    template<typename... Args>
-    void info(const char* format_str, Args&&... args)
+    template<typename Format, typename... Args>
+    void debug(const Format& format_str, Args&&... args)
+    {
+        log<RtLogLevel::DEBUG>(nullptr, format_str, args...);
+    }
+
+    template<typename Format, typename... Args>
+    void info(const Format& format_str, Args&&... args)
     {
-        if (_closed == true) return;
+        log<RtLogLevel::INFO>(nullptr, format_str, args...);
+    }
+
+    template<typename Format, typename... Args>
+    void info_rt(const Format& format_str, Args&&... args)
+    {
+        check_message<Format, Args...>();
+        if (_closed == true || should_log(nullptr, RtLogLevel::INFO) == false) return;
 
+        _rt_logger->log_info(format_str, args...);
+    }
+
+    template<typename Format, typename... Args>
+    void warning(const Format& format_str, Args&&... args)
+    {
+        log<RtLogLevel::WARNING>(nullptr, format_str, args...);
+    }
+
+    template<typename Format, typename... Args>
+    void error(const Format& format_str, Args&&... args)
+    {
+        log<RtLogLevel::ERROR>(nullptr, format_str, args...);
+    }
+
+    /**
+     * @brief Handle for logging from a single thread. Whether the thread is
+     *        realtime, and its rt queues, are resolved once when the handle is
+     *        created instead of on every log call. A handle must only be used
+     *        from the thread that created it, and rt threads must be marked as
+     *        realtime before creating their handle.
+     */
+    class ThreadHandle
+    {
+    public:
+        ThreadHandle() = default;
+
+        template<RtLogLevel level, typename Format, typename... Args>
+        void log(const LogModule* module, const Format& format_str, Args&&... args)
+        {
+            check_message<Format, Args...>();
+            if (ELKLOG_UNLIKELY(should_log(module, level) == false || _logger->_closed == true)) return;
+
+            if (_realtime)
+            {
+                _logger->_rt_logger->template log_bound<level>(_binding, format_str, args...);
+            }
+            else
+            {
+                _logger->template _log_non_rt<level>(format_str, args...);
+            }
+        }
+
+        template<typename Format, typename... Args>
+        void debug(const Format& format_str, Args&&... args)
+        {
+            log<RtLogLevel::DEBUG>(nullptr, format_str, args...);
+        }
+
+        template<typename Format, typename... Args>
+        void info(const Format& format_str, Args&&... args)
+        {
+            log<RtLogLevel::INFO>(nullptr, format_str, args...);
+        }
+
+        template<typename Format, typename... Args>
+        void warning(const Format& format_str, Args&&... args)
+        {
+            log<RtLogLevel::WARNING>(nullptr, format_str, args...);
+        }
+
+        template<typename Format, typename... Args>
+        void error(const Format& format_str, Args&&... args)
+        {
+            log<RtLogLevel::ERROR>(nullptr, format_str, args...);
+        }
+
+        bool should_log(const LogModule* module, RtLogLevel level) const
+        {
+            return _logger != nullptr && _logger->should_log(module, level);
+        }
+
+        bool is_realtime() const
+        {
+            return _realtime;
+        }
+
+        ElkLogger* logger() const
+        {
+            return _logger;
+        }
+
+    private:
+        friend class ElkLogger;
+
+        ThreadHandle(ElkLogger* logger, bool realtime, RtLoggerType::ThreadBinding binding) :
+            _logger(logger),
+            _realtime(realtime),
+            _binding(binding)
+        {}
+
+        ElkLogger* _logger {nullptr};
+        bool _realtime {false};
+        RtLoggerType::ThreadBinding _binding {};
+    };
+
+    /**
+     * @brief Create a logging handle for the calling thread, see ThreadHandle
+     */
+    ThreadHandle thread_handle()
+    {
         if (twine::is_current_thread_realtime())
         {
-            _rt_logger->log_info(format_str, args...);
+            return ThreadHandle(this, true, _rt_logger->bind_thread());
         }
-        else
+        return ThreadHandle(this, false, {});
+    }
+
+    /**
+     * @brief Start writing trace events to a file in Chrome trace JSON format,
+     *        replacing any trace already started. Fails if tracing is disabled
+     *        with ELKLOG_RT_TRACE_QUEUE_SIZE = 0. Not safe to call from rt threads.
+     */
+    Status start_trace(const std::string& trace_file_path)
+    {
+        if constexpr (RTLOG_TRACE_QUEUE_SIZE == 0)
         {
-            _logger_instance->info(format_str, args...);
+            return Status::FAILED_TO_START_LOGGER;
         }
+        auto writer = std::make_unique<TraceWriter>(trace_file_path);
+        if (writer->is_open() == false)
+        {
+            return Status::FAILED_TO_START_LOGGER;
+        }
+        std::scoped_lock lock(_trace_lock);
+        _trace_writer = std::move(writer);
+        _tracing.store(true, std::memory_order_relaxed);
+        return Status::OK;
     }
 
-    template<typename... Args>
-    void info_rt(const char* format_str, Args&&... args)
+    /**
+     * @brief Stop tracing and close the trace file, after the events already
+     *        traced have been written. Not safe to call from rt threads.
+     */
+    void stop_trace()
     {
-        if (_closed == true) return;
+        _tracing.store(false, std::memory_order_relaxed);
+        _rt_logger->drain(CLOSE_DRAIN_TIMEOUT);
+        std::scoped_lock lock(_trace_lock);
+        _trace_writer.reset();
+    }
 
-        _rt_logger->log_info(format_str, args...);
+    /**
+     * @brief Trace events, safe to call from any thread, and do nothing unless
+     *        start_trace() was called. Names must be created with ELKLOG_TRACE_NAME.
+     */
+    template<typename Name>
+    void trace_begin(const Name& name)
+    {
+        trace_event(TraceEventType::BEGIN, _trace_name_id(name));
     }
 
-    template<typename... Args>
-    void warning(const char* format_str, Args&&... args)
+    template<typename Name>
+    void trace_end(const Name& name)
     {
-        if (_closed == true) return;
+        trace_event(TraceEventType::END, _trace_name_id(name));
+    }
 
-        if (twine::is_current_thread_realtime())
+    template<typename Name>
+    void trace_instant(const Name& name)
+    {
+        trace_event(TraceEventType::INSTANT, _trace_name_id(name));
+    }
+
+    template<typename Name>
+    void trace_counter(const Name& name, int64_t value)
+    {
+        trace_event(TraceEventType::COUNTER, _trace_name_id(name), value);
+    }
+
+    /**
+     * @brief Begin a span that ends when the returned object goes out of scope
+     */
+    template<typename Name>
+    TraceScope<ElkLogger> trace_scope(const Name& name)
+    {
+        return TraceScope<ElkLogger>(*this, _trace_name_id(name));
+    }
+
+    void trace_event(TraceEventType type, uint32_t name_id, int64_t value = 0)
+    {
+        if (_tracing.load(std::memory_order_relaxed))
         {
-            _rt_logger->log_warning(format_str, args...);
+            _rt_logger->trace_event(type, name_id, value);
         }
-        else
+    }
+
+    /**
+     * @brief Returns true if a message at the given level would be logged.
+     *        Only does relaxed atomic loads, safe to call from rt threads.
+     */
+    bool should_log(const LogModule* module, RtLogLevel level) const
+    {
+        int spdlog_level = _to_spdlog_level(level);
+        if (module != nullptr && module->id() < ELKLOG_MAX_LOG_MODULES)
         {
-            _logger_instance->warn(format_str, args...);
+            int module_level = _module_levels[module->id()].load(std::memory_order_relaxed);
+            if (module_level != NO_LEVEL_OVERRIDE)
+            {
+                return spdlog_level >= module_level;
+            }
         }
+        return spdlog_level >= _level.load(std::memory_order_relaxed);
     }
 
-    template<typename... Args>
-    void error(const char* format_str, Args&&... args)
+    /**
+     * @brief Change the minimum log level of the logger, for messages from both
+     *        rt and non-rt threads. Safe to call from rt threads, but not from
+     *        multiple threads at the same time. From rt threads only atomic
+     *        levels are stored, the level of the spdlog logger is updated by
+     *        the next thread that passes a message on to it.
+     */
+    void set_level(RtLogLevel level)
     {
-        if (_closed == true) return;
-
+        _level.store(_to_spdlog_level(level), std::memory_order_relaxed);
         if (twine::is_current_thread_realtime())
         {
-            _rt_logger->log_error(format_str, args...);
+            _rt_logger->set_min_log_level(_to_rt_level(_passthrough_level()));
+            _passthrough_level_pending.store(true, std::memory_order_release);
         }
         else
         {
-            _logger_instance->error(format_str, args...);
+            _update_passthrough_level();
         }
     }
 
-    void close_log()
+    /**
+     * @brief Rotate the log file with the given file size, file count, interval
+     *        and compression instead of with MAX_LOG_FILE_SIZE and the max_files
+     *        passed to initialize(). Files are rotated without stalling the writer
+     *        thread, see async_rotating_file_sink.h. Must be called before
+     *        initialize(), which fails if the config can not be used, i.e. if
+     *        compression is not built in.
+     */
+    void set_rotation_config(const RotationConfig& config)
     {
-        if (_type != Type::JSON)
+        _rotation = config;
+    }
+
+    /**
+     * @brief Set the affinity, scheduling and name of the threads of this logger,
+     *        i.e. to keep them off the cores of rt threads. Applied to the rt
+     *        consumer thread at once. Applied to the writer thread only if called
+     *        before initialize(), and only if spdlog's global thread pool has not
+     *        been created yet by another async logger. Loggers with a LogBackend
+     *        are configured through the backend instead. Not safe to call from
+     *        rt threads.
+     */
+    Status set_thread_config(const ThreadConfig& config)
+    {
+        if (_backend)
         {
-            _logger_instance->flush();
-            _closed = true;
-            return;
+            return Status::FAILED_TO_CONFIGURE_THREAD;
         }
+        _thread_config = config;
+        return _rt_logger->set_consumer_thread_config(config);
+    }
 
-        if (_closed == true) return;
+    /**
+     * @brief As above, but the level is given as a string (debug, info, warning,
+     *        error, critical). Not safe to call from rt threads.
+     */
+    Status set_level(const std::string& level)
+    {
+        spdlog::level::level_enum spdlog_level;
+        if (_parse_level(level, spdlog_level) == false)
+        {
+            return Status::INVALID_LOG_LEVEL;
+        }
+        _level.store(spdlog_level, std::memory_order_relaxed);
+        _update_passthrough_level();
+        return Status::OK;
+    }
 
-        _logger_instance->flush();
+    /**
+     * @brief Set a level for all modules with the given name, as passed to
+     *        ELKLOG_GET_LOGGER_WITH_MODULE_NAME. Overrides the logger's level
+     *        in both directions, i.e. a module can log debug messages while the
+     *        rest of the logger is at warning level. Not safe to call from rt
+     *        threads.
+     */
+    Status set_module_level(const std::string& module_name, const std::string& level)
+    {
+        spdlog::level::level_enum spdlog_level;
+        if (_parse_level(level, spdlog_level) == false)
+        {
+            return Status::INVALID_LOG_LEVEL;
+        }
+        LogModuleRegistry::for_each_module(module_name.c_str(), [&](uint32_t id)
+        {
+            _module_levels[id].store(spdlog_level, std::memory_order_relaxed);
+        });
+        _update_module_passthrough_level();
+        return Status::OK;
+    }
 
-        // We have some extra formatting on the log level %l below,
-        // to keep color coding when dumping json to the console,
-        // and we use a full ISO 8601 time/date format.
-        _logger_instance->set_pattern(
-            "{\"time\": \"%Y-%m-%dT%H:%M:%S.%e%z\", "
-            "\"name\": \"%n\", "
-            "\"level\": \"%^%l%$\", "
-            "\"process\": %P, "
-            "\"thread\": %t, "
-            "\"data\": %v}");
+    /**
+     * @brief Remove a level set with set_module_level(), the module then uses
+     *        the logger's level again.
+     */
+    void clear_module_level(const std::string& module_name)
+    {
+        LogModuleRegistry::for_each_module(module_name.c_str(), [&](uint32_t id)
+        {
+            _module_levels[id].store(NO_LEVEL_OVERRIDE, std::memory_order_relaxed);
+        });
+        _update_module_passthrough_level();
+    }
 
-        // Below is our last log entry.
-        _logger_instance->info(R"({ "status": "Finished" })");
-        _logger_instance->flush();
+    /**
+     * @brief Wait until everything logged before the call, from rt and non-rt
+     *        threads, has been written to the log file and synced to disk, or
+     *        until timeout. Not safe to call from rt threads.
+     * @return FAILED_TO_FLUSH if not everything was written within timeout,
+     *         or if the file could not be synced
+     */
+    Status flush(std::chrono::milliseconds timeout)
+    {
+        if (_logger_instance == nullptr)
+        {
+            return Status::FAILED_TO_FLUSH;
+        }
+        auto deadline = std::chrono::steady_clock::now() + timeout;
+        // Passes the messages of rt threads, and of non-rt threads with
+        // ELKLOG_SINGLE_WRITER_THREAD, on to the writer queue
+        if (_rt_logger->drain(timeout) == false)
+        {
+            return Status::FAILED_TO_FLUSH;
+        }
+#ifndef ELKLOG_SINGLE_WRITER_THREAD
+        // A barrier queued to a full writer queue would overrun a message,
+        // unless the policy is BLOCK
+        while (_writer_pool && _overflow_policy != OverflowPolicy::BLOCK &&
+               _writer_pool->queue_size() >= _writer_queue_size)
+        {
+            if (std::chrono::steady_clock::now() >= deadline)
+            {
+                return Status::FAILED_TO_FLUSH;
+            }
+            std::this_thread::sleep_for(FLUSH_RETRY_PERIOD);
+        }
+#endif
+        auto barrier = _flush_barrier->post(*_logger_instance);
+        if (_flush_barrier->wait(barrier, deadline) == false)
+        {
+            return Status::FAILED_TO_FLUSH;
+        }
+        return sync_file(_log_file_path) ? Status::OK : Status::FAILED_TO_FLUSH;
+    }
 
+    /**
+     * @brief Write everything queued to the log file, messages logged from rt
+     *        threads after this are dropped. Called when the logger is destroyed.
+     */
+    void close_log()
+    {
+        if (_type == Type::JSON && _closed == false)
+        {
+            // Below is our last log entry, after the ones still in the rt queue.
+            _rt_logger->drain(CLOSE_DRAIN_TIMEOUT);
+            _log(spdlog::level::info, "", kv("status", "Finished"));
+        }
+        flush(CLOSE_DRAIN_TIMEOUT);
         _closed = true;
     }
 
@@ -304,39 +761,467 @@ public:
         return _closed_promise;
     }
 
+    /**
+     * @brief Statistics of messages logged from rt threads, i.e. how many were
+     *        pushed, consumed, filtered and dropped because the queue was full.
+     *        With ELKLOG_SINGLE_WRITER_THREAD, messages from non-rt threads
+     *        are included. Otherwise, messages from non-rt threads are only
+     *        included when dropped by the overflow policy. Overruns are counted
+     *        for the whole writer queue, which is shared with the other loggers
+     *        of a backend.
+     */
+    LogStats stats() const
+    {
+        auto stats = _rt_logger->stats();
+#ifndef ELKLOG_SINGLE_WRITER_THREAD
+        if (_writer_pool && _overflow_policy != OverflowPolicy::BLOCK)
+        {
+            stats.overrun = _writer_pool->overrun_counter();
+        }
+#endif
+        return stats;
+    }
+
+    /**
+     * @brief Histograms of the size, producer cost and queue latency of
+     *        messages logged from rt threads, and from non-rt threads with
+     *        ELKLOG_SINGLE_WRITER_THREAD. Empty unless ELKLOG_RT_TELEMETRY
+     *        is defined, see log_telemetry.h.
+     */
+    LogTelemetry telemetry() const
+    {
+        return _rt_logger->telemetry();
+    }
+
+    void reset_telemetry()
+    {
+        _rt_logger->reset_telemetry();
+    }
+
+    /**
+     * @brief Log a summary of telemetry() every period, 0 to stop
+     */
+    void set_telemetry_report_period(std::chrono::milliseconds period)
+    {
+        _rt_logger->set_telemetry_report_period(period);
+    }
+
+    /**
+     * @brief Log a summary of telemetry() now, at info level
+     */
+    void log_telemetry()
+    {
+        for_each_histogram(telemetry(), [&](const char* name, const HistogramSnapshot& histogram)
+        {
+            info("{}: {}", name, histogram.summary());
+        });
+    }
+
+    /**
+     * @brief Size and alignment of the memory region that can be passed to the
+     *        constructor as rt_memory
+     */
+    static constexpr size_t rt_memory_size()
+    {
+        return sizeof(RtLoggerType);
+    }
+
+    static constexpr size_t rt_memory_alignment()
+    {
+        return alignof(RtLoggerType);
+    }
+
+    /**
+     * @brief Returns true if the memory used by rt threads is locked in memory,
+     *        requires ELKLOG_RT_LOCK_MEMORY and a large enough RLIMIT_MEMLOCK
+     */
+    bool rt_memory_locked() const
+    {
+        return _rt_logger->memory_locked();
+    }
+
 private:
-    void _rt_logger_callback(const RtLogMessage<RTLOG_MESSAGE_SIZE>& msg)
+    static constexpr int NO_LEVEL_OVERRIDE = -1;
+
+    // We have some extra formatting on the log level %l below,
+    // to keep color coding when dumping json to the console,
+    // and we use a full ISO 8601 time/date format.
+    // "time" here is human-readable - there's another raw timestamp in the payload from wrappers.
+    static constexpr const char* JSON_PATTERN = "{\"time\": \"%Y-%m-%dT%H:%M:%S.%e%z\", "
+                                                "\"name\": \"%n\", "
+                                                "\"level\": \"%^%l%$\", "
+                                                "\"process\": %P, "
+                                                "\"thread\": %t, "
+                                                "\"data\": %v}";
+
+    // Only frees the memory if it was allocated by ElkLogger
+    struct RtLoggerDeleter
     {
-        if (_closed) return;
+        bool owns_memory;
 
-        switch (msg.level())
+        void operator()(RtLoggerType* rt_logger) const
         {
-        case RtLogLevel::DEBUG:
-            _logger_instance->debug("{}", msg.message());
-            break;
+            rt_logger->~RtLoggerType();
+            if (owns_memory)
+            {
+                ::operator delete(rt_logger, std::align_val_t(rt_memory_alignment()));
+            }
+        }
+    };
 
-        case RtLogLevel::INFO:
-            _logger_instance->info("{}", msg.message());
-            break;
+    static bool _parse_level(const std::string& level, spdlog::level::level_enum& spdlog_level)
+    {
+        std::map<std::string, spdlog::level::level_enum> level_map;
+        level_map["debug"] = spdlog::level::debug;
+        level_map["info"] = spdlog::level::info;
+        level_map["warning"] = spdlog::level::warn;
+        level_map["error"] = spdlog::level::err;
+        level_map["critical"] = spdlog::level::critical;
 
-        case RtLogLevel::WARNING:
-            _logger_instance->warn("{}", msg.message());
-            break;
+        std::string level_lowercase = level;
+        std::transform(level.begin(), level.end(), level_lowercase.begin(), ::tolower);
+
+        auto entry = level_map.find(level_lowercase);
+        if (entry == level_map.end())
+        {
+            return false;
+        }
+        spdlog_level = entry->second;
+        return true;
+    }
+
+    /**
+     * @brief Filtering is done by should_log(), so the spdlog logger and the rt
+     *        logger are set to let through the most verbose of all active levels
+     */
+    spdlog::level::level_enum _passthrough_level() const
+    {
+        return static_cast<spdlog::level::level_enum>(std::min(_level.load(std::memory_order_relaxed),
+                                                               _module_passthrough_level.load(std::memory_order_relaxed)));
+    }
+
+    void _update_passthrough_level()
+    {
+        auto level = _passthrough_level();
+        if (_logger_instance)
+        {
+            _logger_instance->set_level(level);
+        }
+        _rt_logger->set_min_log_level(_to_rt_level(level));
+    }
+
+    void _update_module_passthrough_level()
+    {
+        int level = spdlog::level::off;
+        for (const auto& module_level : _module_levels)
+        {
+            int override_level = module_level.load(std::memory_order_relaxed);
+            if (override_level != NO_LEVEL_OVERRIDE)
+            {
+                level = std::min(level, override_level);
+            }
+        }
+        _module_passthrough_level.store(level, std::memory_order_relaxed);
+        _update_passthrough_level();
+    }
+
+    /**
+     * @brief Update the level of the spdlog logger after set_level() was
+     *        called from an rt thread, as it is not atomic
+     */
+    void _apply_pending_passthrough_level()
+    {
+        if (ELKLOG_UNLIKELY(_passthrough_level_pending.load(std::memory_order_relaxed)) &&
+            _passthrough_level_pending.exchange(false, std::memory_order_acquire))
+        {
+            _update_passthrough_level();
+        }
+    }
+
+    /**
+     * @brief Create a logger writing to a Sink, which also handles the barriers of flush()
+     */
+    template<typename Sink, typename... SinkArgs>
+    std::shared_ptr<spdlog::logger> _create_logger(const std::string& logger_name, SinkArgs&&... args)
+    {
+        auto logger = _create_spdlog_logger<FlushBarrierSink<Sink>>(logger_name, std::forward<SinkArgs>(args)...);
+        if (logger)
+        {
+            _flush_barrier = std::static_pointer_cast<FlushBarrierSink<Sink>>(logger->sinks().front());
+        }
+        return logger;
+    }
+
+    template<typename Sink, typename... SinkArgs>
+    std::shared_ptr<spdlog::logger> _create_spdlog_logger(const std::string& logger_name, SinkArgs&&... args)
+    {
+        if (_backend)
+        {
+#ifdef ELKLOG_SINGLE_WRITER_THREAD
+            return _backend->create_logger<Sink>(logger_name, std::forward<SinkArgs>(args)...);
+#else
+            // Through the writer threads of the backend, with the overflow policy of this logger
+            return _create_async_logger<Sink>(logger_name, std::forward<SinkArgs>(args)...);
+#endif
+        }
+#ifndef ELKLOG_SINGLE_WRITER_THREAD
+        if (_overflow_policy != OverflowPolicy::BLOCK || _writer_queue_size > 0)
+        {
+            return _create_async_logger<Sink>(logger_name, std::forward<SinkArgs>(args)...);
+        }
+        if (_thread_config.empty() == false && spdlog::thread_pool() == nullptr)
+        {
+            // Otherwise created by the factory, with the default configuration
+            spdlog::init_thread_pool(spdlog::details::default_async_q_size, 1, [config = _thread_config]()
+            {
+                apply_thread_config(config);
+            });
+        }
+#endif
+        return LoggerFactory::create<Sink>(logger_name, std::forward<SinkArgs>(args)...);
+    }
+
+#ifndef ELKLOG_SINGLE_WRITER_THREAD
+    /**
+     * @brief Create a logger that writes through the writer queue of the backend,
+     *        or through its own writer queue, with the overflow policy of the logger
+     */
+    template<typename Sink, typename... SinkArgs>
+    std::shared_ptr<spdlog::logger> _create_async_logger(const std::string& logger_name, SinkArgs&&... args)
+    {
+        if (_backend)
+        {
+            _writer_pool = _backend->writer_pool();
+            _writer_queue_size = _backend->writer_queue_size();
+        }
+        else
+        {
+            if (_writer_queue_size == 0)
+            {
+                _writer_queue_size = spdlog::details::default_async_q_size;
+            }
+            _writer_pool = std::make_shared<spdlog::details::thread_pool>(_writer_queue_size, 1, [config = _thread_config]()
+            {
+                apply_thread_config(config);
+            });
+        }
+        // Drops of new messages are counted by the logger before they are queued
+        auto policy = _overflow_policy == OverflowPolicy::BLOCK ? spdlog::async_overflow_policy::block :
+                                                                  spdlog::async_overflow_policy::overrun_oldest;
+        auto logger = std::make_shared<spdlog::async_logger>(logger_name,
+                                                             std::make_shared<Sink>(std::forward<SinkArgs>(args)...),
+                                                             _writer_pool, policy);
+        spdlog::initialize_logger(logger);
+        return logger;
+    }
+#endif
+
+    template<RtLogLevel level, typename Format, typename... Args>
+    void _log_non_rt(const Format& format_str, Args&&... args)
+    {
+#ifdef ELKLOG_SINGLE_WRITER_THREAD
+        if (_overflow_policy == OverflowPolicy::BLOCK)
+        {
+            _rt_logger->log_blocking<level>(format_str, args...);
+        }
+        else
+        {
+            _rt_logger->log<level>(format_str, args...);
+        }
+#else
+        if (_overflow_policy == OverflowPolicy::DISCARD_NEW && _writer_pool &&
+            _writer_pool->queue_size() >= _writer_queue_size)
+        {
+            _rt_logger->count_dropped(level);
+            return;
+        }
+        _log(_to_spdlog_level(level), format_str, args...);
+#endif
+    }
 
+    template<typename Format, typename... Args>
+    void _log(spdlog::level::level_enum level, const Format& format_str, Args&&... args)
+    {
+        _apply_pending_passthrough_level();
+        if constexpr (are_fields<Args...>())
+        {
+            // Encoded here in one pass, and passed on as a plain string
+            thread_local fmt::memory_buffer buffer;
+            buffer.clear();
+            encode_fields(buffer, _type == Type::JSON ? FieldEncoding::JSON : FieldEncoding::TEXT,
+                          format_c_str(format_str), args...);
+            _log(level, "{}", std::string_view(buffer.data(), buffer.size()));
+        }
+        else if (_binary_writer)
+        {
+            _binary_writer->log(level, format_str, args...);
+        }
+        else if constexpr (is_static_format_v<Format>)
+        {
+            // Formatted here with the compiled format, and passed on as a plain string
+            if (_logger_instance->should_log(level))
+            {
+                thread_local fmt::memory_buffer buffer;
+                buffer.clear();
+                fmt::format_to(std::back_inserter(buffer), fmt_format(format_str), args...);
+                _logger_instance->log(level, spdlog::string_view_t(buffer.data(), buffer.size()));
+            }
+        }
+        else
+        {
+            _logger_instance->log(level, format_c_str(format_str), args...);
+        }
+    }
+
+    static spdlog::level::level_enum _to_spdlog_level(RtLogLevel level)
+    {
+        switch (level)
+        {
+        case RtLogLevel::DEBUG:
+            return spdlog::level::debug;
+        case RtLogLevel::INFO:
+            return spdlog::level::info;
+        case RtLogLevel::WARNING:
+            return spdlog::level::warn;
         case RtLogLevel::ERROR:
-            _logger_instance->error("{}", msg.message());
-            break;
+        default:
+            return spdlog::level::err;
+        }
+    }
+
+    static RtLogLevel _to_rt_level(spdlog::level::level_enum level)
+    {
+        switch (level)
+        {
+        case spdlog::level::trace:
+        case spdlog::level::debug:
+            return RtLogLevel::DEBUG;
+        case spdlog::level::info:
+            return RtLogLevel::INFO;
+        case spdlog::level::warn:
+            return RtLogLevel::WARNING;
+        default:
+            return RtLogLevel::ERROR;
+        }
+    }
+
+    /**
+     * @brief Convert an rt timestamp to the clock used by spdlog, which is not
+     *        necessarily the same clock, by taking its age relative to when
+     *        rt_now was read
+     */
+    static spdlog::log_clock::time_point _to_log_time(std::chrono::nanoseconds rt_timestamp,
+                                                      std::chrono::nanoseconds rt_now,
+                                                      spdlog::log_clock::time_point log_now)
+    {
+        auto age = rt_now - rt_timestamp;
+        return log_now - std::chrono::duration_cast<spdlog::log_clock::duration>(age);
+    }
+
+    /**
+     * @brief spdlog::logger::sink_it_() is protected, but a member pointer to it
+     *        can be taken through a derived class. This lets messages be passed
+     *        on with their own time and thread id.
+     */
+    struct LoggerAccess : public spdlog::logger
+    {
+        static auto sink_it()
+        {
+            return &LoggerAccess::sink_it_;
+        }
+    };
+
+    /**
+     * @brief Called from the rt consumer thread with each batch of rt messages.
+     *        The clocks are read once per batch. Unless ELKLOG_SINGLE_WRITER_THREAD
+     *        is defined, messages are then queued one at a time by spdlog's async
+     *        logger.
+     */
+    void _rt_logger_callback(const RtLogBatch<RTLOG_MESSAGE_SIZE>& batch)
+    {
+        if (_closed) return;
+        _apply_pending_passthrough_level();
+
+        auto rt_now = twine::current_rt_time();
+        auto log_now = spdlog::log_clock::now();
+        for (size_t i = 0; i < batch.size(); ++i)
+        {
+            const auto& msg = batch[i];
+            auto level = _to_spdlog_level(msg.level());
+            auto time = _to_log_time(msg.timestamp(), rt_now, log_now);
+            if (_binary_writer)
+            {
+                _binary_writer->log_rt(level, msg, time);
+                continue;
+            }
+
+            if (_logger_instance->should_log(level) == false)
+            {
+                continue;
+            }
+
+            // The message is already formatted so it is passed on without a format pass,
+            // with the time and thread id of the rt thread that logged it.
+            spdlog::details::log_msg log_msg(spdlog::source_loc{}, _logger_instance->name(), level,
+                                             spdlog::string_view_t(msg.message(), msg.length()));
+            log_msg.time = time;
+            if (msg.thread_id() != 0)
+            {
+                log_msg.thread_id = msg.thread_id();
+            }
+            (_logger_instance.get()->*LoggerAccess::sink_it())(log_msg);
+        }
+    }
+
+    template<typename Name>
+    static uint32_t _trace_name_id(const Name& name)
+    {
+        static_assert(is_static_format_v<Name>, "Trace names must be created with ELKLOG_TRACE_NAME");
+        return format_id(name);
+    }
+
+    void _trace_callback(const TraceEvent* events, size_t count)
+    {
+        std::scoped_lock lock(_trace_lock);
+        if (_trace_writer)
+        {
+            _trace_writer->write(events, count);
+            _trace_writer->flush();
         }
     }
 
     std::string _min_log_level;
     std::string _log_file_path;
+    // Declared before the rt logger, which it must outlive
+    std::shared_ptr<LogBackend> _backend;
+#ifndef ELKLOG_SINGLE_WRITER_THREAD
+    // Writer queue of the logger or its backend, unless spdlog's global one is used
+    std::shared_ptr<spdlog::details::thread_pool> _writer_pool;
+#endif
     std::shared_ptr<spdlog::logger> _logger_instance;
-    std::unique_ptr<RtLogger<RTLOG_MESSAGE_SIZE, RTLOG_QUEUE_SIZE>> _rt_logger {nullptr};
+    // The sink of _logger_instance
+    std::shared_ptr<FlushBarrier> _flush_barrier;
+    std::unique_ptr<RtLoggerType, RtLoggerDeleter> _rt_logger {nullptr, RtLoggerDeleter{true}};
+    std::unique_ptr<BinaryLogWriter> _binary_writer {nullptr};
+    ThreadConfig _thread_config;
+    std::optional<RotationConfig> _rotation;
+    OverflowPolicy _overflow_policy {OverflowPolicy::BLOCK};
+    size_t _writer_queue_size {0};
 
     Type _type {Type::TEXT};
     bool _closed {false};
 
+    // spdlog::level::level_enum values, or NO_LEVEL_OVERRIDE for modules
+    std::atomic<int> _level;
+    std::array<std::atomic<int>, ELKLOG_MAX_LOG_MODULES> _module_levels;
+    // The most verbose of the module levels, or spdlog::level::off if none are set
+    std::atomic<int> _module_passthrough_level {spdlog::level::off};
+    std::atomic<bool> _passthrough_level_pending {false};
+
+    std::atomic<bool> _tracing {false};
+    std::mutex _trace_lock;
+    std::unique_ptr<TraceWriter> _trace_writer;
+
     std::promise<bool> _closed_promise;
 };
 
@@ -352,11 +1237,25 @@ public:
     enum class Type
     {
         TEXT,
-        JSON
+        JSON,
+        BINARY
+    };
+
+    enum class OverflowPolicy
+    {
+        BLOCK,
+        OVERRUN_OLDEST,
+        DISCARD_NEW
     };
 
     ElkLogger([[maybe_unused]] const std::string& min_log_level,
-              [[maybe_unused]] Type logger_type = Type::TEXT)
+              [[maybe_unused]] Type logger_type = Type::TEXT,
+              [[maybe_unused]] std::chrono::milliseconds rt_poll_period = std::chrono::milliseconds(50),
+              [[maybe_unused]] std::chrono::milliseconds rt_max_idle_period = std::chrono::milliseconds(1000),
+              [[maybe_unused]] int rt_wakeup_threshold = 256,
+              [[maybe_unused]] bool rt_collapse_repeated = false,
+              [[maybe_unused]] void* rt_memory = nullptr,
+              [[maybe_unused]] std::shared_ptr<LogBackend> backend = nullptr)
     {}
 
     virtual ~ElkLogger() = default;
@@ -365,26 +1264,180 @@ public:
                       [[maybe_unused]] const std::string& logger_name = "\"elk_logger",
                       [[maybe_unused]] std::chrono::seconds flush_interval = std::chrono::seconds(0),
                       [[maybe_unused]] bool drop_logger_if_duplicate = false,
-                      [[maybe_unused]] int max_files = 1)
+                      [[maybe_unused]] int max_files = 1,
+                      [[maybe_unused]] size_t ring_file_size = 0,
+                      [[maybe_unused]] OverflowPolicy overflow_policy = OverflowPolicy::BLOCK,
+                      [[maybe_unused]] size_t queue_size = 0)
+    {
+        return Status::OK;
+    }
+
+    template<RtLogLevel level, typename Format, typename... Args>
+    void log(const LogModule* /*module*/, const Format& /*format_str*/, Args&&... /*args*/)
+    {}
+
+    template<typename Format, typename... Args>
+    void debug(const Format& /*format_str*/, Args&&... /*args*/)
+    {}
+
+    template<typename Format, typename... Args>
+    void info(const Format& /*format_str*/, Args&&... /*args*/)
+    {}
+
+    template<typename Format, typename... Args>
+    void warning(const Format& /*format_str*/, Args&&... /*args*/)
+    {}
+
+    template<typename Format, typename... Args>
+    void error(const Format& /*format_str*/, Args&&... /*args*/)
+    {}
+
+    class ThreadHandle
+    {
+    public:
+        template<RtLogLevel level, typename Format, typename... Args>
+        void log(const LogModule* /*module*/, const Format& /*format_str*/, Args&&... /*args*/)
+        {}
+
+        template<typename Format, typename... Args>
+        void debug(const Format& /*format_str*/, Args&&... /*args*/)
+        {}
+
+        template<typename Format, typename... Args>
+        void info(const Format& /*format_str*/, Args&&... /*args*/)
+        {}
+
+        template<typename Format, typename... Args>
+        void warning(const Format& /*format_str*/, Args&&... /*args*/)
+        {}
+
+        template<typename Format, typename... Args>
+        void error(const Format& /*format_str*/, Args&&... /*args*/)
+        {}
+
+        bool should_log(const LogModule* /*module*/, RtLogLevel /*level*/) const
+        {
+            return false;
+        }
+
+        bool is_realtime() const
+        {
+            return false;
+        }
+
+        ElkLogger* logger() const
+        {
+            return nullptr;
+        }
+    };
+
+    ThreadHandle thread_handle()
+    {
+        return {};
+    }
+
+    bool should_log([[maybe_unused]] const LogModule* module, [[maybe_unused]] RtLogLevel level) const
+    {
+        return false;
+    }
+
+    void set_level([[maybe_unused]] RtLogLevel level)
+    {}
+
+    void set_rotation_config([[maybe_unused]] const RotationConfig& config)
+    {}
+
+    Status set_thread_config([[maybe_unused]] const ThreadConfig& config)
+    {
+        return Status::OK;
+    }
+
+    Status flush([[maybe_unused]] std::chrono::milliseconds timeout)
+    {
+        return Status::OK;
+    }
+
+    Status set_level([[maybe_unused]] const std::string& level)
     {
         return Status::OK;
     }
 
-    template<typename... Args>
-    void debug(const char* /*format_str*/, Args&&... /*args*/)
+    Status set_module_level([[maybe_unused]] const std::string& module_name,
+                            [[maybe_unused]] const std::string& level)
+    {
+        return Status::OK;
+    }
+
+    void clear_module_level([[maybe_unused]] const std::string& module_name)
     {}
 
-    template<typename... Args>
-    void info(const char* /*format_str*/, Args&&... /*args*/)
+    Status start_trace([[maybe_unused]] const std::string& trace_file_path)
+    {
+        return Status::OK;
+    }
+
+    void stop_trace()
     {}
 
-    template<typename... Args>
-    void warning(const char* /*format_str*/, Args&&... /*args*/)
+    template<typename Name>
+    void trace_begin(const Name& /*name*/)
     {}
 
-    template<typename... Args>
-    void error(const char* /*format_str*/, Args&&... /*args*/)
+    template<typename Name>
+    void trace_end(const Name& /*name*/)
     {}
+
+    template<typename Name>
+    void trace_instant(const Name& /*name*/)
+    {}
+
+    template<typename Name>
+    void trace_counter(const Name& /*name*/, int64_t /*value*/)
+    {}
+
+    template<typename Name>
+    TraceScope<ElkLogger> trace_scope(const Name& /*name*/)
+    {
+        return TraceScope<ElkLogger>(*this, NO_FORMAT_ID);
+    }
+
+    void trace_event([[maybe_unused]] TraceEventType type, [[maybe_unused]] uint32_t name_id,
+                     [[maybe_unused]] int64_t value = 0)
+    {}
+
+    LogStats stats() const
+    {
+        return {};
+    }
+
+    LogTelemetry telemetry() const
+    {
+        return {};
+    }
+
+    void reset_telemetry()
+    {}
+
+    void set_telemetry_report_period([[maybe_unused]] std::chrono::milliseconds period)
+    {}
+
+    void log_telemetry()
+    {}
+
+    static constexpr size_t rt_memory_size()
+    {
+        return 1;
+    }
+
+    static constexpr size_t rt_memory_alignment()
+    {
+        return 1;
+    }
+
+    bool rt_memory_locked() const
+    {
+        return false;
+    }
 };
 
 } // namespace elklog
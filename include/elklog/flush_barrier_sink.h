@@ -0,0 +1,183 @@
+/*
+ * Copyright 2020-2023 Elk Audio AB
+ * ElkLog is free software: you can redistribute it and/or modify it under the terms
+ * of the GNU General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * Twine is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with Twine.
+ * If not, see http://www.gnu.org/licenses/ .
+ */
+
+/**
+ * @brief Adds flush barriers to an spdlog sink, to wait until everything
+ *        logged before a point has been written by the async writer thread.
+ *        spdlog's own flush of an async logger only queues the flush and
+ *        returns, and periodic flushes can not be told apart from it.
+ *
+ *        A barrier is a message of level off, tagged through its source
+ *        location, that goes through the writer queue like any other message.
+ *        When it reaches the sink, the sink is flushed and the barrier is
+ *        marked as passed instead of being written. As the writer queue is
+ *        processed in order, everything queued before the barrier has then
+ *        been written. With more than one writer thread, messages taken from
+ *        the queue just before the barrier may still be in progress.
+ *
+ * @copyright Copyright 2020-2023 Elk Audio AB, Stockholm
+ */
+
+#ifndef ELKLOG_FLUSH_BARRIER_SINK_H
+#define ELKLOG_FLUSH_BARRIER_SINK_H
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "spdlog/logger.h"
+#include "spdlog/details/log_msg.h"
+#include "spdlog/sinks/sink.h"
+
+namespace elklog {
+
+class FlushBarrier
+{
+public:
+    virtual ~FlushBarrier() = default;
+
+    /**
+     * @brief Queue a barrier through logger, which must write to this sink
+     * @return The id of the barrier to pass to wait()
+     */
+    int post(spdlog::logger& logger)
+    {
+        int id;
+        {
+            std::scoped_lock lock(_barrier_lock);
+            id = ++_posted;
+        }
+        logger.log(spdlog::source_loc{BARRIER_TAG, id, ""}, spdlog::level::off, "");
+        return id;
+    }
+
+    /**
+     * @brief Wait until the barrier with the given id, and all barriers before
+     *        it, have passed, or until deadline
+     * @return true if the barrier passed
+     */
+    bool wait(int id, std::chrono::steady_clock::time_point deadline)
+    {
+        std::unique_lock lock(_barrier_lock);
+        return _barrier_notify.wait_until(lock, deadline, [&]() { return _passed >= id; });
+    }
+
+protected:
+    static bool is_barrier(const spdlog::details::log_msg& msg)
+    {
+        return msg.source.filename == BARRIER_TAG && msg.level == spdlog::level::off;
+    }
+
+    void pass(const spdlog::details::log_msg& msg)
+    {
+        {
+            std::scoped_lock lock(_barrier_lock);
+            _passed = std::max(_passed, msg.source.line);
+        }
+        _barrier_notify.notify_all();
+    }
+
+private:
+    // Only compared by address. An array rather than a pointer to a literal,
+    // as identical literals in different translation units are not always merged.
+    static constexpr char BARRIER_TAG[] = "elklog_flush_barrier";
+
+    std::mutex _barrier_lock;
+    std::condition_variable _barrier_notify;
+    int _posted {0};
+    int _passed {0};
+};
+
+/**
+ * @brief Sink that handles flush barriers, and passes everything else on to
+ *        a Sink constructed with the same arguments. spdlog's sinks are final,
+ *        so it contains the sink rather than extending it.
+ */
+template<typename Sink>
+class FlushBarrierSink : public spdlog::sinks::sink, public FlushBarrier
+{
+public:
+    template<typename... SinkArgs>
+    explicit FlushBarrierSink(SinkArgs&&... args) : _sink(std::forward<SinkArgs>(args)...)
+    {}
+
+    void log(const spdlog::details::log_msg& msg) override
+    {
+        if (is_barrier(msg))
+        {
+            _sink.flush();
+            pass(msg);
+            return;
+        }
+        _sink.log(msg);
+    }
+
+    void flush() override
+    {
+        _sink.flush();
+    }
+
+    void set_pattern(const std::string& pattern) override
+    {
+        _sink.set_pattern(pattern);
+    }
+
+    void set_formatter(std::unique_ptr<spdlog::formatter> sink_formatter) override
+    {
+        _sink.set_formatter(std::move(sink_formatter));
+    }
+
+    Sink& sink()
+    {
+        return _sink;
+    }
+
+private:
+    Sink _sink;
+};
+
+/**
+ * @brief Sync the content of a file written by another handle to disk
+ * @return false if the file could not be opened or synced
+ */
+inline bool sync_file(const std::string& path)
+{
+#ifdef __linux__
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return false;
+    }
+    // Syncs the file, not only the data written through this descriptor
+    bool ok = ::fsync(fd) == 0;
+    ::close(fd);
+    return ok;
+#else
+    (void) path;
+    return true;
+#endif
+}
+
+} // namespace elklog
+
+#endif // ELKLOG_FLUSH_BARRIER_SINK_H
@@ -0,0 +1,394 @@
+/*
+ * Copyright 2020-2023 Elk Audio AB
+ * ElkLog is free software: you can redistribute it and/or modify it under the terms
+ * of the GNU General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * Twine is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with Twine.
+ * If not, see http://www.gnu.org/licenses/ .
+ */
+
+/**
+ * @brief Compile-time format strings.
+ *
+ *        ELKLOG_FORMAT("...") creates an object of a type unique to the call
+ *        site that carries the format string. When passed to the logging
+ *        functions, the format string is checked against the argument types
+ *        at compile time, and each call site gets a static id that is used
+ *        instead of the string itself by the binary log and deferred
+ *        formatting. When formatted as text, static formats are compiled
+ *        with FMT_COMPILE, so that fmt parses them at compile time rather
+ *        than on every call.
+ *
+ *        The check covers replacement field syntax, argument indexes, and
+ *        that presentation types (e.g. 'd', 'f', 's') match the argument.
+ *        Specs for other types than numbers and strings are not checked.
+ *
+ * @copyright Copyright 2020-2023 Elk Audio AB, Stockholm
+ */
+
+#ifndef ELKLOG_FORMAT_STRING_H
+#define ELKLOG_FORMAT_STRING_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+#include <spdlog/fmt/bundled/compile.h>
+
+#ifndef ELKLOG_MAX_STATIC_FORMATS
+#define ELKLOG_MAX_STATIC_FORMATS 4096
+#endif
+
+#define ELKLOG_FORMAT(str) [] { struct S : elklog::StaticFormat \
+                                { static constexpr const char* value() { return str; } \
+                                  static constexpr auto compiled() { return FMT_COMPILE(str); } }; \
+                                return S{}; }()
+
+namespace elklog {
+
+constexpr uint32_t NO_FORMAT_ID = UINT32_MAX;
+
+/**
+ * @brief Base class of all types created with ELKLOG_FORMAT
+ */
+struct StaticFormat {};
+
+template<typename T>
+constexpr bool is_static_format_v = std::is_base_of_v<StaticFormat, std::decay_t<T>>;
+
+/**
+ * @brief Global table of static format strings, indexed by id. Ids are
+ *        assigned during static initialization. Lock-free so it is safe to
+ *        use from rt threads.
+ */
+class FormatRegistry
+{
+public:
+    static uint32_t register_format(const char* format_str)
+    {
+        auto id = _count().fetch_add(1, std::memory_order_relaxed);
+        if (id >= ELKLOG_MAX_STATIC_FORMATS)
+        {
+            return NO_FORMAT_ID;
+        }
+        _formats()[id].store(format_str, std::memory_order_release);
+        return id;
+    }
+
+    /**
+     * @brief Returns the format string with the given id or nullptr if not registered
+     */
+    static const char* lookup(uint32_t id)
+    {
+        return id < ELKLOG_MAX_STATIC_FORMATS ? _formats()[id].load(std::memory_order_acquire) : nullptr;
+    }
+
+private:
+    static std::atomic<uint32_t>& _count()
+    {
+        static std::atomic<uint32_t> count {0};
+        return count;
+    }
+
+    static std::array<std::atomic<const char*>, ELKLOG_MAX_STATIC_FORMATS>& _formats()
+    {
+        static std::array<std::atomic<const char*>, ELKLOG_MAX_STATIC_FORMATS> formats {};
+        return formats;
+    }
+};
+
+template<typename Format>
+struct StaticFormatId
+{
+    static inline const uint32_t value = FormatRegistry::register_format(Format::value());
+};
+
+/**
+ * @brief Returns the string of either a plain or a static format string
+ */
+template<typename Format>
+constexpr const char* format_c_str(const Format& format_str)
+{
+    if constexpr (is_static_format_v<Format>)
+    {
+        return std::decay_t<Format>::value();
+    }
+    else
+    {
+        return format_str;
+    }
+}
+
+/**
+ * @brief Returns the format string to pass to fmt, the compiled format of a
+ *        static format string or the plain string itself
+ */
+template<typename Format>
+constexpr auto fmt_format(const Format& format_str)
+{
+    if constexpr (is_static_format_v<Format>)
+    {
+        return std::decay_t<Format>::compiled();
+    }
+    else
+    {
+        return format_c_str(format_str);
+    }
+}
+
+/**
+ * @brief Returns the static id of a format string, or NO_FORMAT_ID if it is
+ *        not a static format
+ */
+template<typename Format>
+uint32_t format_id(const Format& /*format_str*/)
+{
+    if constexpr (is_static_format_v<Format>)
+    {
+        return StaticFormatId<std::decay_t<Format>>::value;
+    }
+    else
+    {
+        return NO_FORMAT_ID;
+    }
+}
+
+namespace format_check {
+
+enum class Category
+{
+    INT,
+    CHAR,
+    BOOL,
+    FLOAT,
+    STRING,
+    POINTER,
+    OTHER
+};
+
+template<typename T>
+constexpr Category category()
+{
+    using Type = std::decay_t<T>;
+    if constexpr (std::is_same_v<Type, bool>)
+    {
+        return Category::BOOL;
+    }
+    else if constexpr (std::is_same_v<Type, char>)
+    {
+        return Category::CHAR;
+    }
+    else if constexpr (std::is_integral_v<Type>)
+    {
+        return Category::INT;
+    }
+    else if constexpr (std::is_floating_point_v<Type>)
+    {
+        return Category::FLOAT;
+    }
+    else if constexpr (std::is_same_v<Type, const char*> || std::is_same_v<Type, char*> ||
+                       std::is_same_v<Type, std::string> || std::is_same_v<Type, std::string_view>)
+    {
+        return Category::STRING;
+    }
+    else if constexpr (std::is_pointer_v<Type>)
+    {
+        return Category::POINTER;
+    }
+    else
+    {
+        return Category::OTHER;
+    }
+}
+
+constexpr bool is_digit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+constexpr bool is_alpha(char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+constexpr bool type_matches(char type, Category category)
+{
+    if (category == Category::OTHER)
+    {
+        return true;
+    }
+    switch (type)
+    {
+        case 'd': case 'x': case 'X': case 'o': case 'b': case 'B':
+            return category == Category::INT || category == Category::CHAR || category == Category::BOOL;
+        case 'c':
+            return category == Category::INT || category == Category::CHAR;
+        case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+            return category == Category::FLOAT;
+        case 's':
+            return category == Category::STRING || category == Category::BOOL;
+        case 'p':
+            return category == Category::POINTER;
+        default:
+            return false;
+    }
+}
+
+/**
+ * @brief Returns true if format_str is a valid format string for the given
+ *        argument categories
+ */
+template<size_t arg_count>
+constexpr bool check(std::string_view format_str, const std::array<Category, arg_count>& args)
+{
+    size_t next_arg = 0;
+    bool manual_index = false;
+    size_t pos = 0;
+    while (pos < format_str.size())
+    {
+        char c = format_str[pos];
+        if (c == '}')
+        {
+            if (pos + 1 >= format_str.size() || format_str[pos + 1] != '}')
+            {
+                return false; // Unmatched '}'
+            }
+            pos += 2;
+            continue;
+        }
+        if (c != '{')
+        {
+            pos++;
+            continue;
+        }
+        if (pos + 1 < format_str.size() && format_str[pos + 1] == '{')
+        {
+            pos += 2;
+            continue;
+        }
+
+        // Parse arg id
+        pos++;
+        size_t index = 0;
+        if (pos < format_str.size() && is_digit(format_str[pos]))
+        {
+            if (next_arg > 0)
+            {
+                return false; // Mixing automatic and manual indexing
+            }
+            manual_index = true;
+            while (pos < format_str.size() && is_digit(format_str[pos]))
+            {
+                index = index * 10 + (format_str[pos++] - '0');
+            }
+        }
+        else
+        {
+            if (manual_index)
+            {
+                return false;
+            }
+            index = next_arg++;
+        }
+        if (index >= arg_count || pos >= format_str.size())
+        {
+            return false;
+        }
+
+        // Parse spec, nested fields for dynamic width and precision use up an
+        // argument, or refer to one with manual indexing
+        char last = 0;
+        if (format_str[pos] == ':')
+        {
+            pos++;
+            while (pos < format_str.size() && format_str[pos] != '}')
+            {
+                if (format_str[pos] == '{')
+                {
+                    pos++;
+                    size_t nested_index = 0;
+                    if (pos < format_str.size() && is_digit(format_str[pos]))
+                    {
+                        if (manual_index == false)
+                        {
+                            return false;
+                        }
+                        while (pos < format_str.size() && is_digit(format_str[pos]))
+                        {
+                            nested_index = nested_index * 10 + (format_str[pos++] - '0');
+                        }
+                    }
+                    else
+                    {
+                        if (manual_index)
+                        {
+                            return false;
+                        }
+                        nested_index = next_arg++;
+                    }
+                    if (nested_index >= arg_count || pos >= format_str.size() || format_str[pos] != '}')
+                    {
+                        return false;
+                    }
+                    pos++;
+                    last = 0;
+                    continue;
+                }
+                // The locale flag comes before the type, and is not one
+                if (format_str[pos] != 'L')
+                {
+                    last = format_str[pos];
+                }
+                pos++;
+            }
+        }
+        if (pos >= format_str.size() || format_str[pos] != '}')
+        {
+            return false;
+        }
+        if (is_alpha(last) && type_matches(last, args[index]) == false)
+        {
+            return false;
+        }
+        pos++;
+    }
+    return true;
+}
+
+} // namespace format_check
+
+/**
+ * @brief Returns true if the format string is valid for the given argument types
+ */
+template<typename... Args>
+constexpr bool is_valid_format(std::string_view format_str)
+{
+    constexpr std::array<format_check::Category, sizeof...(Args)> args = {format_check::category<Args>()...};
+    return format_check::check(format_str, args);
+}
+
+/**
+ * @brief Fails compilation if Format is a static format that doesn't match the
+ *        argument types. Does nothing for plain strings.
+ */
+template<typename Format, typename... Args>
+constexpr void check_format()
+{
+    if constexpr (is_static_format_v<Format>)
+    {
+        static_assert(is_valid_format<Args...>(std::decay_t<Format>::value()),
+                      "Invalid format string for the given arguments");
+    }
+}
+
+} // namespace elklog
+
+#endif // ELKLOG_FORMAT_STRING_H
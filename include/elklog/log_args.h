@@ -0,0 +1,286 @@
+/*
+ * Copyright 2020-2023 Elk Audio AB
+ * ElkLog is free software: you can redistribute it and/or modify it under the terms
+ * of the GNU General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * Twine is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with Twine.
+ * If not, see http://www.gnu.org/licenses/ .
+ */
+
+/**
+ * @brief Log arguments for buffers, i.e. to log a short snapshot of an audio
+ *        buffer from an rt thread without a loop:
+ *
+ *            logger.info("Output {:.3f}", elklog::span(buffer, frames));
+ *            logger.info("Midi {}", elklog::hex_dump(data, size));
+ *
+ *        Spans are formatted as [1.000, 2.000], with the format spec applied
+ *        to each element, and hex dumps as 0a 1b ff. Floats with a plain
+ *        precision spec, like {:.3f}, are formatted without fmt, as it is
+ *        slow at formatting floats with a precision. RtLogMessage truncates
+ *        both to what can fit in the message buffer when they are captured,
+ *        so that the work done on the rt thread is bounded, and truncated
+ *        values end with "...".
+ *
+ * @copyright Copyright 2020-2023 Elk Audio AB, Stockholm
+ */
+
+#ifndef ELKLOG_LOG_ARGS_H
+#define ELKLOG_LOG_ARGS_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <string_view>
+#include <type_traits>
+
+#include <spdlog/fmt/bundled/format.h>
+
+namespace elklog {
+
+template<typename T>
+struct Span
+{
+    const T* data;
+    size_t size;
+    // The size before truncation
+    size_t total;
+};
+
+struct HexDump
+{
+    const uint8_t* data;
+    size_t size;
+    // The size before truncation
+    size_t total;
+};
+
+template<typename T>
+constexpr Span<std::remove_cv_t<T>> span(const T* data, size_t size)
+{
+    return {data, size, size};
+}
+
+template<typename T, size_t N>
+constexpr Span<std::remove_cv_t<T>> span(const T (&data)[N])
+{
+    return {data, N, N};
+}
+
+/**
+ * @brief A span over any contiguous container, i.e. std::array or std::vector
+ */
+template<typename Container, typename = decltype(std::data(std::declval<const Container&>()))>
+constexpr auto span(const Container& container)
+{
+    return span(std::data(container), std::size(container));
+}
+
+inline HexDump hex_dump(const void* data, size_t size)
+{
+    return {static_cast<const uint8_t*>(data), size, size};
+}
+
+/**
+ * @brief Truncate a span, hex dump or string_view to what can fit in a
+ *        formatted message of buffer_len characters, other arguments are
+ *        passed on as they are
+ */
+template<size_t buffer_len, typename T>
+constexpr decltype(auto) capture_arg(const T& arg)
+{
+    if constexpr (std::is_same_v<T, HexDump>)
+    {
+        // At least 3 characters for each byte
+        return HexDump{arg.data, std::min(arg.size, buffer_len / 3 + 1), arg.total};
+    }
+    else if constexpr (std::is_same_v<T, std::string_view>)
+    {
+        return arg.substr(0, buffer_len);
+    }
+    else
+    {
+        return (arg);
+    }
+}
+
+template<size_t buffer_len, typename T>
+constexpr Span<T> capture_arg(const Span<T>& arg)
+{
+    // At least 2 characters for each element
+    return {arg.data, std::min(arg.size, buffer_len / 2 + 1), arg.total};
+}
+
+namespace detail {
+
+constexpr int MAX_FIXED_PRECISION = 9;
+
+/**
+ * @brief Returns N if the spec is exactly .Nf, with N <= MAX_FIXED_PRECISION, otherwise -1.
+ *        A plain .N is the general format with N significant digits, and is left to fmt.
+ */
+template<typename Iterator>
+constexpr int parse_fixed_precision(Iterator begin, Iterator end)
+{
+    if (begin == end || *begin != '.' || ++begin == end || *begin < '0' || *begin > '9')
+    {
+        return -1;
+    }
+    int precision = *begin++ - '0';
+    if (begin == end || *begin++ != 'f')
+    {
+        return -1;
+    }
+    return (begin != end && *begin == '}' && precision <= MAX_FIXED_PRECISION) ? precision : -1;
+}
+
+/**
+ * @brief Fixed point formatting of a float with a small precision, which is
+ *        several times faster than through fmt, with the same result. The
+ *        scaling is exact to within an ulp, values too close to halfway
+ *        between two results for that to decide the rounding are left to fmt.
+ * @return false if the value is not finite, too large or too close to
+ *         halfway, and nothing was written
+ */
+template<typename T, typename OutputIt>
+bool format_fixed(T value, int precision, OutputIt& out)
+{
+    constexpr uint64_t POWERS_OF_10[] = {1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000};
+    // Above this, a double has no fractional digits left to round on
+    constexpr double MAX_SCALED = 4503599627370496.0; // 2^52
+    double scaled = std::abs(static_cast<double>(value)) * static_cast<double>(POWERS_OF_10[precision]);
+    if (!(scaled < MAX_SCALED))
+    {
+        return false;
+    }
+    // The powers of 10 are exact, so the multiplication is off by at most half an ulp
+    double truncated = std::floor(scaled);
+    double remainder = scaled - truncated;
+    if (std::abs(remainder - 0.5) <= scaled * std::numeric_limits<double>::epsilon())
+    {
+        return false;
+    }
+    auto fixed = static_cast<uint64_t>(truncated) + (remainder > 0.5 ? 1 : 0);
+    auto integer = fixed / POWERS_OF_10[precision];
+    auto fraction = fixed % POWERS_OF_10[precision];
+
+    // Digits are written backwards, the longest is "-" + 18 digits + "." + 9 digits
+    char digits[32];
+    char* start = digits + sizeof(digits);
+    for (int i = 0; i < precision; ++i)
+    {
+        *--start = static_cast<char>('0' + fraction % 10);
+        fraction /= 10;
+    }
+    if (precision > 0)
+    {
+        *--start = '.';
+    }
+    do
+    {
+        *--start = static_cast<char>('0' + integer % 10);
+        integer /= 10;
+    } while (integer > 0);
+    if (std::signbit(value))
+    {
+        *--start = '-';
+    }
+    for (const char* c = start; c < digits + sizeof(digits); ++c)
+    {
+        *out++ = *c;
+    }
+    return true;
+}
+
+} // namespace detail
+
+} // namespace elklog
+
+template<typename T, typename Char>
+struct fmt::formatter<elklog::Span<T>, Char> : fmt::formatter<T, Char>
+{
+    constexpr auto parse(fmt::basic_format_parse_context<Char>& ctx) -> decltype(ctx.begin())
+    {
+        if constexpr (std::is_floating_point_v<T>)
+        {
+            _precision = elklog::detail::parse_fixed_precision(ctx.begin(), ctx.end());
+        }
+        return fmt::formatter<T, Char>::parse(ctx);
+    }
+
+    template<typename FormatContext>
+    auto format(const elklog::Span<T>& span, FormatContext& ctx) const -> decltype(ctx.out())
+    {
+        auto out = ctx.out();
+        *out++ = '[';
+        for (size_t i = 0; i < span.size; ++i)
+        {
+            if (i > 0)
+            {
+                *out++ = ',';
+                *out++ = ' ';
+            }
+            if (_precision < 0 || elklog::detail::format_fixed(span.data[i], _precision, out) == false)
+            {
+                ctx.advance_to(out);
+                out = fmt::formatter<T, Char>::format(span.data[i], ctx);
+            }
+        }
+        if (span.size < span.total)
+        {
+            for (char c : std::string_view(span.size > 0 ? ", ..." : "..."))
+            {
+                *out++ = c;
+            }
+        }
+        *out++ = ']';
+        return out;
+    }
+
+private:
+    // Precision of a plain {:.Nf} spec, formatted without fmt, or -1
+    int _precision {-1};
+};
+
+template<typename Char>
+struct fmt::formatter<elklog::HexDump, Char>
+{
+    constexpr auto parse(fmt::basic_format_parse_context<Char>& ctx) -> decltype(ctx.begin())
+    {
+        return ctx.begin();
+    }
+
+    template<typename FormatContext>
+    auto format(const elklog::HexDump& dump, FormatContext& ctx) const -> decltype(ctx.out())
+    {
+        constexpr char DIGITS[] = "0123456789abcdef";
+        auto out = ctx.out();
+        for (size_t i = 0; i < dump.size; ++i)
+        {
+            if (i > 0)
+            {
+                *out++ = ' ';
+            }
+            *out++ = DIGITS[dump.data[i] >> 4];
+            *out++ = DIGITS[dump.data[i] & 0x0f];
+        }
+        if (dump.size < dump.total)
+        {
+            for (char c : std::string_view(dump.size > 0 ? " ..." : "..."))
+            {
+                *out++ = c;
+            }
+        }
+        return out;
+    }
+};
+
+#endif // ELKLOG_LOG_ARGS_H
@@ -0,0 +1,254 @@
+/*
+ * Copyright 2020-2023 Elk Audio AB
+ * ElkLog is free software: you can redistribute it and/or modify it under the terms
+ * of the GNU General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * Twine is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with Twine.
+ * If not, see http://www.gnu.org/licenses/ .
+ */
+
+/**
+ * @brief Threads shared by many ElkLogger instances, i.e. one logger for each
+ *        plugin instance in a host. Without a backend, every ElkLogger starts
+ *        its own rt consumer thread.
+ *
+ *        The rt queues of all loggers are consumed by a fixed number of
+ *        consumer threads, and their files are written by a fixed number of
+ *        writer threads, instead of by spdlog's global thread pool. Loggers
+ *        that were initialized with a flush interval are flushed by the
+ *        backend, instead of through spdlog's global periodic flush.
+ *
+ *        Each logger still has its own level and file. The backend must
+ *        outlive its loggers, which is ensured by passing it to them as a
+ *        shared_ptr.
+ *
+ * @copyright Copyright 2020-2023 Elk Audio AB, Stockholm
+ */
+
+#ifndef ELKLOG_LOG_BACKEND_H
+#define ELKLOG_LOG_BACKEND_H
+
+#include <chrono>
+#include <cstddef>
+
+#include "log_return_code.h"
+#include "thread_config.h"
+
+#ifndef ELKLOG_DISABLE_LOGGING
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "spdlog/spdlog.h"
+#include "spdlog/async.h"
+
+#include "rt_consumer_pool.h"
+
+namespace elklog {
+
+class LogBackend
+{
+public:
+    static constexpr size_t DEFAULT_WRITER_QUEUE_SIZE = 8192;
+
+    /**
+     * @brief Create a backend and start its threads
+     *
+     * @param consumer_threads Number of threads that consume the rt queues of the loggers
+     * @param writer_threads Number of threads that write log files. Messages of a
+     *                       logger can be written out of order with more than one.
+     *                       Not used with ELKLOG_SINGLE_WRITER_THREAD, where the
+     *                       consumer threads write the files.
+     * @param poll_period How often the consumer threads check the rt queues
+     * @param max_idle_period The poll period backs off up to this period when no
+     *                        messages are logged from rt threads
+     * @param writer_queue_size Number of messages that can be queued for the writer threads
+     * @param thread_config Applied to both the consumer and the writer threads,
+     *                      i.e. to keep them off the cores of rt threads
+     */
+    explicit LogBackend(int consumer_threads = 1,
+                        int writer_threads = 1,
+                        std::chrono::milliseconds poll_period = std::chrono::milliseconds(50),
+                        std::chrono::milliseconds max_idle_period = std::chrono::milliseconds(1000),
+                        size_t writer_queue_size = DEFAULT_WRITER_QUEUE_SIZE,
+                        const ThreadConfig& thread_config = {}) :
+        _consumer_pool(consumer_threads, poll_period, max_idle_period, thread_config),
+        _writer_queue_size(writer_queue_size)
+    {
+#ifndef ELKLOG_SINGLE_WRITER_THREAD
+        writer_threads = std::max(writer_threads, 1);
+        _writer_pool = std::make_shared<spdlog::details::thread_pool>(writer_queue_size, writer_threads,
+                                                                      [this, thread_config]()
+        {
+            if (apply_thread_config(thread_config) != Status::OK)
+            {
+                _writer_config_failures++;
+            }
+            _writers_started++;
+        });
+        // The writer threads configure themselves when they start
+        auto deadline = std::chrono::steady_clock::now() + WRITER_START_TIMEOUT;
+        while (_writers_started.load() < writer_threads && std::chrono::steady_clock::now() < deadline)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        if (_writers_started.load() < writer_threads)
+        {
+            _writer_config_failures++;
+        }
+#else
+        (void) writer_threads;
+#endif
+        _flush_registration = _consumer_pool.add([this]() { _flush_loggers(); return size_t(0); });
+    }
+
+    ~LogBackend()
+    {
+        _consumer_pool.remove(_flush_registration);
+    }
+
+    /**
+     * @brief Create and register an spdlog logger that writes through the
+     *        writer threads of the backend, in the same way as spdlog's
+     *        factories create loggers.
+     */
+    template<typename Sink, typename... SinkArgs>
+    std::shared_ptr<spdlog::logger> create_logger(std::string logger_name, SinkArgs&&... args)
+    {
+        auto sink = std::make_shared<Sink>(std::forward<SinkArgs>(args)...);
+#ifdef ELKLOG_SINGLE_WRITER_THREAD
+        auto logger = std::make_shared<spdlog::logger>(std::move(logger_name), std::move(sink));
+#else
+        auto logger = std::make_shared<spdlog::async_logger>(std::move(logger_name), std::move(sink), _writer_pool,
+                                                             spdlog::async_overflow_policy::block);
+#endif
+        spdlog::initialize_logger(logger);
+        return logger;
+    }
+
+    /**
+     * @brief Flush logger every interval from a consumer thread, until
+     *        remove_flush() is called or the logger is destroyed
+     */
+    void add_flush(const std::shared_ptr<spdlog::logger>& logger, std::chrono::seconds interval)
+    {
+        std::scoped_lock lock(_flush_lock);
+        _flushes.push_back({logger, interval, std::chrono::steady_clock::now()});
+    }
+
+    void remove_flush(const std::shared_ptr<spdlog::logger>& logger)
+    {
+        std::scoped_lock lock(_flush_lock);
+        _flushes.erase(std::remove_if(_flushes.begin(), _flushes.end(),
+                                      [&](const Flush& flush) { return flush.logger.lock() == logger; }),
+                       _flushes.end());
+    }
+
+    RtConsumerPool& consumer_pool()
+    {
+        return _consumer_pool;
+    }
+
+#ifndef ELKLOG_SINGLE_WRITER_THREAD
+    const std::shared_ptr<spdlog::details::thread_pool>& writer_pool() const
+    {
+        return _writer_pool;
+    }
+#endif
+
+    size_t writer_queue_size() const
+    {
+        return _writer_queue_size;
+    }
+
+    /**
+     * @brief FAILED_TO_CONFIGURE_THREAD if the thread config could not be
+     *        applied to all consumer and writer threads
+     */
+    Status thread_config_status() const
+    {
+        if (_writer_config_failures.load() > 0)
+        {
+            return Status::FAILED_TO_CONFIGURE_THREAD;
+        }
+        return _consumer_pool.thread_config_status();
+    }
+
+private:
+    static constexpr auto WRITER_START_TIMEOUT = std::chrono::milliseconds(1000);
+
+    struct Flush
+    {
+        std::weak_ptr<spdlog::logger> logger;
+        std::chrono::seconds interval;
+        std::chrono::steady_clock::time_point last_flush;
+    };
+
+    void _flush_loggers()
+    {
+        auto now = std::chrono::steady_clock::now();
+        std::scoped_lock lock(_flush_lock);
+        for (auto& flush : _flushes)
+        {
+            if (now - flush.last_flush >= flush.interval)
+            {
+                if (auto logger = flush.logger.lock())
+                {
+                    logger->flush();
+                }
+                flush.last_flush = now;
+            }
+        }
+    }
+
+    std::mutex _flush_lock;
+    std::vector<Flush> _flushes;
+    std::atomic<int> _writers_started {0};
+    std::atomic<int> _writer_config_failures {0};
+#ifndef ELKLOG_SINGLE_WRITER_THREAD
+    std::shared_ptr<spdlog::details::thread_pool> _writer_pool;
+#endif
+    RtConsumerPool _consumer_pool;
+    RtConsumerPool::Registration _flush_registration;
+    size_t _writer_queue_size;
+};
+
+} // namespace elklog
+
+#else // ELKLOG_DISABLE_LOGGING
+
+namespace elklog {
+
+class LogBackend
+{
+public:
+    static constexpr size_t DEFAULT_WRITER_QUEUE_SIZE = 8192;
+
+    explicit LogBackend([[maybe_unused]] int consumer_threads = 1,
+                        [[maybe_unused]] int writer_threads = 1,
+                        [[maybe_unused]] std::chrono::milliseconds poll_period = std::chrono::milliseconds(50),
+                        [[maybe_unused]] std::chrono::milliseconds max_idle_period = std::chrono::milliseconds(1000),
+                        [[maybe_unused]] size_t writer_queue_size = DEFAULT_WRITER_QUEUE_SIZE,
+                        [[maybe_unused]] const ThreadConfig& thread_config = {})
+    {}
+
+    Status thread_config_status() const
+    {
+        return Status::OK;
+    }
+};
+
+} // namespace elklog
+
+#endif // ELKLOG_DISABLE_LOGGING
+
+#endif // ELKLOG_LOG_BACKEND_H
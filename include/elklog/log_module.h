@@ -0,0 +1,116 @@
+/*
+ * Copyright 2020-2023 Elk Audio AB
+ * ElkLog is free software: you can redistribute it and/or modify it under the terms
+ * of the GNU General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * Twine is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with Twine.
+ * If not, see http://www.gnu.org/licenses/ .
+ */
+
+/**
+ * @brief Log modules, declared with ELKLOG_GET_LOGGER_WITH_MODULE_NAME, can
+ *        have their own log level. Each module gets an id at static
+ *        initialization that loggers use to look up the module's level.
+ *
+ * @copyright Copyright 2020-2023 Elk Audio AB, Stockholm
+ */
+
+#ifndef ELKLOG_LOG_MODULE_H
+#define ELKLOG_LOG_MODULE_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+
+#ifndef ELKLOG_MAX_LOG_MODULES
+#define ELKLOG_MAX_LOG_MODULES 256
+#endif
+
+namespace elklog {
+
+constexpr uint32_t NO_MODULE_ID = UINT32_MAX;
+
+/**
+ * @brief Global table of module names, indexed by id. Several modules can
+ *        have the same name, i.e. if the same name is used in multiple files.
+ */
+class LogModuleRegistry
+{
+public:
+    static uint32_t register_module(const char* name)
+    {
+        auto id = _count().fetch_add(1, std::memory_order_relaxed);
+        if (id >= ELKLOG_MAX_LOG_MODULES)
+        {
+            return NO_MODULE_ID;
+        }
+        _names()[id].store(name, std::memory_order_release);
+        return id;
+    }
+
+    /**
+     * @brief Call function with the id of every module with the given name
+     */
+    template<typename Function>
+    static void for_each_module(const char* name, Function&& function)
+    {
+        for (uint32_t id = 0; id < ELKLOG_MAX_LOG_MODULES; ++id)
+        {
+            auto module_name = _names()[id].load(std::memory_order_acquire);
+            if (module_name != nullptr && std::strcmp(module_name, name) == 0)
+            {
+                function(id);
+            }
+        }
+    }
+
+private:
+    static std::atomic<uint32_t>& _count()
+    {
+        static std::atomic<uint32_t> count {0};
+        return count;
+    }
+
+    static std::array<std::atomic<const char*>, ELKLOG_MAX_LOG_MODULES>& _names()
+    {
+        static std::array<std::atomic<const char*>, ELKLOG_MAX_LOG_MODULES> names {};
+        return names;
+    }
+};
+
+class LogModule
+{
+public:
+    /**
+     * @param name Name of the module, must outlive the object. An empty name
+     *             means no module, and the logger's level is always used.
+     */
+    explicit LogModule(const char* name) :
+        _name(name),
+        _id(name[0] != '\0' ? LogModuleRegistry::register_module(name) : NO_MODULE_ID)
+    {}
+
+    const char* name() const
+    {
+        return _name;
+    }
+
+    uint32_t id() const
+    {
+        return _id;
+    }
+
+private:
+    const char* _name;
+    uint32_t _id;
+};
+
+} // namespace elklog
+
+#endif // ELKLOG_LOG_MODULE_H
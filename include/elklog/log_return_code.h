@@ -30,7 +30,9 @@ enum class Status : int
     OK = 0,
     INVALID_LOG_LEVEL = 1,
     FAILED_TO_START_LOGGER = 2,
-    INVALID_FLUSH_INTERVAL = 3
+    INVALID_FLUSH_INTERVAL = 3,
+    FAILED_TO_CONFIGURE_THREAD = 4,
+    FAILED_TO_FLUSH = 5
 };
 
 inline std::ostream& operator << (std::ostream& o, const Status& c)
@@ -52,6 +54,14 @@ inline std::ostream& operator << (std::ostream& o, const Status& c)
     case Status::FAILED_TO_START_LOGGER:
         o << "Failed to initialize SPD logger instance";
         break;
+
+    case Status::FAILED_TO_CONFIGURE_THREAD:
+        o << "Failed to configure logging thread";
+        break;
+
+    case Status::FAILED_TO_FLUSH:
+        o << "Failed to flush log";
+        break;
     }
 
     return o;
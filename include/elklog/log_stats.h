@@ -0,0 +1,167 @@
+/*
+ * Copyright 2020-2023 Elk Audio AB
+ * ElkLog is free software: you can redistribute it and/or modify it under the terms
+ * of the GNU General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * Twine is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with Twine.
+ * If not, see http://www.gnu.org/licenses/ .
+ */
+
+/**
+ * @brief Logging statistics, used to size queues from real data and to tell
+ *        if messages were dropped.
+ *
+ * @copyright Copyright 2020-2023 Elk Audio AB, Stockholm
+ */
+
+#ifndef ELKLOG_LOG_STATS_H
+#define ELKLOG_LOG_STATS_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <numeric>
+
+#include "rtloglevel.h"
+
+namespace elklog {
+
+constexpr int RTLOG_LEVEL_COUNT = 4;
+
+/**
+ * @brief Snapshot of logging statistics
+ */
+struct LogStats
+{
+    // Messages successfully queued
+    uint64_t pushed {0};
+    // Messages passed on from the queue
+    uint64_t consumed {0};
+    // Messages discarded for being below the minimum log level
+    uint64_t filtered {0};
+    // Messages dropped because the queue was full, indexed by RtLogLevel
+    std::array<uint64_t, RTLOG_LEVEL_COUNT> dropped {};
+    // The highest number of messages seen waiting in the queue
+    uint64_t queue_high_water_mark {0};
+    // Trace events successfully queued
+    uint64_t traced {0};
+    // Trace events dropped because the trace queue was full
+    uint64_t trace_dropped {0};
+    // Queued messages from non-rt threads overwritten by newer ones when the
+    // writer queue was full, their levels are not known
+    uint64_t overrun {0};
+
+    uint64_t total_dropped() const
+    {
+        return std::accumulate(dropped.begin(), dropped.end(), overrun);
+    }
+};
+
+/**
+ * @brief Counters behind LogStats, updated with relaxed atomics so that
+ *        they are safe and cheap to update from rt threads.
+ */
+class LogStatsCounters
+{
+public:
+    uint64_t count_pushed()
+    {
+        return _pushed.fetch_add(1, std::memory_order_relaxed) + 1;
+    }
+
+    // Release/acquire so that messages are passed on before they are seen as consumed
+    void count_consumed(uint64_t count)
+    {
+        _consumed.fetch_add(count, std::memory_order_release);
+    }
+
+    void count_filtered()
+    {
+        _filtered.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void count_dropped(RtLogLevel level)
+    {
+        _dropped[static_cast<int>(level)].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    uint64_t count_traced()
+    {
+        return _traced.fetch_add(1, std::memory_order_relaxed) + 1;
+    }
+
+    void count_trace_dropped()
+    {
+        _trace_dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Update the high-water mark, not safe to call from multiple threads
+     */
+    void update_queue_level(uint64_t queued)
+    {
+        if (queued > _queue_high_water_mark.load(std::memory_order_relaxed))
+        {
+            _queue_high_water_mark.store(queued, std::memory_order_relaxed);
+        }
+    }
+
+    uint64_t pushed() const
+    {
+        return _pushed.load(std::memory_order_relaxed);
+    }
+
+    uint64_t traced() const
+    {
+        return _traced.load(std::memory_order_relaxed);
+    }
+
+    uint64_t consumed() const
+    {
+        return _consumed.load(std::memory_order_acquire);
+    }
+
+    uint64_t total_dropped() const
+    {
+        uint64_t total = 0;
+        for (const auto& d : _dropped)
+        {
+            total += d.load(std::memory_order_relaxed);
+        }
+        return total;
+    }
+
+    LogStats snapshot() const
+    {
+        LogStats stats;
+        stats.pushed = _pushed.load(std::memory_order_relaxed);
+        stats.consumed = _consumed.load(std::memory_order_relaxed);
+        stats.filtered = _filtered.load(std::memory_order_relaxed);
+        for (int i = 0; i < RTLOG_LEVEL_COUNT; ++i)
+        {
+            stats.dropped[i] = _dropped[i].load(std::memory_order_relaxed);
+        }
+        stats.queue_high_water_mark = _queue_high_water_mark.load(std::memory_order_relaxed);
+        stats.traced = _traced.load(std::memory_order_relaxed);
+        stats.trace_dropped = _trace_dropped.load(std::memory_order_relaxed);
+        return stats;
+    }
+
+private:
+    std::atomic<uint64_t> _pushed {0};
+    std::atomic<uint64_t> _consumed {0};
+    std::atomic<uint64_t> _filtered {0};
+    std::array<std::atomic<uint64_t>, RTLOG_LEVEL_COUNT> _dropped {};
+    std::atomic<uint64_t> _queue_high_water_mark {0};
+    std::atomic<uint64_t> _traced {0};
+    std::atomic<uint64_t> _trace_dropped {0};
+};
+
+} // namespace elklog
+
+#endif // ELKLOG_LOG_STATS_H
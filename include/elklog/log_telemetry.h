@@ -0,0 +1,228 @@
+/*
+ * Copyright 2020-2023 Elk Audio AB
+ * ElkLog is free software: you can redistribute it and/or modify it under the terms
+ * of the GNU General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * Twine is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with Twine.
+ * If not, see http://www.gnu.org/licenses/ .
+ */
+
+/**
+ * @brief Histograms of rt logging, to size ELKLOG_RT_MESSAGE_SIZE and
+ *        ELKLOG_RT_QUEUE_SIZE from what a product logs in the field. Only
+ *        recorded if ELKLOG_RT_TELEMETRY is defined, otherwise snapshots are
+ *        empty.
+ *
+ *        Histograms are log-bucketed like HdrHistogram: values below 8 have
+ *        a bucket each, and every power of 2 above is split into 8 buckets,
+ *        so that a value is at most 12.5% off from the bounds of its bucket.
+ *        Recording is 3 relaxed atomic updates, safe from rt threads.
+ *
+ * @copyright Copyright 2020-2023 Elk Audio AB, Stockholm
+ */
+
+#ifndef ELKLOG_LOG_TELEMETRY_H
+#define ELKLOG_LOG_TELEMETRY_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <string>
+
+#include <spdlog/fmt/bundled/format.h>
+
+namespace elklog {
+
+constexpr int HISTOGRAM_SUB_BUCKET_BITS = 3;
+constexpr int HISTOGRAM_SUB_BUCKETS = 1 << HISTOGRAM_SUB_BUCKET_BITS;
+// Larger values are counted in the last bucket, 2^40 ns is about 18 minutes
+constexpr int HISTOGRAM_VALUE_BITS = 40;
+constexpr int HISTOGRAM_BUCKETS = (HISTOGRAM_VALUE_BITS - HISTOGRAM_SUB_BUCKET_BITS + 1) * HISTOGRAM_SUB_BUCKETS;
+
+constexpr int histogram_bucket(uint64_t value)
+{
+    if (value < HISTOGRAM_SUB_BUCKETS)
+    {
+        return static_cast<int>(value);
+    }
+    int msb = 63 - __builtin_clzll(value);
+    if (msb >= HISTOGRAM_VALUE_BITS)
+    {
+        return HISTOGRAM_BUCKETS - 1;
+    }
+    int shift = msb - HISTOGRAM_SUB_BUCKET_BITS;
+    return (shift + 1) * HISTOGRAM_SUB_BUCKETS + static_cast<int>((value >> shift) & (HISTOGRAM_SUB_BUCKETS - 1));
+}
+
+/**
+ * @brief The lowest value counted in bucket
+ */
+constexpr uint64_t histogram_bucket_min(int bucket)
+{
+    if (bucket < HISTOGRAM_SUB_BUCKETS)
+    {
+        return static_cast<uint64_t>(bucket);
+    }
+    int shift = bucket / HISTOGRAM_SUB_BUCKETS - 1;
+    return static_cast<uint64_t>(HISTOGRAM_SUB_BUCKETS + bucket % HISTOGRAM_SUB_BUCKETS) << shift;
+}
+
+/**
+ * @brief The highest value counted in bucket, except for the last bucket
+ */
+constexpr uint64_t histogram_bucket_max(int bucket)
+{
+    return histogram_bucket_min(bucket + 1) - 1;
+}
+
+struct HistogramSnapshot
+{
+    std::array<uint64_t, HISTOGRAM_BUCKETS> counts {};
+    uint64_t count {0};
+    uint64_t sum {0};
+    uint64_t max {0};
+
+    double mean() const
+    {
+        return count > 0 ? static_cast<double>(sum) / static_cast<double>(count) : 0.0;
+    }
+
+    /**
+     * @brief The highest value of the bucket that has the given percentile,
+     *        i.e. 99 for p99, or 0 if nothing was recorded
+     */
+    uint64_t percentile(double percentile) const
+    {
+        if (count == 0)
+        {
+            return 0;
+        }
+        auto rank = static_cast<uint64_t>(std::ceil(std::clamp(percentile, 0.0, 100.0) / 100.0 * static_cast<double>(count)));
+        rank = std::max<uint64_t>(rank, 1);
+        uint64_t seen = 0;
+        for (int i = 0; i < HISTOGRAM_BUCKETS - 1; ++i)
+        {
+            seen += counts[i];
+            if (seen >= rank)
+            {
+                return std::min(histogram_bucket_max(i), max);
+            }
+        }
+        return max;
+    }
+
+    /**
+     * @brief One line summary, i.e. "count 10, mean 52.5, p50 48, p90 95, p99 120, max 120"
+     */
+    std::string summary() const
+    {
+        return fmt::format("count {}, mean {:.1f}, p50 {}, p90 {}, p99 {}, max {}",
+                           count, mean(), percentile(50), percentile(90), percentile(99), max);
+    }
+};
+
+class LogHistogram
+{
+public:
+    void record(uint64_t value)
+    {
+        _counts[histogram_bucket(value)].fetch_add(1, std::memory_order_relaxed);
+        _sum.fetch_add(value, std::memory_order_relaxed);
+        auto max = _max.load(std::memory_order_relaxed);
+        while (value > max && _max.compare_exchange_weak(max, value, std::memory_order_relaxed) == false)
+        {}
+    }
+
+    /**
+     * @brief Values recorded while taking a snapshot may be partly included
+     */
+    HistogramSnapshot snapshot() const
+    {
+        HistogramSnapshot snapshot;
+        for (int i = 0; i < HISTOGRAM_BUCKETS; ++i)
+        {
+            snapshot.counts[i] = _counts[i].load(std::memory_order_relaxed);
+            snapshot.count += snapshot.counts[i];
+        }
+        snapshot.sum = _sum.load(std::memory_order_relaxed);
+        snapshot.max = _max.load(std::memory_order_relaxed);
+        return snapshot;
+    }
+
+    /**
+     * @brief Values recorded during the reset may be partly kept
+     */
+    void reset()
+    {
+        for (auto& count : _counts)
+        {
+            count.store(0, std::memory_order_relaxed);
+        }
+        _sum.store(0, std::memory_order_relaxed);
+        _max.store(0, std::memory_order_relaxed);
+    }
+
+private:
+    std::array<std::atomic<uint64_t>, HISTOGRAM_BUCKETS> _counts {};
+    std::atomic<uint64_t> _sum {0};
+    std::atomic<uint64_t> _max {0};
+};
+
+/**
+ * @brief Snapshot of the rt logging histograms
+ */
+struct LogTelemetry
+{
+    // Time from the timestamp of a message until it was queued, in ns,
+    // which includes formatting unless the message is deferred
+    HistogramSnapshot producer_cost;
+    // Length of messages when passed on, in bytes. Truncated messages have
+    // the message size - 1.
+    HistogramSnapshot message_size;
+    // Time from the timestamp of a message until the consumer passed it on, in ns
+    HistogramSnapshot queue_latency;
+};
+
+/**
+ * @brief Call function with the name, including the unit, and snapshot of
+ *        each histogram, i.e. to log a summary of them
+ */
+template<typename Function>
+void for_each_histogram(const LogTelemetry& telemetry, Function&& function)
+{
+    function("Rt message size (bytes)", telemetry.message_size);
+    function("Rt producer cost (ns)", telemetry.producer_cost);
+    function("Rt queue latency (ns)", telemetry.queue_latency);
+}
+
+class alignas(64) LogTelemetryCounters
+{
+public:
+    // Recorded by rt threads, on other cache lines than the ones recorded by the consumer
+    alignas(64) LogHistogram producer_cost;
+    alignas(64) LogHistogram message_size;
+    LogHistogram queue_latency;
+
+    LogTelemetry snapshot() const
+    {
+        return {producer_cost.snapshot(), message_size.snapshot(), queue_latency.snapshot()};
+    }
+
+    void reset()
+    {
+        producer_cost.reset();
+        message_size.reset();
+        queue_latency.reset();
+    }
+};
+
+} // namespace elklog
+
+#endif // ELKLOG_LOG_TELEMETRY_H
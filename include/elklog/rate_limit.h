@@ -0,0 +1,82 @@
+/*
+ * Copyright 2020-2023 Elk Audio AB
+ * ElkLog is free software: you can redistribute it and/or modify it under the terms
+ * of the GNU General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * Twine is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with Twine.
+ * If not, see http://www.gnu.org/licenses/ .
+ */
+
+/**
+ * @brief Rate limiters for log call sites, used by the ELKLOG_LOG_XXX_EVERY_N
+ *        and ELKLOG_LOG_XXX_EVERY_MS macros. Meant to be declared as static
+ *        objects at each call site, they have constexpr constructors so that
+ *        they are constant initialized and need no initialization guard.
+ *        Safe to use from rt threads.
+ *
+ * @copyright Copyright 2020-2023 Elk Audio AB, Stockholm
+ */
+
+#ifndef ELKLOG_RATE_LIMIT_H
+#define ELKLOG_RATE_LIMIT_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+#include "twine/twine.h"
+
+namespace elklog {
+
+/**
+ * @brief Lets through the first of every n calls
+ */
+class EveryN
+{
+public:
+    explicit constexpr EveryN(uint32_t n) : _n(n > 0 ? n : 1) {}
+
+    bool should_log()
+    {
+        return _count.fetch_add(1, std::memory_order_relaxed) % _n == 0;
+    }
+
+private:
+    uint32_t _n;
+    std::atomic<uint32_t> _count {0};
+};
+
+/**
+ * @brief Lets through at most one call per interval
+ */
+class EveryInterval
+{
+public:
+    explicit constexpr EveryInterval(std::chrono::milliseconds interval) :
+        _interval(std::chrono::duration_cast<std::chrono::nanoseconds>(interval).count()) {}
+
+    bool should_log()
+    {
+        int64_t now = twine::current_rt_time().count();
+        int64_t next = _next.load(std::memory_order_relaxed);
+        if (now < next)
+        {
+            return false;
+        }
+        // Only one of several threads passing at the same time gets through
+        return _next.compare_exchange_strong(next, now + _interval, std::memory_order_relaxed);
+    }
+
+private:
+    int64_t _interval;
+    std::atomic<int64_t> _next {INT64_MIN};
+};
+
+} // namespace elklog
+
+#endif // ELKLOG_RATE_LIMIT_H
@@ -0,0 +1,257 @@
+/*
+ * Copyright 2020-2023 Elk Audio AB
+ * ElkLog is free software: you can redistribute it and/or modify it under the terms
+ * of the GNU General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * Twine is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with Twine.
+ * If not, see http://www.gnu.org/licenses/ .
+ */
+
+/**
+ * @brief spdlog sink that writes to a fixed size, memory-mapped file used as
+ *        a ring, overwriting the oldest messages when full. Writing a message
+ *        is a memcpy into the mapping, without system calls, and the content
+ *        survives a crash of the process, as it is already in the page cache.
+ *        flush() syncs the mapping to disk, so that it also survives a power
+ *        loss on filesystems that keep the data.
+ *
+ *        The file starts with a RingFileHeader, followed by the ring. An
+ *        existing ring file of the same size is appended to, so that the
+ *        messages before a crash are still there after a restart.
+ *        read_ring_file() returns the content in order, oldest first, and is
+ *        used by the elklog_ring_dump tool.
+ *
+ * @copyright Copyright 2020-2023 Elk Audio AB, Stockholm
+ */
+
+#ifndef ELKLOG_RING_FILE_SINK_H
+#define ELKLOG_RING_FILE_SINK_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "spdlog/common.h"
+#include "spdlog/details/null_mutex.h"
+#include "spdlog/sinks/base_sink.h"
+
+namespace elklog {
+
+constexpr std::array<char, 8> RING_FILE_MAGIC = {'E', 'L', 'K', 'R', 'I', 'N', 'G', '\0'};
+constexpr uint32_t RING_FILE_VERSION = 1;
+// The ring starts on the next page after the header
+constexpr size_t RING_FILE_HEADER_SIZE = 4096;
+
+struct RingFileHeader
+{
+    std::array<char, 8> magic;
+    uint32_t version;
+    uint32_t header_size;
+    uint64_t capacity;
+    // Total number of bytes written since the file was created, the write
+    // position in the ring is written % capacity
+    std::atomic<uint64_t> written;
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free);
+static_assert(sizeof(RingFileHeader) <= RING_FILE_HEADER_SIZE);
+
+/**
+ * @brief Read the header fields from the raw bytes of a ring file
+ * @return false if it is not a valid ring file header
+ */
+inline bool parse_ring_file_header(const char* data, uint64_t& capacity, uint64_t& written)
+{
+    std::array<char, 8> magic;
+    uint32_t version;
+    uint32_t header_size;
+    std::memcpy(magic.data(), data + offsetof(RingFileHeader, magic), magic.size());
+    std::memcpy(&version, data + offsetof(RingFileHeader, version), sizeof(version));
+    std::memcpy(&header_size, data + offsetof(RingFileHeader, header_size), sizeof(header_size));
+    std::memcpy(&capacity, data + offsetof(RingFileHeader, capacity), sizeof(capacity));
+    std::memcpy(&written, data + offsetof(RingFileHeader, written), sizeof(written));
+    return magic == RING_FILE_MAGIC && version == RING_FILE_VERSION &&
+           header_size == RING_FILE_HEADER_SIZE && capacity > 0;
+}
+
+template<typename Mutex>
+class RingFileSink : public spdlog::sinks::base_sink<Mutex>
+{
+public:
+    /**
+     * @brief Open or create a ring file, throws spdlog::spdlog_ex on failure
+     *        like the spdlog file sinks
+     * @param path Path of the file
+     * @param capacity Size of the ring in bytes, the file is slightly larger
+     */
+    RingFileSink(const std::string& path, size_t capacity) : _capacity(capacity)
+    {
+        if (capacity == 0)
+        {
+            spdlog::throw_spdlog_ex("Ring file size must be > 0");
+        }
+        _fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        if (_fd < 0)
+        {
+            spdlog::throw_spdlog_ex("Failed to open ring file " + path, errno);
+        }
+
+        _map_size = RING_FILE_HEADER_SIZE + capacity;
+        bool reuse = _has_valid_header();
+        if (reuse == false && ::ftruncate(_fd, _map_size) != 0)
+        {
+            ::close(_fd);
+            spdlog::throw_spdlog_ex("Failed to resize ring file " + path, errno);
+        }
+
+        void* map = ::mmap(nullptr, _map_size, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+        if (map == MAP_FAILED)
+        {
+            ::close(_fd);
+            spdlog::throw_spdlog_ex("Failed to map ring file " + path, errno);
+        }
+        _header = static_cast<RingFileHeader*>(map);
+        _ring = static_cast<char*>(map) + RING_FILE_HEADER_SIZE;
+
+        if (reuse)
+        {
+            // The last message before a crash could be cut off
+            uint64_t written = _header->written.load(std::memory_order_relaxed);
+            if (written > 0 && _ring[(written - 1) % _capacity] != '\n')
+            {
+                _write("\n", 1);
+            }
+        }
+        else
+        {
+            _header->magic = RING_FILE_MAGIC;
+            _header->version = RING_FILE_VERSION;
+            _header->header_size = RING_FILE_HEADER_SIZE;
+            _header->capacity = _capacity;
+            _header->written.store(0, std::memory_order_release);
+        }
+    }
+
+    ~RingFileSink() override
+    {
+        ::munmap(_header, _map_size);
+        ::close(_fd);
+    }
+
+protected:
+    void sink_it_(const spdlog::details::log_msg& msg) override
+    {
+        spdlog::memory_buf_t formatted;
+        this->formatter_->format(msg, formatted);
+        _write(formatted.data(), formatted.size());
+    }
+
+    void flush_() override
+    {
+        ::msync(_header, _map_size, MS_SYNC);
+    }
+
+private:
+    bool _has_valid_header()
+    {
+        std::array<char, sizeof(RingFileHeader)> data;
+        if (::pread(_fd, data.data(), data.size(), 0) != static_cast<ssize_t>(data.size()) ||
+            ::lseek(_fd, 0, SEEK_END) != static_cast<off_t>(_map_size))
+        {
+            return false;
+        }
+        uint64_t capacity;
+        uint64_t written;
+        return parse_ring_file_header(data.data(), capacity, written) && capacity == _capacity;
+    }
+
+    void _write(const char* data, size_t size)
+    {
+        // Only the end of a message longer than the whole ring is kept
+        if (size > _capacity)
+        {
+            data += size - _capacity;
+            size = _capacity;
+        }
+        uint64_t written = _header->written.load(std::memory_order_relaxed);
+        size_t pos = written % _capacity;
+        size_t first = std::min(size, _capacity - pos);
+        std::memcpy(_ring + pos, data, first);
+        std::memcpy(_ring, data + first, size - first);
+
+        // Published after the data, so that a crash in the middle of a write
+        // leaves the previous content readable
+        _header->written.store(written + size, std::memory_order_release);
+    }
+
+    size_t _capacity;
+    size_t _map_size {0};
+    int _fd {-1};
+    RingFileHeader* _header {nullptr};
+    char* _ring {nullptr};
+};
+
+using ring_file_sink_mt = RingFileSink<std::mutex>;
+using ring_file_sink_st = RingFileSink<spdlog::details::null_mutex>;
+
+/**
+ * @brief Read the content of a ring file in order, oldest first. If the ring
+ *        has wrapped around, the partly overwritten oldest line is skipped.
+ * @return false if the file could not be read or is not a ring file
+ */
+inline bool read_ring_file(const std::string& path, std::string& content)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+    {
+        return false;
+    }
+    std::vector<char> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    if (data.size() < RING_FILE_HEADER_SIZE)
+    {
+        return false;
+    }
+
+    uint64_t capacity;
+    uint64_t written;
+    if (parse_ring_file_header(data.data(), capacity, written) == false ||
+        data.size() < RING_FILE_HEADER_SIZE + capacity)
+    {
+        return false;
+    }
+
+    const char* ring = data.data() + RING_FILE_HEADER_SIZE;
+    if (written <= capacity)
+    {
+        content.assign(ring, written);
+        return true;
+    }
+
+    size_t start = written % capacity;
+    content.assign(ring + start, capacity - start);
+    content.append(ring, start);
+    auto line_end = content.find('\n');
+    content.erase(0, line_end == std::string::npos ? content.size() : line_end + 1);
+    return true;
+}
+
+} // namespace elklog
+
+#endif // ELKLOG_RING_FILE_SINK_H
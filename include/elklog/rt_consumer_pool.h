@@ -0,0 +1,236 @@
+/*
+ * Copyright 2020-2023 Elk Audio AB
+ * ElkLog is free software: you can redistribute it and/or modify it under the terms
+ * of the GNU General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * Twine is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with Twine.
+ * If not, see http://www.gnu.org/licenses/ .
+ */
+
+/**
+ * @brief A fixed number of consumer threads shared by many RtLoggers, instead
+ *        of one consumer thread per logger. Each logger is assigned to the
+ *        worker with the fewest loggers and is polled by it together with the
+ *        other loggers of that worker.
+ *
+ *        Workers back off from poll_period up to max_idle_period while none
+ *        of their loggers have any messages, and are woken up early through
+ *        the signal returned by add().
+ *
+ * @copyright Copyright 2020-2023 Elk Audio AB, Stockholm
+ */
+
+#ifndef ELKLOG_RT_CONSUMER_POOL_H
+#define ELKLOG_RT_CONSUMER_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "rtsignal.h"
+#include "thread_config.h"
+
+namespace elklog {
+
+class RtConsumerPool
+{
+public:
+    /**
+     * @brief Called from a worker thread to pass on the queued messages of a
+     *        logger, returns the number of messages and events consumed
+     */
+    using ConsumeFunction = std::function<size_t()>;
+
+    struct Registration
+    {
+        int worker {-1};
+        uint64_t id {0};
+        RtSignal* wakeup {nullptr};
+    };
+
+    /**
+     * @param thread_config Applied to every worker thread when it starts, see
+     *                      thread_config_status()
+     */
+    RtConsumerPool(int threads,
+                   std::chrono::milliseconds poll_period,
+                   std::chrono::milliseconds max_idle_period,
+                   const ThreadConfig& thread_config = {}) :
+        _poll_period(poll_period),
+        _max_idle_period(std::max(poll_period, max_idle_period))
+    {
+        threads = std::max(threads, 1);
+        for (int i = 0; i < threads; ++i)
+        {
+            _workers.push_back(std::make_unique<Worker>());
+        }
+        _running.store(true);
+        std::vector<std::future<Status>> started;
+        for (auto& worker : _workers)
+        {
+            std::promise<Status> config_status;
+            started.push_back(config_status.get_future());
+            worker->thread = std::thread(&RtConsumerPool::_worker_loop, this, worker.get(),
+                                         thread_config, std::move(config_status));
+        }
+        for (auto& status : started)
+        {
+            if (status.get() != Status::OK)
+            {
+                _thread_config_status = Status::FAILED_TO_CONFIGURE_THREAD;
+            }
+        }
+    }
+
+    /**
+     * @brief Stops the workers, all loggers must be removed before
+     */
+    ~RtConsumerPool()
+    {
+        _running.store(false);
+        for (auto& worker : _workers)
+        {
+            worker->wakeup.notify();
+            if (worker->thread.joinable())
+            {
+                worker->thread.join();
+            }
+        }
+    }
+
+    /**
+     * @brief Start calling consume from the least loaded worker. Not safe to
+     *        call from rt threads.
+     * @return A registration to pass to remove(), with the signal that wakes
+     *         up the worker early
+     */
+    Registration add(ConsumeFunction consume)
+    {
+        size_t index = 0;
+        for (size_t i = 1; i < _workers.size(); ++i)
+        {
+            if (_workers[i]->count.load() < _workers[index]->count.load())
+            {
+                index = i;
+            }
+        }
+
+        auto& worker = *_workers[index];
+        std::scoped_lock lock(worker.mutex);
+        Registration registration;
+        registration.worker = static_cast<int>(index);
+        registration.id = ++_next_id;
+        registration.wakeup = &worker.wakeup;
+        worker.consumers.push_back({registration.id, std::move(consume)});
+        worker.count++;
+        return registration;
+    }
+
+    /**
+     * @brief Stop calling the consume function of a registration. When this
+     *        returns, the function is not running and will not be called again.
+     */
+    void remove(const Registration& registration)
+    {
+        if (registration.worker < 0 || registration.worker >= static_cast<int>(_workers.size()))
+        {
+            return;
+        }
+        auto& worker = *_workers[registration.worker];
+        std::scoped_lock lock(worker.mutex);
+        auto& consumers = worker.consumers;
+        auto entry = std::find_if(consumers.begin(), consumers.end(),
+                                  [&](const Consumer& consumer) { return consumer.id == registration.id; });
+        if (entry != consumers.end())
+        {
+            consumers.erase(entry);
+            worker.count--;
+        }
+    }
+
+    int threads() const
+    {
+        return static_cast<int>(_workers.size());
+    }
+
+    /**
+     * @brief FAILED_TO_CONFIGURE_THREAD if the thread config could not be
+     *        applied to all workers
+     */
+    Status thread_config_status() const
+    {
+        return _thread_config_status;
+    }
+
+    /**
+     * @brief The number of loggers of each worker
+     */
+    std::vector<int> load() const
+    {
+        std::vector<int> load;
+        for (const auto& worker : _workers)
+        {
+            load.push_back(worker->count.load());
+        }
+        return load;
+    }
+
+private:
+    struct Consumer
+    {
+        uint64_t id;
+        ConsumeFunction consume;
+    };
+
+    struct Worker
+    {
+        std::thread thread;
+        std::mutex mutex;
+        std::vector<Consumer> consumers;
+        std::atomic<int> count {0};
+        RtSignal wakeup;
+    };
+
+    void _worker_loop(Worker* worker, ThreadConfig thread_config, std::promise<Status> config_status)
+    {
+        config_status.set_value(apply_thread_config(thread_config));
+        auto period = _poll_period;
+        while (_running)
+        {
+            size_t count = 0;
+            {
+                // Held while consuming, so that remove() waits for the pass to finish
+                std::scoped_lock lock(worker->mutex);
+                for (auto& consumer : worker->consumers)
+                {
+                    count += consumer.consume();
+                }
+            }
+            period = count > 0 ? _poll_period : std::min(period * 2, _max_idle_period);
+            worker->wakeup.wait_for(period);
+        }
+    }
+
+    std::chrono::milliseconds _poll_period;
+    std::chrono::milliseconds _max_idle_period;
+    std::atomic<bool> _running {false};
+    std::atomic<uint64_t> _next_id {0};
+    Status _thread_config_status {Status::OK};
+    std::vector<std::unique_ptr<Worker>> _workers;
+};
+
+} // namespace elklog
+
+#endif // ELKLOG_RT_CONSUMER_POOL_H
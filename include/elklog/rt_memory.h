@@ -0,0 +1,76 @@
+/*
+ * Copyright 2020-2023 Elk Audio AB
+ * ElkLog is free software: you can redistribute it and/or modify it under the terms
+ * of the GNU General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * Twine is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with Twine.
+ * If not, see http://www.gnu.org/licenses/ .
+ */
+
+/**
+ * @brief Helpers to make sure memory used from rt threads is mapped before
+ *        it is used, so that the first accesses do not cause page faults.
+ *
+ * @copyright Copyright 2020-2023 Elk Audio AB, Stockholm
+ */
+
+#ifndef ELKLOG_RT_MEMORY_H
+#define ELKLOG_RT_MEMORY_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace elklog {
+
+/**
+ * @brief Write to every page in the range so that it is mapped to physical
+ *        memory. The content is left unchanged, so this can be done on memory
+ *        that already holds objects, as long as no other thread uses it.
+ */
+inline void prefault_memory(void* data, size_t size)
+{
+    static const size_t page_size = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+    auto begin = static_cast<volatile char*>(data);
+    auto end = begin + size;
+    // Also covers the last page, which the stride could step over
+    for (auto page = begin; page < end; page += page_size)
+    {
+        *page = *page;
+    }
+    if (size > 0)
+    {
+        *(end - 1) = *(end - 1);
+    }
+}
+
+/**
+ * @brief Lock the pages of the range in memory so that they can not be paged out
+ * @return false if it could not be locked, i.e. because of RLIMIT_MEMLOCK
+ */
+inline bool lock_memory(const void* data, size_t size)
+{
+    return ::mlock(data, size) == 0;
+}
+
+/**
+ * @brief Unlock the pages of the range. Locks do not stack, so this also
+ *        unlocks other data on the same pages, and pages locked with
+ *        mlockall(). Only use it on page aligned memory that is owned by the
+ *        caller.
+ */
+inline void unlock_memory(const void* data, size_t size)
+{
+    ::munlock(data, size);
+}
+
+} // namespace elklog
+
+#endif // ELKLOG_RT_MEMORY_H
@@ -16,7 +16,59 @@
  * @brief Real-Time logger that can be used to pass messages
  *        from RT to non-RT and merged into the main log system used.
  *
- *        Not safe to log messages from multiple RT threads at the same time.
+ *        Not safe to log messages from multiple RT threads at the same time,
+ *        unless ELKLOG_MULTI_THREADED_RT_LOGGING is defined. Then RT threads
+ *        either share a single queue guarded by a spinlock, or if
+ *        ELKLOG_RT_PER_THREAD_QUEUES is also defined, each thread gets its own
+ *        wait-free queue and messages are merged in timestamp order by the
+ *        consumer thread. With ELKLOG_RT_LOCK_FREE_QUEUE, all threads share a
+ *        lock-free multi-producer queue instead, fifo_size must then be a
+ *        power of 2.
+ *
+ *        If ELKLOG_RT_VARIABLE_LENGTH_QUEUE is defined, messages are stored in
+ *        a variable-length record ring and fifo_size is the capacity of the
+ *        ring in bytes rather than in messages.
+ *
+ *        If ELKLOG_RT_DEFERRED_FORMATTING is defined, messages whose arguments
+ *        are all numeric are not formatted on the RT thread. Only the format
+ *        string pointer and a copy of the arguments are queued, and formatting
+ *        is done on the consumer thread before the message is passed on.
+ *
+ *        If error_fifo_size is > 0, error messages are put in a separate queue
+ *        of that size, so that they can not be dropped because the main queue
+ *        is filled up by messages of lower levels. The consumer thread merges
+ *        the two queues in timestamp order.
+ *
+ *        Format strings can be plain strings or static formats created with
+ *        ELKLOG_FORMAT, which are checked against the arguments at compile time.
+ *
+ *        If trace_fifo_size is > 0, trace events (see trace_event.h) can be
+ *        queued with the trace_xxx() functions. They have their own lock-free
+ *        queue, of a size that must be a power of 2, and are passed to the
+ *        trace callback from the consumer thread.
+ *
+ *        All memory used by rt threads is prefaulted when the logger is
+ *        created, and also locked in memory if ELKLOG_RT_LOCK_MEMORY is
+ *        defined, so that the first messages do not cause page faults. The
+ *        pages are left locked when the logger is destroyed. To place the
+ *        logger in a specific memory region, i.e. one backed by huge pages,
+ *        construct it there with placement new.
+ *
+ *        Threads that log often can resolve their queues once with
+ *        bind_thread() and log with log_bound(), instead of looking them up
+ *        on every call.
+ *
+ *        The consumer thread drains the queues in batches of up to
+ *        CONSUMER_BATCH_SIZE messages, which are passed to the callback in a
+ *        single call if it takes an RtLogBatch, or one call per message if
+ *        it takes an RtLogMessage.
+ *
+ *        Instead of starting a consumer thread of its own, the logger can be
+ *        consumed by a worker of an RtConsumerPool shared with other loggers.
+ *
+ *        If ELKLOG_RT_TELEMETRY is defined, histograms of the producer cost,
+ *        message size and queue latency of messages are recorded, see
+ *        log_telemetry.h and telemetry().
  *
  * @copyright Copyright 2020-2023 Elk Audio AB, Stockholm
  */
@@ -26,8 +78,51 @@
 
 #include <string>
 #include <functional>
+#include <vector>
 
 #include "rtlogmessage.h"
+#include "log_stats.h"
+#include "log_telemetry.h"
+#include "trace_event.h"
+#include "log_return_code.h"
+#include "rt_consumer_pool.h"
+
+namespace elklog {
+
+/**
+ * @brief A batch of messages passed to the consumer callback. Only valid
+ *        during the callback.
+ */
+template<size_t message_len>
+class RtLogBatch
+{
+public:
+    RtLogBatch(const RtLogMessage<message_len>* const* messages, size_t size) :
+        _messages(messages),
+        _size(size)
+    {}
+
+    size_t size() const
+    {
+        return _size;
+    }
+
+    bool empty() const
+    {
+        return _size == 0;
+    }
+
+    const RtLogMessage<message_len>& operator[](size_t index) const
+    {
+        return *_messages[index];
+    }
+
+private:
+    const RtLogMessage<message_len>* const* _messages;
+    size_t _size;
+};
+
+} // namespace elklog
 
 #ifndef ELKLOG_DISABLE_LOGGING
 
@@ -36,24 +131,110 @@
 #include <chrono>
 #include <thread>
 #include <atomic>
+#include <future>
+#include <mutex>
 
 #include "fifo/circularfifo_memory_relaxed_aquire_release.h"
 #include "twine/twine.h"
 
-#include "spinlock.h"
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "rtlogring.h"
+#include "rtlogqueue.h"
+#include "rtsignal.h"
+#include "rt_memory.h"
 
 
 namespace elklog {
 
+#ifdef ELKLOG_RT_VARIABLE_LENGTH_QUEUE
 template<size_t message_len, size_t fifo_size>
+using RtLogFifo = RtLogMessageRing<message_len, fifo_size>;
+#else
+// Cache line aligned slots, so that the message being written does not share
+// a cache line with the one being read
+template<size_t message_len, size_t fifo_size>
+using RtLogFifo = memory_relaxed_aquire_release::CircularFifo<RtLogMessage<message_len>, fifo_size,
+                                                              memory_relaxed_aquire_release::CACHE_LINE_SIZE>;
+#endif
+
+#if defined(ELKLOG_RT_LOCK_FREE_QUEUE)
+template<size_t message_len, size_t fifo_size>
+using RtLogQueue = MpscRtLogQueue<RtLogMessage<message_len>, fifo_size>;
+#elif defined(ELKLOG_RT_PER_THREAD_QUEUES)
+template<size_t message_len, size_t fifo_size>
+using RtLogQueue = PerThreadRtLogQueue<RtLogMessage<message_len>, RtLogFifo<message_len, fifo_size>, ELKLOG_RT_MAX_THREADS>;
+#else
+template<size_t message_len, size_t fifo_size>
+using RtLogQueue = LockedRtLogQueue<RtLogMessage<message_len>, RtLogFifo<message_len, fifo_size>>;
+#endif
+
+template<size_t message_len, size_t fifo_size, size_t error_fifo_size = 0, size_t trace_fifo_size = 0>
 class RtLogger
 {
+    static constexpr bool USE_ERROR_QUEUE = error_fifo_size > 0;
+    using ErrorQueue = std::conditional_t<USE_ERROR_QUEUE, RtLogQueue<message_len, error_fifo_size>, std::nullptr_t>;
+
 public:
+    using MessageCallback = std::function<void(const RtLogMessage<message_len>& msg)>;
+    using BatchCallback = std::function<void(const RtLogBatch<message_len>& batch)>;
+    using TraceCallback = std::function<void(const TraceEvent* events, size_t count)>;
+
+    static constexpr size_t CONSUMER_BATCH_SIZE = 32;
+
+    /**
+     * @brief Create an RtLogger and start its consumer thread
+     *
+     * @param consumer_poll_period Time between checks for new messages
+     * @param consumer_callback Called from the consumer thread for each batch of messages
+     * @param min_log_level Minimum logging level (debug, info, warning, error)
+     * @param wakeup_threshold If > 0, the consumer thread is signaled to wake up
+     *                         early when this many messages have been queued
+     *                         since it last ran
+     * @param max_idle_period If longer than consumer_poll_period, the poll period is
+     *                        doubled every time the queue is found empty, up to
+     *                        this period
+     * @param format_deferred If false, deferred messages are passed to the callback
+     *                        unformatted, i.e. for writing them in binary form
+     * @param collapse_repeated If true, identical consecutive messages are passed on
+     *                          once, followed by a message with the number of repeats
+     * @param trace_callback Called from the consumer thread with batches of trace events
+     * @param consumer_pool If not nullptr, the queues are consumed by a worker of
+     *                      this pool instead of by a thread of the logger's own,
+     *                      with the poll periods of the pool. Must outlive the logger.
+     */
     RtLogger(std::chrono::milliseconds consumer_poll_period,
-             std::function<void(const RtLogMessage<message_len>& msg)> consumer_callback,
-             const std::string& min_log_level) :
-        _consumer_callback(consumer_callback)
+             BatchCallback consumer_callback,
+             const std::string& min_log_level,
+             int wakeup_threshold = 0,
+             std::chrono::milliseconds max_idle_period = std::chrono::milliseconds(0),
+             bool format_deferred = true,
+             bool collapse_repeated = false,
+             TraceCallback trace_callback = nullptr,
+             RtConsumerPool* consumer_pool = nullptr) :
+        _consumer_pool(consumer_pool),
+        _wakeup_threshold(wakeup_threshold),
+        _format_deferred(format_deferred),
+        _collapse_repeated(collapse_repeated),
+        _consumer_callback(consumer_callback),
+        _trace_callback(trace_callback)
     {
+        if constexpr (USE_TRACE_QUEUE)
+        {
+            _trace_batch.resize(TRACE_BATCH_SIZE);
+        }
+        _batch.messages.resize(CONSUMER_BATCH_SIZE);
+        if constexpr (USE_ERROR_QUEUE)
+        {
+            _error_batch.messages.resize(CONSUMER_BATCH_SIZE);
+        }
+        // Room for every message of both batches plus one repeat report
+        _output.reserve(2 * CONSUMER_BATCH_SIZE + 1);
+        _prepare_memory();
+
         std::map<std::string, RtLogLevel> level_map;
         level_map["debug"] = RtLogLevel::DEBUG;
         level_map["info"] = RtLogLevel::INFO;
@@ -65,91 +246,876 @@ public:
 
         if (level_map.count(log_level_lowercase) > 0)
         {
-            _min_log_level = level_map[log_level_lowercase];
+            _min_log_level.store(level_map[log_level_lowercase]);
         }
         else
         {
-            _min_log_level = RtLogLevel::INFO;
+            _min_log_level.store(RtLogLevel::INFO);
         }
         _sleep_period = std::chrono::milliseconds(consumer_poll_period);
+        _max_idle_period = std::max(_sleep_period, max_idle_period);
+        _last_drop_report = std::chrono::steady_clock::now();
         _consumer_running.store(true);
-        _consumer_thread = std::thread(&RtLogger::_consumer_worker, this);
+        if (consumer_pool)
+        {
+            _registration = consumer_pool->add([this]() { return _consume(); });
+            _wakeup_signal = _registration.wakeup;
+        }
+        else
+        {
+            _consumer_thread = std::thread(&RtLogger::_consumer_worker, this);
+        }
     }
 
+    /**
+     * @brief Create an RtLogger with a callback that is called for each message
+     */
+    RtLogger(std::chrono::milliseconds consumer_poll_period,
+             MessageCallback consumer_callback,
+             const std::string& min_log_level,
+             int wakeup_threshold = 0,
+             std::chrono::milliseconds max_idle_period = std::chrono::milliseconds(0),
+             bool format_deferred = true,
+             bool collapse_repeated = false,
+             TraceCallback trace_callback = nullptr,
+             RtConsumerPool* consumer_pool = nullptr) :
+        RtLogger(consumer_poll_period,
+                 BatchCallback([callback = std::move(consumer_callback)](const RtLogBatch<message_len>& batch)
+                 {
+                     for (size_t i = 0; i < batch.size(); ++i)
+                     {
+                         callback(batch[i]);
+                     }
+                 }),
+                 min_log_level, wakeup_threshold, max_idle_period, format_deferred, collapse_repeated,
+                 std::move(trace_callback), consumer_pool)
+    {}
+
+    /**
+     * @brief Wakes up the consumer rather than waiting for its poll period, and
+     *        passes on what is left in the queues before returning
+     */
     virtual ~RtLogger()
     {
         _consumer_running.store(false);
+        if (_consumer_pool)
+        {
+            _consumer_pool->remove(_registration);
+            // The pool no longer calls _consume(), so it is safe to do here
+            _consume();
+        }
+        _wakeup.notify();
         if (_consumer_thread.joinable())
         {
             _consumer_thread.join();
         }
+        // Memory is not unlocked, as the locked pages are shared with other
+        // allocations, and may also have been locked by the host with mlockall()
     }
 
-    template<RtLogLevel level, typename... Args>
-    void log(const char* format_str, Args&&... args)
+    template<RtLogLevel level, typename Format, typename... Args>
+    void log(const Format& format_str, Args&&... args)
     {
-        if (_min_log_level < level)
+        check_message<Format, Args...>();
+        if (ELKLOG_UNLIKELY(_min_log_level.load(std::memory_order_relaxed) < level))
         {
+            _stats.count_filtered();
             return;
         }
-        RtLogMessage<message_len> message;
-        message.set_message(level, twine::current_rt_time(), format_str, args...);
+        if (_push<level>(nullptr, twine::current_rt_time(), format_str, args...) == false)
+        {
+            _stats.count_dropped(level);
+        }
+    }
+
+    /**
+     * @brief Count a message that was dropped before it reached the rt queue,
+     *        i.e. by a full non-rt queue, so that it is included in stats()
+     *        and in the periodic drop reports
+     */
+    void count_dropped(RtLogLevel level)
+    {
+        _stats.count_dropped(level);
+    }
+
+    /**
+     * @brief The queues of the calling thread, see bind_thread()
+     */
+    struct ThreadBinding
+    {
+        using QueueBinding = typename RtLogQueue<message_len, fifo_size>::ThreadBinding;
+        // Unused without an error queue
+        using ErrorQueueBinding = typename std::conditional_t<USE_ERROR_QUEUE, ErrorQueue,
+                                                              RtLogQueue<message_len, fifo_size>>::ThreadBinding;
+        QueueBinding queue {};
+        ErrorQueueBinding error_queue {};
+    };
+
+    /**
+     * @brief Resolve the queues of the calling thread once, i.e. claim its
+     *        own queue with ELKLOG_RT_PER_THREAD_QUEUES, so that log_bound()
+     *        does not have to look them up on every call. The binding is only
+     *        valid for the calling thread and this logger.
+     */
+    ThreadBinding bind_thread()
+    {
+        ThreadBinding binding;
+        binding.queue = _queue.bind_thread();
+        if constexpr (USE_ERROR_QUEUE)
+        {
+            binding.error_queue = _error_queue.bind_thread();
+        }
+        return binding;
+    }
+
+    /**
+     * @brief Same as log(), with the queues of a binding from bind_thread()
+     */
+    template<RtLogLevel level, typename Format, typename... Args>
+    void log_bound(const ThreadBinding& binding, const Format& format_str, Args&&... args)
+    {
+        check_message<Format, Args...>();
+        if (ELKLOG_UNLIKELY(_min_log_level.load(std::memory_order_relaxed) < level))
+        {
+            _stats.count_filtered();
+            return;
+        }
+        if (_push<level>(&binding, twine::current_rt_time(), format_str, args...) == false)
+        {
+            _stats.count_dropped(level);
+        }
+    }
+
+    /**
+     * @brief Log a message from a non-rt thread. Instead of dropping the message
+     *        if the queue is full, the consumer thread is woken up and the call
+     *        waits until there is room for it. Not safe to call from rt threads.
+     */
+    template<RtLogLevel level, typename Format, typename... Args>
+    void log_blocking(const Format& format_str, Args&&... args)
+    {
+        check_message<Format, Args...>();
+        if (ELKLOG_UNLIKELY(_min_log_level.load(std::memory_order_relaxed) < level))
+        {
+            _stats.count_filtered();
+            return;
+        }
+        auto timestamp = twine::current_rt_time();
+        while (_push<level>(nullptr, timestamp, format_str, args...) == false)
+        {
+            if (_consumer_running.load(std::memory_order_relaxed) == false)
+            {
+                _stats.count_dropped(level);
+                return;
+            }
+            _wakeup_signal->notify();
+            std::this_thread::sleep_for(BLOCKING_RETRY_PERIOD);
+        }
+    }
 
-        _lock.lock();
-        _queue.push(message);
-        _lock.unlock();
+    /**
+     * @brief Wait until all messages and trace events queued before the call
+     *        have been passed to the callbacks, or until timeout. Not safe to
+     *        call from rt threads or from the callbacks.
+     * @return true if all messages were passed on
+     */
+    bool drain(std::chrono::milliseconds timeout)
+    {
+        auto target = _stats.pushed();
+        auto trace_target = _stats.traced();
+        auto deadline = std::chrono::steady_clock::now() + timeout;
+        while (_stats.consumed() < target || _trace_consumed.load(std::memory_order_acquire) < trace_target)
+        {
+            if (std::chrono::steady_clock::now() >= deadline)
+            {
+                return false;
+            }
+            _wakeup_signal->notify();
+            std::this_thread::sleep_for(BLOCKING_RETRY_PERIOD);
+        }
+        return true;
     }
 
-    template<typename... Args>
-    void log_debug(const char* format_str, Args&&... args)
+    template<typename Format, typename... Args>
+    void log_debug(const Format& format_str, Args&&... args)
     {
         log<RtLogLevel::DEBUG>(format_str, args...);
     }
 
-    template<typename... Args>
-    void log_info(const char* format_str, Args&&... args)
+    template<typename Format, typename... Args>
+    void log_info(const Format& format_str, Args&&... args)
     {
         log<RtLogLevel::INFO>(format_str, args...);
     }
 
-    template<typename... Args>
-    void log_warning(const char* format_str, Args&&... args)
+    template<typename Format, typename... Args>
+    void log_warning(const Format& format_str, Args&&... args)
     {
         log<RtLogLevel::WARNING>(format_str, args...);
     }
 
-    template<typename... Args>
-    void log_error(const char* format_str, Args&&... args)
+    template<typename Format, typename... Args>
+    void log_error(const Format& format_str, Args&&... args)
     {
         log<RtLogLevel::ERROR>(format_str, args...);
     }
 
+    /**
+     * @brief Trace events, safe to call from any thread. The name must be
+     *        created with ELKLOG_TRACE_NAME. These do nothing if trace_fifo_size is 0.
+     */
+    template<typename Name>
+    void trace_begin(const Name& name)
+    {
+        trace_event(TraceEventType::BEGIN, _trace_name_id(name));
+    }
+
+    template<typename Name>
+    void trace_end(const Name& name)
+    {
+        trace_event(TraceEventType::END, _trace_name_id(name));
+    }
+
+    template<typename Name>
+    void trace_instant(const Name& name)
+    {
+        trace_event(TraceEventType::INSTANT, _trace_name_id(name));
+    }
+
+    template<typename Name>
+    void trace_counter(const Name& name, int64_t value)
+    {
+        trace_event(TraceEventType::COUNTER, _trace_name_id(name), value);
+    }
+
+    /**
+     * @brief Begin a span that ends when the returned object goes out of scope
+     */
+    template<typename Name>
+    TraceScope<RtLogger> trace_scope(const Name& name)
+    {
+        return TraceScope<RtLogger>(*this, _trace_name_id(name));
+    }
+
+    void trace_event([[maybe_unused]] TraceEventType type, [[maybe_unused]] uint32_t name_id,
+                     [[maybe_unused]] int64_t value = 0)
+    {
+        if constexpr (USE_TRACE_QUEUE)
+        {
+            auto timestamp = twine::current_rt_time();
+            bool queued = _trace_queue.write([&](TraceEvent& event)
+            {
+                event.timestamp = timestamp;
+                event.value = value;
+                event.name_id = name_id;
+                event.thread_id = _current_thread_id();
+                event.type = type;
+            });
+            if (queued == false)
+            {
+                _stats.count_trace_dropped();
+                return;
+            }
+            // Wake up the consumer when the queue is half full, as events are
+            // typically traced at a high rate
+            if (_stats.count_traced() % (trace_fifo_size / 2) == 0)
+            {
+                _wakeup_signal->notify();
+            }
+        }
+    }
+
+    /**
+     * @brief Change the minimum log level. Safe to call from any thread,
+     *        including rt threads.
+     */
+    void set_min_log_level(RtLogLevel level)
+    {
+        _min_log_level.store(level, std::memory_order_relaxed);
+    }
+
+    RtLogLevel min_log_level() const
+    {
+        return _min_log_level.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Set how the fields of structured messages are encoded when they
+     *        are formatted on the consumer thread, see structured.h
+     */
+    void set_field_encoding(FieldEncoding encoding)
+    {
+        _field_encoding.store(encoding, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Apply config to the consumer thread, i.e. to keep it off the cores
+     *        of rt threads. Waits for the consumer thread to apply it. Not safe to
+     *        call from rt threads. Loggers consumed by an RtConsumerPool are
+     *        configured through the pool instead.
+     */
+    Status set_consumer_thread_config(const ThreadConfig& config)
+    {
+        if (_consumer_pool != nullptr || _consumer_running.load() == false)
+        {
+            return Status::FAILED_TO_CONFIGURE_THREAD;
+        }
+        std::future<Status> status;
+        {
+            std::scoped_lock lock(_thread_config_lock);
+            _thread_config = config;
+            _thread_config_status = std::promise<Status>();
+            status = _thread_config_status.get_future();
+            _thread_config_pending.store(true, std::memory_order_release);
+        }
+        _wakeup.notify();
+        if (status.wait_for(THREAD_CONFIG_TIMEOUT) != std::future_status::ready)
+        {
+            return Status::FAILED_TO_CONFIGURE_THREAD;
+        }
+        return status.get();
+    }
+
+    /**
+     * @brief Returns true if the memory used by rt threads was locked, requires
+     *        ELKLOG_RT_LOCK_MEMORY
+     */
+    bool memory_locked() const
+    {
+        return _memory_locked;
+    }
+
+    /**
+     * @brief Returns a snapshot of the message counters. Safe to call from any thread.
+     */
+    LogStats stats() const
+    {
+        return _stats.snapshot();
+    }
+
+    /**
+     * @brief Returns a snapshot of the histograms recorded since the logger was
+     *        created or reset_telemetry() was called, which are empty unless
+     *        ELKLOG_RT_TELEMETRY is defined. Safe to call from any thread.
+     */
+    LogTelemetry telemetry() const
+    {
+#ifdef ELKLOG_RT_TELEMETRY
+        return _telemetry.snapshot();
+#else
+        return {};
+#endif
+    }
+
+    void reset_telemetry()
+    {
+#ifdef ELKLOG_RT_TELEMETRY
+        _telemetry.reset();
+#endif
+    }
+
+    /**
+     * @brief Pass on a summary of telemetry() from the consumer thread every
+     *        period, at info level, 0 to stop. Requires ELKLOG_RT_TELEMETRY.
+     */
+    void set_telemetry_report_period([[maybe_unused]] std::chrono::milliseconds period)
+    {
+#ifdef ELKLOG_RT_TELEMETRY
+        _telemetry_report_period.store(period, std::memory_order_relaxed);
+#endif
+    }
+
+#ifdef ELKLOG_RT_PER_THREAD_QUEUES
+    /**
+     * @brief Claim a dedicated queue for the calling thread, optional as
+     *        this is otherwise done the first time the thread logs.
+     * @return false if all queues are already in use
+     */
+    bool register_rt_thread()
+    {
+        if constexpr (USE_ERROR_QUEUE)
+        {
+            if (_error_queue.register_thread() == false)
+            {
+                return false;
+            }
+        }
+        return _queue.register_thread();
+    }
+
+    /**
+     * @brief Free the calling thread's queue so that it can be claimed by
+     *        another thread. Done automatically when the thread exits.
+     */
+    void unregister_rt_thread()
+    {
+        if constexpr (USE_ERROR_QUEUE)
+        {
+            _error_queue.unregister_thread();
+        }
+        _queue.unregister_thread();
+    }
+#endif
 
 private:
+    static constexpr bool USE_TRACE_QUEUE = trace_fifo_size > 0;
+    using TraceQueue = std::conditional_t<USE_TRACE_QUEUE, MpscRtLogQueue<TraceEvent, trace_fifo_size>, std::nullptr_t>;
+    static constexpr size_t TRACE_BATCH_SIZE = 256;
+
+    template<typename Name>
+    static uint32_t _trace_name_id(const Name& name)
+    {
+        static_assert(is_static_format_v<Name>, "Trace names must be created with ELKLOG_TRACE_NAME");
+        return format_id(name);
+    }
+
+    using Message = RtLogMessage<message_len>;
+
+    /**
+     * @brief Messages popped from a queue but not yet passed on
+     */
+    struct ConsumerBatch
+    {
+        std::vector<Message> messages;
+        size_t begin {0};
+        size_t end {0};
+        bool full {false};
+
+        bool empty() const
+        {
+            return begin == end;
+        }
+
+        template<typename Queue>
+        size_t refill(Queue& queue)
+        {
+            if (empty() == false)
+            {
+                return 0;
+            }
+            begin = 0;
+            end = queue.pop_bulk(messages.data(), messages.size());
+            full = end == messages.size();
+            return end;
+        }
+    };
+
+    /**
+     * @brief Returns the oldest message of the two batches, or nullptr if
+     *        there is none or the other queue may still hold older messages.
+     */
+    Message* _next_message()
+    {
+        ConsumerBatch* next = nullptr;
+        if constexpr (USE_ERROR_QUEUE)
+        {
+            if (_batch.empty() == false && _error_batch.empty() == false)
+            {
+                const auto& error = _error_batch.messages[_error_batch.begin];
+                const auto& message = _batch.messages[_batch.begin];
+                next = error.timestamp() <= message.timestamp() ? &_error_batch : &_batch;
+            }
+            else if (_batch.empty() == false && _error_batch.full == false)
+            {
+                next = &_batch;
+            }
+            else if (_error_batch.empty() == false && _batch.full == false)
+            {
+                next = &_error_batch;
+            }
+        }
+        else if (_batch.empty() == false)
+        {
+            next = &_batch;
+        }
+        return next ? &next->messages[next->begin++] : nullptr;
+    }
+
+    /**
+     * @brief Set the message in the queue of its level, through the thread
+     *        binding if one is given
+     * @return false if the queue was full
+     */
+    template<RtLogLevel level, typename Format, typename... Args>
+    bool _push(const ThreadBinding* binding, std::chrono::nanoseconds timestamp, const Format& format_str, Args&... args)
+    {
+        auto thread_id = _current_thread_id();
+
+        // The message is set directly in the queue to avoid extra copies
+        auto set_message = [&](RtLogMessage<message_len>& message)
+        {
+            message.set_thread_id(thread_id);
+            if constexpr (are_fields<Args...>())
+            {
+                message.set_structured_message(level, timestamp, format_str, args...);
+            }
+#ifdef ELKLOG_RT_DEFERRED_FORMATTING
+            else if constexpr (RtLogMessage<message_len>::template is_deferrable<Args...>())
+            {
+                message.set_deferred_message(level, timestamp, format_str, args...);
+            }
+#endif
+            else
+            {
+                message.set_message(level, timestamp, format_str, args...);
+            }
+        };
+
+        bool queued;
+        if constexpr (USE_ERROR_QUEUE && level == RtLogLevel::ERROR)
+        {
+            queued = binding ? _error_queue.write(binding->error_queue, set_message) : _error_queue.write(set_message);
+        }
+        else
+        {
+            queued = binding ? _queue.write(binding->queue, set_message) : _queue.write(set_message);
+        }
+
+        if (queued == false)
+        {
+            return false;
+        }
+#ifdef ELKLOG_RT_TELEMETRY
+        _telemetry.producer_cost.record(_elapsed_since(timestamp));
+#endif
+
+        // Only the thread that reaches the threshold signals, once per batch
+        auto pushed = _stats.count_pushed();
+        if (_wakeup_threshold > 0 &&
+            pushed - _pushed_at_last_drain.load(std::memory_order_relaxed) == static_cast<uint64_t>(_wakeup_threshold))
+        {
+            _wakeup_signal->notify();
+        }
+        return true;
+    }
+
+    /**
+     * @brief Returns the same id as spdlog uses for the thread, cached as
+     *        getting it takes a system call
+     */
+    static uint32_t _current_thread_id()
+    {
+#ifdef __linux__
+        static thread_local uint32_t thread_id = static_cast<uint32_t>(::syscall(SYS_gettid));
+#else
+        static thread_local uint32_t thread_id = static_cast<uint32_t>(std::hash<std::thread::id>()(std::this_thread::get_id()));
+#endif
+        return thread_id;
+    }
+
     void _consumer_worker()
     {
-        RtLogMessage<message_len> message;
+        auto period = _sleep_period;
         while (_consumer_running)
         {
-            while (_queue.pop(message))
+            if (_thread_config_pending.load(std::memory_order_acquire))
+            {
+                std::scoped_lock lock(_thread_config_lock);
+                _thread_config_status.set_value(apply_thread_config(_thread_config));
+                _thread_config_pending.store(false, std::memory_order_relaxed);
+            }
+            auto count = _consume();
+            // Back off while idle, bursts are handled by the wakeup signal
+            period = count > 0 ? _sleep_period : std::min(period * 2, _max_idle_period);
+            _wakeup.wait_for(period);
+        }
+        // Messages pushed during the last wait
+        _consume();
+    }
+
+    /**
+     * @brief Pass on everything queued, called from the consumer thread or
+     *        from a worker of the consumer pool
+     * @return The number of messages and trace events consumed
+     */
+    size_t _consume()
+    {
+        // The queue only grows between drains, so this is the max level since the last one.
+        // Messages are counted as pushed after they are queued, so consumed can be ahead.
+        auto pushed = _stats.pushed();
+        auto consumed_before = _stats.consumed();
+        _pushed_at_last_drain.store(pushed, std::memory_order_relaxed);
+        _stats.update_queue_level(pushed > consumed_before ? pushed - consumed_before : 0);
+
+        size_t count = 0;
+        while (true)
+        {
+            size_t popped = _batch.refill(_queue);
+            if constexpr (USE_ERROR_QUEUE)
+            {
+                popped += _error_batch.refill(_error_queue);
+            }
+            if (popped == 0 && _batch.empty() && (USE_ERROR_QUEUE == false || _error_batch.empty()))
+            {
+                break;
+            }
+            // Counted when passed on, so that drain() sees them as consumed only then
+            auto consumed = _consume_batch();
+            _stats.count_consumed(consumed);
+            count += consumed;
+        }
+        if constexpr (USE_TRACE_QUEUE)
+        {
+            count += _consume_traces();
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        if (now - _last_drop_report >= RT_DROP_REPORT_PERIOD)
+        {
+            _report_drops(_reported_drops);
+            _report_repeats();
+            _last_drop_report = now;
+        }
+#ifdef ELKLOG_RT_TELEMETRY
+        auto report_period = _telemetry_report_period.load(std::memory_order_relaxed);
+        if (report_period.count() > 0 && now - _last_telemetry_report >= report_period)
+        {
+            _report_telemetry();
+            _last_telemetry_report = now;
+        }
+#endif
+        return count;
+    }
+
+    /**
+     * @brief Pass on the popped messages in timestamp order as one batch
+     * @return The number of messages taken from the batches, including repeats
+     */
+    size_t _consume_batch()
+    {
+        size_t consumed = 0;
+        _output.clear();
+        _free_slot = nullptr;
+        while (auto message = _next_message())
+        {
+            consumed++;
+            if (_collapse_repeated)
+            {
+                // Compared before formatting, so repeats are never formatted
+                if (_repeat_count >= 0 && message->has_same_content(*_last_message))
+                {
+                    _repeat_count++;
+                    _repeat_timestamp = message->timestamp();
+                    _free_slot = message;
+                    continue;
+                }
+                if (_repeat_count > 0)
+                {
+                    // The slot of a repeat from this batch is reused for the report
+                    auto report = _free_slot ? _free_slot : &_repeat_message;
+                    _set_repeat_report(*report);
+                    _output.push_back(report);
+                }
+                _last_message = message;
+                _repeat_count = 0;
+            }
+            _output.push_back(message);
+        }
+
+        // Keep the last message for comparing with the next batch, as batch slots are reused
+        if (_collapse_repeated && _last_message != &_last_message_copy && _last_message != nullptr)
+        {
+            _last_message_copy = *_last_message;
+            _last_message = &_last_message_copy;
+        }
+
+        if (_format_deferred)
+        {
+            // Batch slots are full size messages, so formatting can be done in place
+            auto encoding = _field_encoding.load(std::memory_order_relaxed);
+            for (auto message : _output)
+            {
+                if (message->is_deferred())
+                {
+                    message->format_deferred(encoding);
+                }
+            }
+        }
+#ifdef ELKLOG_RT_TELEMETRY
+        auto now = twine::current_rt_time();
+        for (auto message : _output)
+        {
+            _telemetry.message_size.record(static_cast<uint64_t>(message->length()));
+            _telemetry.queue_latency.record(_elapsed_since(message->timestamp(), now));
+        }
+#endif
+        if (_output.empty() == false)
+        {
+            _consumer_callback(RtLogBatch<message_len>(_output.data(), _output.size()));
+        }
+        return consumed;
+    }
+
+    /**
+     * @brief Call function with every buffer used by rt threads, i.e. the
+     *        logger itself with its queues, and anything they allocate
+     */
+    template<typename Function>
+    void _for_each_buffer(Function&& function)
+    {
+        function(static_cast<void*>(this), sizeof(*this));
+        function(static_cast<void*>(_batch.messages.data()), _batch.messages.size() * sizeof(Message));
+        _queue.for_each_buffer(function);
+        if constexpr (USE_ERROR_QUEUE)
+        {
+            function(static_cast<void*>(_error_batch.messages.data()), _error_batch.messages.size() * sizeof(Message));
+            _error_queue.for_each_buffer(function);
+        }
+        if constexpr (USE_TRACE_QUEUE)
+        {
+            function(static_cast<void*>(_trace_batch.data()), _trace_batch.size() * sizeof(TraceEvent));
+        }
+    }
+
+    void _prepare_memory()
+    {
+        _for_each_buffer([](void* data, size_t size) { prefault_memory(data, size); });
+#ifdef ELKLOG_RT_LOCK_MEMORY
+        bool locked = true;
+        _for_each_buffer([&](void* data, size_t size) { locked = lock_memory(data, size) && locked; });
+        _memory_locked = locked;
+#endif
+    }
+
+    size_t _consume_traces()
+    {
+        size_t total = 0;
+        size_t count;
+        do
+        {
+            count = _trace_queue.pop_bulk(_trace_batch.data(), _trace_batch.size());
+            if (count > 0 && _trace_callback)
             {
-                _consumer_callback(message);
+                _trace_callback(_trace_batch.data(), count);
             }
-            std::this_thread::sleep_for(_sleep_period);
+            total += count;
+        } while (count == _trace_batch.size());
+        _trace_consumed.fetch_add(total, std::memory_order_release);
+        return total;
+    }
+
+    void _pass_on(const Message& message)
+    {
+        const Message* messages[] = {&message};
+        _consumer_callback(RtLogBatch<message_len>(messages, 1));
+    }
+
+    void _set_repeat_report(Message& report)
+    {
+        report.set_message(_last_message->level(), _repeat_timestamp,
+                           "Last message repeated {} times", _repeat_count);
+        report.set_thread_id(_last_message->thread_id());
+        _repeat_count = 0;
+    }
+
+    /**
+     * @brief Pass on the number of times the last message was repeated, if it was.
+     *        Called before a new message and periodically, so that a message that
+     *        keeps repeating is still reported.
+     */
+    void _report_repeats()
+    {
+        if (_repeat_count > 0)
+        {
+            _set_repeat_report(_repeat_message);
+            _pass_on(_repeat_message);
+        }
+    }
+
+    /**
+     * @brief Pass on a warning if messages were dropped since the last report
+     */
+    void _report_drops(uint64_t& reported_drops)
+    {
+        auto dropped = _stats.total_dropped();
+        if (dropped > reported_drops)
+        {
+            _drop_message.set_message(RtLogLevel::WARNING, twine::current_rt_time(),
+                                      "{} log messages dropped, queue full", dropped - reported_drops);
+            _pass_on(_drop_message);
+            reported_drops = dropped;
         }
     }
 
+#ifdef ELKLOG_RT_TELEMETRY
+    /**
+     * @brief In ns, 0 if the timestamp is in the future, i.e. from another clock domain
+     */
+    static uint64_t _elapsed_since(std::chrono::nanoseconds timestamp,
+                                   std::chrono::nanoseconds now = twine::current_rt_time())
+    {
+        return static_cast<uint64_t>(std::max<int64_t>((now - timestamp).count(), 0));
+    }
+
+    void _report_telemetry()
+    {
+        for_each_histogram(_telemetry.snapshot(), [&](const char* name, const HistogramSnapshot& histogram)
+        {
+            _drop_message.set_message(RtLogLevel::INFO, twine::current_rt_time(), "{}: {}", name, histogram.summary());
+            _pass_on(_drop_message);
+        });
+    }
+#endif
+
+    static constexpr auto RT_DROP_REPORT_PERIOD = std::chrono::seconds(1);
+    static constexpr auto BLOCKING_RETRY_PERIOD = std::chrono::microseconds(100);
+    static constexpr auto THREAD_CONFIG_TIMEOUT = std::chrono::milliseconds(1000);
+
     std::thread _consumer_thread;
     std::atomic<bool> _consumer_running {false};
     std::chrono::milliseconds _sleep_period;
+    std::chrono::milliseconds _max_idle_period;
+    RtConsumerPool* _consumer_pool;
+    RtConsumerPool::Registration _registration;
+
+    // Applied by the consumer thread on its next pass
+    std::mutex _thread_config_lock;
+    ThreadConfig _thread_config;
+    std::promise<Status> _thread_config_status;
+    std::atomic<bool> _thread_config_pending {false};
+
+    // Signals the consumer thread, or the pool worker that consumes the queues
+    RtSignal _wakeup;
+    RtSignal* _wakeup_signal {&_wakeup};
+    int _wakeup_threshold;
+    bool _format_deferred;
+    bool _collapse_repeated;
+    std::atomic<uint64_t> _pushed_at_last_drain {0};
+    LogStatsCounters _stats;
+#ifdef ELKLOG_RT_TELEMETRY
+    LogTelemetryCounters _telemetry;
+    std::atomic<std::chrono::milliseconds> _telemetry_report_period {std::chrono::milliseconds(0)};
+    std::chrono::steady_clock::time_point _last_telemetry_report;
+#endif
 
-    SpinLock _lock;
+    RtLogQueue<message_len, fifo_size> _queue;
+    ErrorQueue _error_queue {};
+    TraceQueue _trace_queue {};
 
-    memory_relaxed_aquire_release::CircularFifo<RtLogMessage<message_len>, fifo_size> _queue;
+    BatchCallback _consumer_callback;
+    TraceCallback _trace_callback;
+    Message _drop_message;
 
-    std::function<void(const RtLogMessage<message_len>& msg)> _consumer_callback;
+    // Only used by the consumer thread
+    ConsumerBatch _batch;
+    ConsumerBatch _error_batch;
+    std::chrono::steady_clock::time_point _last_drop_report;
+    uint64_t _reported_drops {0};
+    std::vector<Message*> _output;
+    std::vector<TraceEvent> _trace_batch;
+    std::atomic<uint64_t> _trace_consumed {0};
 
-    RtLogLevel _min_log_level;
+    // _repeat_count is -1 before the first message
+    Message* _last_message {nullptr};
+    Message* _free_slot {nullptr};
+    Message _last_message_copy;
+    Message _repeat_message;
+    int _repeat_count {-1};
+    std::chrono::nanoseconds _repeat_timestamp {0};
+
+    std::atomic<RtLogLevel> _min_log_level {RtLogLevel::INFO};
+    std::atomic<FieldEncoding> _field_encoding {FieldEncoding::TEXT};
+    bool _memory_locked {false};
 };
 
 } // namespace elklog
@@ -158,37 +1124,144 @@ private:
 
 namespace elklog {
 
-template<size_t message_len, size_t fifo_size>
+template<size_t message_len, size_t fifo_size, size_t error_fifo_size = 0, size_t trace_fifo_size = 0>
 class RtLogger
 {
 public:
-    RtLogger(int /*consumer_poll_period_ms*/,
-             std::function<void(const RtLogMessage<message_len>& msg)> /*consumer_callback*/,
-             const std::string& /*min_log_level*/)
+    using MessageCallback = std::function<void(const RtLogMessage<message_len>& msg)>;
+    using BatchCallback = std::function<void(const RtLogBatch<message_len>& batch)>;
+    using TraceCallback = std::function<void(const TraceEvent* events, size_t count)>;
+
+    static constexpr size_t CONSUMER_BATCH_SIZE = 32;
+
+    RtLogger(std::chrono::milliseconds /*consumer_poll_period*/,
+             BatchCallback /*consumer_callback*/,
+             const std::string& /*min_log_level*/,
+             int /*wakeup_threshold*/ = 0,
+             std::chrono::milliseconds /*max_idle_period*/ = std::chrono::milliseconds(0),
+             bool /*format_deferred*/ = true,
+             bool /*collapse_repeated*/ = false,
+             TraceCallback /*trace_callback*/ = nullptr,
+             RtConsumerPool* /*consumer_pool*/ = nullptr)
+    {}
+
+    RtLogger(std::chrono::milliseconds /*consumer_poll_period*/,
+             MessageCallback /*consumer_callback*/,
+             const std::string& /*min_log_level*/,
+             int /*wakeup_threshold*/ = 0,
+             std::chrono::milliseconds /*max_idle_period*/ = std::chrono::milliseconds(0),
+             bool /*format_deferred*/ = true,
+             bool /*collapse_repeated*/ = false,
+             TraceCallback /*trace_callback*/ = nullptr,
+             RtConsumerPool* /*consumer_pool*/ = nullptr)
     {}
 
     virtual ~RtLogger() = default;
 
-    template<RtLogLevel level, typename... Args>
-    void log(const char* /*format_str*/, Args&&... /*args*/)
+    template<RtLogLevel level, typename Format, typename... Args>
+    void log(const Format& /*format_str*/, Args&&... /*args*/)
     {}
 
-    template<typename... Args>
-    void log_debug(const char* /*format_str*/, Args&&... /*args*/)
+    void count_dropped(RtLogLevel /*level*/)
     {}
 
-    template<typename... Args>
-    void log_info(const char* /*format_str*/, Args&&... /*args*/)
+    struct ThreadBinding {};
+
+    ThreadBinding bind_thread()
+    {
+        return {};
+    }
+
+    template<RtLogLevel level, typename Format, typename... Args>
+    void log_bound(const ThreadBinding& /*binding*/, const Format& /*format_str*/, Args&&... /*args*/)
     {}
 
-    template<typename... Args>
-    void log_warning(const char* /*format_str*/, Args&&... /*args*/)
+    template<RtLogLevel level, typename Format, typename... Args>
+    void log_blocking(const Format& /*format_str*/, Args&&... /*args*/)
     {}
 
-    template<typename... Args>
-    void log_error(const char* /*format_str*/, Args&&... /*args*/)
+    bool drain(std::chrono::milliseconds /*timeout*/)
+    {
+        return true;
+    }
+
+    template<typename Format, typename... Args>
+    void log_debug(const Format& /*format_str*/, Args&&... /*args*/)
+    {}
+
+    template<typename Format, typename... Args>
+    void log_info(const Format& /*format_str*/, Args&&... /*args*/)
+    {}
+
+    template<typename Format, typename... Args>
+    void log_warning(const Format& /*format_str*/, Args&&... /*args*/)
+    {}
+
+    template<typename Format, typename... Args>
+    void log_error(const Format& /*format_str*/, Args&&... /*args*/)
+    {}
+
+    template<typename Name>
+    void trace_begin(const Name& /*name*/)
+    {}
+
+    template<typename Name>
+    void trace_end(const Name& /*name*/)
+    {}
+
+    template<typename Name>
+    void trace_instant(const Name& /*name*/)
     {}
 
+    template<typename Name>
+    void trace_counter(const Name& /*name*/, int64_t /*value*/)
+    {}
+
+    template<typename Name>
+    TraceScope<RtLogger> trace_scope(const Name& /*name*/)
+    {
+        return TraceScope<RtLogger>(*this, NO_FORMAT_ID);
+    }
+
+    void trace_event(TraceEventType /*type*/, uint32_t /*name_id*/, int64_t /*value*/ = 0)
+    {}
+
+    void set_min_log_level(RtLogLevel /*level*/)
+    {}
+
+    void set_field_encoding(FieldEncoding /*encoding*/)
+    {}
+
+    RtLogLevel min_log_level() const
+    {
+        return RtLogLevel::INFO;
+    }
+
+    Status set_consumer_thread_config(const ThreadConfig& /*config*/)
+    {
+        return Status::OK;
+    }
+
+    bool memory_locked() const
+    {
+        return false;
+    }
+
+    LogStats stats() const
+    {
+        return {};
+    }
+
+    LogTelemetry telemetry() const
+    {
+        return {};
+    }
+
+    void reset_telemetry()
+    {}
+
+    void set_telemetry_report_period(std::chrono::milliseconds /*period*/)
+    {}
 };
 
 } // namespace elklog
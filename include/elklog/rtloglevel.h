@@ -23,6 +23,27 @@
 
 #include <ostream>
 
+/* Numeric levels for preprocessor checks, with the values of RtLogLevel */
+#define ELKLOG_LEVEL_OFF        -1
+#define ELKLOG_LEVEL_ERROR      0
+#define ELKLOG_LEVEL_WARNING    1
+#define ELKLOG_LEVEL_INFO       2
+#define ELKLOG_LEVEL_DEBUG      3
+
+/* Log calls through the ELKLOG_LOG_* macros below this level are compiled out */
+#ifndef ELKLOG_ACTIVE_LEVEL
+#define ELKLOG_ACTIVE_LEVEL ELKLOG_LEVEL_DEBUG
+#endif
+
+/* Branch hints for the runtime level checks */
+#if defined(__GNUC__) || defined(__clang__)
+#define ELKLOG_LIKELY(x)    __builtin_expect(!!(x), 1)
+#define ELKLOG_UNLIKELY(x)  __builtin_expect(!!(x), 0)
+#else
+#define ELKLOG_LIKELY(x)    (x)
+#define ELKLOG_UNLIKELY(x)  (x)
+#endif
+
 namespace elklog {
 
 enum class RtLogLevel : int
@@ -33,6 +54,9 @@ enum class RtLogLevel : int
     DEBUG
 };
 
+static_assert(static_cast<int>(RtLogLevel::ERROR) == ELKLOG_LEVEL_ERROR &&
+              static_cast<int>(RtLogLevel::DEBUG) == ELKLOG_LEVEL_DEBUG, "Level values must match ELKLOG_LEVEL_*");
+
 inline std::ostream& operator << (std::ostream& o, const RtLogLevel& l)
 {
     switch (l)
@@ -23,14 +23,23 @@
 
 #include <chrono>
 #include <ostream>
+#include <algorithm>
 #include <array>
 #include <cstring>
 #include <cassert>
+#include <cstddef>
+#include <tuple>
+#include <type_traits>
+#include <utility>
 
 #include <spdlog/fmt/bundled/format.h>
 #include <spdlog/fmt/bundled/chrono.h>
 
 #include "rtloglevel.h"
+#include "binary_format.h"
+#include "format_string.h"
+#include "structured.h"
+#include "log_args.h"
 
 namespace elklog {
 
@@ -41,8 +50,8 @@ public:
 
     RtLogMessage() :
         _level(RtLogLevel::INFO),
-        _timestamp(std::chrono::nanoseconds(0)),
-        _length(0)
+        _length(0),
+        _timestamp(std::chrono::nanoseconds(0))
     {
         _buffer[0] = '\0';
     }
@@ -58,6 +67,11 @@ public:
         _level = rhs._level;
         _timestamp = rhs._timestamp;
         _length = rhs._length;
+        _format_id = rhs._format_id;
+        _thread_id = rhs._thread_id;
+        _format_str = rhs._format_str;
+        _formatter = rhs._formatter;
+        _arg_types = rhs._arg_types;
 
         std::copy(rhs._buffer.begin(), rhs._buffer.begin() + rhs._length + 1, _buffer.begin());
         return *this;
@@ -65,6 +79,8 @@ public:
 
     /*
     * @brief Returns a null-terminated string with a formatted message.
+    *        Only valid once a deferred message has been formatted with
+    *        format_deferred().
     */
     const char* message() const
     {
@@ -82,7 +98,21 @@ public:
     }
 
     /*
-     * @brief Returns the length of the formatted message excluding null termination
+     * @brief Returns the id of the thread that logged the message, or 0 if not set
+     */
+    uint32_t thread_id() const
+    {
+        return _thread_id;
+    }
+
+    void set_thread_id(uint32_t thread_id)
+    {
+        _thread_id = thread_id;
+    }
+
+    /*
+     * @brief Returns the length of the formatted message excluding null termination,
+     *        or the size of the packed arguments if the message is still deferred.
      */
     size_t length() const
     {
@@ -90,25 +120,345 @@ public:
     }
 
     /**
-     * @brief Set the log message string with formatting
+     * @brief Returns the number of bytes, counted from the start of the object,
+     *        that hold valid data. Messages can be stored truncated to this
+     *        size in variable-length queues and read back with operator=.
      */
-    template<typename... Args>
+    size_t storage_size() const
+    {
+        return offsetof(RtLogMessage, _buffer) + _length + 1;
+    }
+
+    /**
+     * @brief Set the log message string with formatting. format_str is either
+     *        a plain string or a static format created with ELKLOG_FORMAT.
+     *        Spans, hex dumps and string_views are truncated to what can fit
+     *        in the buffer before they are formatted, see log_args.h.
+     */
+    template<typename Format, typename... Args>
     void set_message(RtLogLevel level, std::chrono::nanoseconds timestamp,
-                     const char* format_str, Args&&... args)
+                     const Format& format_str, Args&&... args)
     {
         _level = level;
         _timestamp = timestamp;
-        auto end = fmt::format_to_n(_buffer.data(), buffer_len - 1, format_str, args...);
+        auto end = fmt::format_to_n(_buffer.data(), buffer_len - 1, fmt_format(format_str),
+                                    capture_arg<buffer_len>(args)...);
 
         // Add null-termination character
         *end.out = '\0';
         _length = std::distance(_buffer.data(), end.out);
+        _format_id = NO_FORMAT_ID;
+        _format_str = nullptr;
+        _formatter = nullptr;
+    }
+
+    /**
+     * @brief Returns true if all argument types can be captured by
+     *        set_deferred_message(), i.e. they are arithmetic or enum
+     *        values that can be safely copied byte by byte, or
+     *        string_views, and that fit in the message buffer with
+     *        room left for the null-termination of the formatted message.
+     */
+    template<typename... Args>
+    static constexpr bool is_deferrable()
+    {
+        return ((binary::numeric_arg_type<std::decay_t<Args>>() != binary::ArgType::NONE ||
+                 std::is_same_v<std::decay_t<Args>, std::string_view>) && ...) &&
+               (0 + ... + _packed_arg_size<std::decay_t<Args>>()) < buffer_len;
+    }
+
+    /**
+     * @brief Store the arguments unformatted, to be formatted later by
+     *        calling format_deferred(), typically from a non-rt thread.
+     *        format_str is stored as a pointer and must outlive the
+     *        message, which is normally the case for string literals.
+     *        If format_str is a static format, its id is stored too.
+     *        The content of string_views is copied, truncated to fit in
+     *        the buffer, as a length followed by the characters.
+     */
+    template<typename Format, typename... Args>
+    void set_deferred_message(RtLogLevel level, std::chrono::nanoseconds timestamp,
+                              const Format& format_str, Args&&... args)
+    {
+        static_assert(is_deferrable<Args...>(), "Argument types can not be deferred");
+        _level = level;
+        _timestamp = timestamp;
+        _format_id = elklog::format_id(format_str);
+        _format_str = format_c_str(format_str);
+        _formatter = &_format_packed<PackedFormat<Format>, std::decay_t<Args>...>;
+        _arg_types = binary::ArgTypes<std::decay_t<Args>...>::value;
+
+        // Room left for the content of strings, the last byte is kept free
+        // as operator= and storage_size() include it as null-termination
+        [[maybe_unused]] size_t available = buffer_len - 1 - (0 + ... + _packed_arg_size<std::decay_t<Args>>());
+        size_t offset = 0;
+        (_pack_arg(offset, available, args), ...);
+        _length = offset;
+    }
+
+    /**
+     * @brief Store a plain message with fields created with kv(), packed as
+     *        binary data to be encoded later by format_deferred(). Keys and
+     *        numeric values are always stored, string values are truncated
+     *        to fit in the buffer. message is stored as a pointer like the
+     *        format string of set_deferred_message().
+     */
+    template<typename Format, typename... Fields>
+    void set_structured_message(RtLogLevel level, std::chrono::nanoseconds timestamp,
+                                const Format& message, const Fields&... fields)
+    {
+        static_assert((0 + ... + _packed_size<typename Fields::value_type>()) < buffer_len, "Fields do not fit in the message");
+        _level = level;
+        _timestamp = timestamp;
+        _format_id = elklog::format_id(message);
+        _format_str = format_c_str(message);
+        _formatter = &_encode_packed<typename Fields::value_type...>;
+        _arg_types = nullptr;
+
+        // Room left for the content of string values, minus the last byte
+        // as in set_deferred_message()
+        size_t available = buffer_len - 1 - (0 + ... + _packed_size<typename Fields::value_type>());
+        size_t offset = 0;
+        (_pack_field(offset, available, fields), ...);
+        _length = offset;
+    }
+
+    /**
+     * @brief Returns true if the message holds unformatted arguments or fields
+     */
+    bool is_deferred() const
+    {
+        return _formatter != nullptr;
+    }
+
+    /**
+     * @brief Returns true if the message holds fields set with
+     *        set_structured_message() that are not yet encoded
+     */
+    bool is_structured() const
+    {
+        return _formatter != nullptr && _arg_types == nullptr;
+    }
+
+    /**
+     * @brief Accessors for the unformatted content of a deferred message.
+     *        The arguments are packed back to back in native byte order,
+     *        arg_types() returns a list of their types terminated by
+     *        binary::ArgType::NONE.
+     */
+    const char* format_str() const
+    {
+        return _format_str;
+    }
+
+    /**
+     * @brief Returns the static id of the format string, or NO_FORMAT_ID if
+     *        the message was not logged with a static format
+     */
+    uint32_t format_id() const
+    {
+        return _format_id;
+    }
+
+    const binary::ArgType* arg_types() const
+    {
+        return _arg_types;
+    }
+
+    const char* packed_args() const
+    {
+        return _buffer.data();
+    }
+
+    /**
+     * @brief Returns true if other has the same level and content, compared in
+     *        whichever form the messages are in, formatted or deferred.
+     *        Timestamps and thread ids are not compared.
+     */
+    bool has_same_content(const RtLogMessage& other) const
+    {
+        return _level == other._level &&
+               _length == other._length &&
+               _format_str == other._format_str &&
+               _formatter == other._formatter &&
+               std::memcmp(_buffer.data(), other._buffer.data(), _length) == 0;
+    }
+
+    /**
+     * @brief Format a message stored with set_deferred_message(), or encode
+     *        the fields of one stored with set_structured_message(). After
+     *        this call message() returns the formatted string. Does nothing
+     *        if the message was not deferred.
+     */
+    void format_deferred(FieldEncoding encoding = FieldEncoding::TEXT)
+    {
+        if (_formatter == nullptr)
+        {
+            return;
+        }
+        _length = _formatter(_format_str, _buffer.data(), encoding);
+        _format_id = NO_FORMAT_ID;
+        _format_str = nullptr;
+        _formatter = nullptr;
     }
 
 private:
+    using Formatter = int(*)(const char* format_str, char* buffer, FieldEncoding encoding);
+
+    // Static formats are formatted with their compiled format, all plain strings share one formatter
+    template<typename Format>
+    using PackedFormat = std::conditional_t<is_static_format_v<Format>, std::decay_t<Format>, const char*>;
+
+    template<typename T>
+    static T _read_arg(const char* data)
+    {
+        T value;
+        std::memcpy(&value, data, sizeof(T));
+        return value;
+    }
+
+    // Strings as a length and their content, in the layout of binary logs
+    template<typename T>
+    static constexpr size_t _packed_arg_size()
+    {
+        return std::is_same_v<T, std::string_view> ? sizeof(uint32_t) : sizeof(T);
+    }
+
+    template<typename T>
+    void _pack_arg(size_t& offset, size_t& available, const T& arg)
+    {
+        if constexpr (std::is_same_v<std::decay_t<T>, std::string_view>)
+        {
+            auto length = static_cast<uint32_t>(std::min(arg.size(), available));
+            available -= length;
+            std::memcpy(_buffer.data() + offset, &length, sizeof(length));
+            std::memcpy(_buffer.data() + offset + sizeof(length), arg.data(), length);
+            offset += sizeof(length) + length;
+        }
+        else
+        {
+            std::memcpy(_buffer.data() + offset, &arg, sizeof(arg));
+            offset += sizeof(arg);
+        }
+    }
+
+    template<typename T>
+    static T _unpack_arg(const char* data, size_t& offset)
+    {
+        if constexpr (std::is_same_v<T, std::string_view>)
+        {
+            auto length = _read_arg<uint32_t>(data + offset);
+            offset += sizeof(length) + length;
+            return std::string_view(data + offset - length, length);
+        }
+        else
+        {
+            offset += sizeof(T);
+            return _read_arg<T>(data + offset - sizeof(T));
+        }
+    }
+
+    template<typename Format, typename... Args>
+    static int _format_packed([[maybe_unused]] const char* format_str, char* buffer, FieldEncoding /*encoding*/)
+    {
+        // Unpack to locals first as the output overwrites the arguments, and
+        // copy the content of strings as they refer to the packed arguments
+        std::array<char, buffer_len> strings;
+        [[maybe_unused]] const char* data = buffer;
+        if constexpr ((std::is_same_v<Args, std::string_view> || ...))
+        {
+            std::memcpy(strings.data(), buffer, buffer_len);
+            data = strings.data();
+        }
+        [[maybe_unused]] size_t offset = 0;
+        // Braced initialization unpacks the arguments in order
+        std::tuple<Args...> args {_unpack_arg<Args>(data, offset)...};
+        auto end = std::apply([&](auto&... values)
+        {
+            if constexpr (is_static_format_v<Format>)
+            {
+                return fmt::format_to_n(buffer, buffer_len - 1, Format::compiled(), values...);
+            }
+            else
+            {
+                return fmt::format_to_n(buffer, buffer_len - 1, format_str, values...);
+            }
+        }, args);
+
+        *end.out = '\0';
+        return std::distance(buffer, end.out);
+    }
+
+    // A key pointer followed by the value, strings as a length and their content
+    template<typename T>
+    static constexpr size_t _packed_size()
+    {
+        return sizeof(const char*) + (std::is_same_v<T, std::string_view> ? sizeof(uint32_t) : sizeof(T));
+    }
+
+    template<typename T>
+    void _pack_field(size_t& offset, size_t& available, const Field<T>& field)
+    {
+        std::memcpy(_buffer.data() + offset, &field.key, sizeof(field.key));
+        offset += sizeof(field.key);
+        if constexpr (std::is_same_v<T, std::string_view>)
+        {
+            auto length = static_cast<uint32_t>(std::min(field.value.size(), available));
+            available -= length;
+            std::memcpy(_buffer.data() + offset, &length, sizeof(length));
+            std::memcpy(_buffer.data() + offset + sizeof(length), field.value.data(), length);
+            offset += sizeof(length) + length;
+        }
+        else
+        {
+            std::memcpy(_buffer.data() + offset, &field.value, sizeof(T));
+            offset += sizeof(T);
+        }
+    }
+
+    template<typename T, typename Encoder>
+    static void _unpack_field(const char* data, size_t& offset, Encoder& encoder)
+    {
+        auto key = _read_arg<const char*>(data + offset);
+        offset += sizeof(key);
+        if constexpr (std::is_same_v<T, std::string_view>)
+        {
+            auto length = _read_arg<uint32_t>(data + offset);
+            encoder.field(key, std::string_view(data + offset + sizeof(length), length));
+            offset += sizeof(length) + length;
+        }
+        else
+        {
+            encoder.field(key, _read_arg<T>(data + offset));
+            offset += sizeof(T);
+        }
+    }
+
+    template<typename... Types>
+    static int _encode_packed(const char* message, char* buffer, FieldEncoding encoding)
+    {
+        // Encoded to a separate buffer first as the output overwrites the fields
+        fmt::basic_memory_buffer<char, buffer_len> out;
+        FieldEncoder encoder(out, encoding, message);
+        size_t offset = 0;
+        (_unpack_field<Types>(buffer, offset, encoder), ...);
+        encoder.end();
+
+        size_t length = std::min(out.size(), buffer_len - 1);
+        std::memcpy(buffer, out.data(), length);
+        buffer[length] = '\0';
+        return static_cast<int>(length);
+    }
+
+    // Ordered to keep the header part small when stored with storage_size()
     RtLogLevel _level;
-    std::chrono::nanoseconds _timestamp;
     int  _length;
+    uint32_t _format_id {NO_FORMAT_ID};
+    uint32_t _thread_id {0};
+    std::chrono::nanoseconds _timestamp;
+    const char* _format_str {nullptr};
+    Formatter _formatter {nullptr};
+    const binary::ArgType* _arg_types {nullptr};
     std::array<char, buffer_len> _buffer;
 };
 
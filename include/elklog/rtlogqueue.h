@@ -0,0 +1,521 @@
+/*
+ * Copyright 2020-2023 Elk Audio AB
+ * ElkLog is free software: you can redistribute it and/or modify it under the terms
+ * of the GNU General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * Twine is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with Twine.
+ * If not, see http://www.gnu.org/licenses/ .
+ */
+
+/**
+ * @brief Queue backends used by RtLogger to pass messages from rt threads
+ *        to the consumer thread.
+ *
+ *        All backends have the same interface, write() is called from rt
+ *        threads with a function that sets the message in place, and peek()
+ *        and release() are called from the consumer thread to read messages
+ *        in place. pop_bulk() copies out up to a given number of messages at
+ *        once, so that a burst of messages can be handed over with a single
+ *        update of the fifo index where the backend allows it. The Fifo type
+ *        used for storage must provide the zero-copy try_reserve()/commit()/
+ *        peek()/release() interface of CircularFifo, and pop_bulk().
+ *        for_each_buffer() calls a function with every buffer the queue has
+ *        allocated outside of itself, so that they can be prefaulted.
+ *        bind_thread() returns a ThreadBinding that resolves once what
+ *        write() otherwise looks up for the calling thread on every call,
+ *        and can be passed to write() from the same thread.
+ *
+ * @copyright Copyright 2020-2023 Elk Audio AB, Stockholm
+ */
+
+#ifndef ELKLOG_RTLOGQUEUE_H
+#define ELKLOG_RTLOGQUEUE_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "spinlock.h"
+
+namespace elklog {
+
+/**
+ * @brief Commit the message reserved in fifo, also for fifos where commit()
+ *        returns false if the message was dropped
+ */
+template<typename Fifo>
+bool commit_reserved(Fifo& fifo)
+{
+    if constexpr (std::is_void_v<decltype(fifo.commit())>)
+    {
+        fifo.commit();
+        return true;
+    }
+    else
+    {
+        return fifo.commit();
+    }
+}
+
+/**
+ * @brief Single fifo guarded by a SpinLock. The lock is a no-op unless
+ *        ELKLOG_MULTI_THREADED_RT_LOGGING is defined.
+ */
+template<typename Message, typename Fifo>
+class LockedRtLogQueue
+{
+public:
+    /**
+     * @brief Set a message in place in the queue.
+     * @param set_message Callable taking a Message& as argument
+     * @return false if the queue was full and the message dropped
+     */
+    template<typename Setter>
+    bool write(Setter&& set_message)
+    {
+        _lock.lock();
+        auto message = _fifo.try_reserve();
+        bool written = false;
+        if (message)
+        {
+            set_message(*message);
+            written = commit_reserved(_fifo);
+        }
+        _lock.unlock();
+        return written;
+    }
+
+    struct ThreadBinding {};
+
+    ThreadBinding bind_thread()
+    {
+        return {};
+    }
+
+    template<typename Setter>
+    bool write(const ThreadBinding& /*binding*/, Setter&& set_message)
+    {
+        return write(set_message);
+    }
+
+    Message* peek()
+    {
+        return _fifo.peek();
+    }
+
+    void release()
+    {
+        _fifo.release();
+    }
+
+    size_t pop_bulk(Message* items, size_t max_count)
+    {
+        return _fifo.pop_bulk(items, max_count);
+    }
+
+    template<typename Function>
+    void for_each_buffer(Function&& /*function*/)
+    {}
+
+private:
+    SpinLock _lock;
+    Fifo _fifo;
+};
+
+/**
+ * @brief One wait-free fifo per rt thread, so that producers never wait on
+ *        each other. A thread claims a fifo the first time it logs, or when
+ *        calling register_thread(), and keeps it until unregister_thread()
+ *        is called, the thread exits or the queue is destroyed. If more
+ *        than max_threads are logging, the remaining threads share an extra
+ *        fifo guarded by a SpinLock. The consumer merges messages from all
+ *        fifos in timestamp order.
+ */
+template<typename Message, typename Fifo, size_t max_threads>
+class PerThreadRtLogQueue
+{
+public:
+    PerThreadRtLogQueue() : _id(_next_id().fetch_add(1) + 1)
+    {
+        for (auto& fifo : _fifos)
+        {
+            fifo = std::make_unique<Fifo>();
+        }
+        for (auto& owner : _owners)
+        {
+            owner.store(std::thread::id(), std::memory_order_relaxed);
+        }
+        std::scoped_lock lock(_registry_lock());
+        _registry().push_back(this);
+    }
+
+    ~PerThreadRtLogQueue()
+    {
+        std::scoped_lock lock(_registry_lock());
+        auto& registry = _registry();
+        registry.erase(std::find(registry.begin(), registry.end(), this));
+    }
+
+    template<typename Setter>
+    bool write(Setter&& set_message)
+    {
+        return write(bind_thread(), set_message);
+    }
+
+    struct ThreadBinding
+    {
+        int index {SHARED_FIFO};
+    };
+
+    /**
+     * @brief Claims a fifo for the calling thread if it has none, like register_thread()
+     */
+    ThreadBinding bind_thread()
+    {
+        return {_thread_index()};
+    }
+
+    template<typename Setter>
+    bool write(const ThreadBinding& binding, Setter&& set_message)
+    {
+        if (binding.index == SHARED_FIFO)
+        {
+            _shared_lock.lock();
+            bool res = _write_to(*_fifos[SHARED_FIFO], set_message);
+            _shared_lock.unlock();
+            return res;
+        }
+        return _write_to(*_fifos[binding.index], set_message);
+    }
+
+    /**
+     * @brief Returns the oldest message from all the fifos
+     */
+    Message* peek()
+    {
+        Message* oldest = nullptr;
+        for (size_t i = 0; i < _fifos.size(); ++i)
+        {
+            auto message = _fifos[i]->peek();
+            if (message && (oldest == nullptr || message->timestamp() < oldest->timestamp()))
+            {
+                oldest = message;
+                _peeked_fifo = i;
+            }
+        }
+        return oldest;
+    }
+
+    void release()
+    {
+        _fifos[_peeked_fifo]->release();
+    }
+
+    /**
+     * @brief Pop up to max_count messages in timestamp order. As messages are
+     *        merged from several fifos, each message is released separately.
+     */
+    size_t pop_bulk(Message* items, size_t max_count)
+    {
+        size_t count = 0;
+        while (count < max_count)
+        {
+            auto message = peek();
+            if (message == nullptr)
+            {
+                break;
+            }
+            items[count++] = *message;
+            release();
+        }
+        return count;
+    }
+
+    template<typename Function>
+    void for_each_buffer(Function&& function)
+    {
+        for (auto& fifo : _fifos)
+        {
+            function(static_cast<void*>(fifo.get()), sizeof(Fifo));
+        }
+    }
+
+    /**
+     * @brief Claim a fifo for the calling thread. Optional, but avoids doing
+     *        it on the thread's first call to write().
+     * @return false if no fifo was free and the thread will use the shared fifo
+     */
+    bool register_thread()
+    {
+        return _thread_index() != SHARED_FIFO;
+    }
+
+    /**
+     * @brief Return the calling thread's fifo so it can be used by other threads.
+     *        The thread must not log to this queue after calling this.
+     */
+    void unregister_thread()
+    {
+        for (auto& entry : _thread_cache)
+        {
+            if (entry.queue_id == _id)
+            {
+                entry.queue_id = 0;
+            }
+        }
+        _release(std::this_thread::get_id());
+    }
+
+private:
+    static constexpr int SHARED_FIFO = max_threads;
+    static constexpr int THREAD_CACHE_SIZE = 4;
+
+    struct ThreadCacheEntry
+    {
+        uint64_t queue_id {0};
+        int index {0};
+    };
+
+    // Releases the fifos claimed by a thread in every queue when it exits
+    struct ThreadExitGuard
+    {
+        bool has_claims {false};
+
+        ~ThreadExitGuard()
+        {
+            if (has_claims)
+            {
+                std::scoped_lock lock(_registry_lock());
+                for (auto queue : _registry())
+                {
+                    queue->_release(std::this_thread::get_id());
+                }
+            }
+        }
+    };
+
+    template<typename Setter>
+    static bool _write_to(Fifo& fifo, Setter& set_message)
+    {
+        auto message = fifo.try_reserve();
+        if (message == nullptr)
+        {
+            return false;
+        }
+        set_message(*message);
+        return commit_reserved(fifo);
+    }
+
+    /**
+     * @brief Lookup the calling thread's fifo, or claim a new one. The cache
+     *        only holds the last few queues used, on a miss the thread's
+     *        claim is looked up from the owners of the fifos before claiming
+     *        a new one. Queues are identified by an id that is never reused,
+     *        so stale entries from destroyed queues are harmless.
+     */
+    int _thread_index()
+    {
+        for (const auto& entry : _thread_cache)
+        {
+            if (entry.queue_id == _id)
+            {
+                return entry.index;
+            }
+        }
+
+        auto thread = std::this_thread::get_id();
+        int index = SHARED_FIFO;
+        for (size_t i = 0; i < max_threads; ++i)
+        {
+            if (_owners[i].load(std::memory_order_acquire) == thread)
+            {
+                index = i;
+                break;
+            }
+        }
+        for (size_t i = 0; i < max_threads && index == SHARED_FIFO; ++i)
+        {
+            auto expected = std::thread::id();
+            if (_owners[i].compare_exchange_strong(expected, thread, std::memory_order_acq_rel))
+            {
+                index = i;
+                _thread_exit_guard.has_claims = true;
+            }
+        }
+
+        auto& entry = _thread_cache[_thread_cache_next++ % THREAD_CACHE_SIZE];
+        entry.queue_id = _id;
+        entry.index = index;
+        return index;
+    }
+
+    void _release(std::thread::id thread)
+    {
+        for (auto& owner : _owners)
+        {
+            auto expected = thread;
+            owner.compare_exchange_strong(expected, std::thread::id(), std::memory_order_acq_rel);
+        }
+    }
+
+    static std::atomic<uint64_t>& _next_id()
+    {
+        static std::atomic<uint64_t> id {0};
+        return id;
+    }
+
+    // All live queues, for releasing the claims of exiting threads
+    static std::vector<PerThreadRtLogQueue*>& _registry()
+    {
+        static std::vector<PerThreadRtLogQueue*> registry;
+        return registry;
+    }
+
+    static std::mutex& _registry_lock()
+    {
+        static std::mutex lock;
+        return lock;
+    }
+
+    static inline thread_local std::array<ThreadCacheEntry, THREAD_CACHE_SIZE> _thread_cache;
+    static inline thread_local int _thread_cache_next {0};
+    static inline thread_local ThreadExitGuard _thread_exit_guard;
+
+    const uint64_t _id;
+    std::array<std::atomic<std::thread::id>, max_threads> _owners;
+    std::array<std::unique_ptr<Fifo>, max_threads + 1> _fifos;
+    SpinLock _shared_lock;
+    size_t _peeked_fifo {0};
+};
+
+/**
+ * @brief Bounded lock-free multi-producer, single-consumer queue, based on
+ *        Dmitry Vyukov's sequence-numbered ring. Producers claim a cell with
+ *        a compare-and-swap and never wait for each other, a producer
+ *        that is preempted while setting its message can only delay the
+ *        consumer, not other producers. Cells are padded to separate cache
+ *        lines. size must be a power of 2.
+ */
+template<typename Message, size_t size>
+class MpscRtLogQueue
+{
+public:
+    static_assert(size >= 2 && (size & (size - 1)) == 0, "Queue size must be a power of 2");
+
+    MpscRtLogQueue()
+    {
+        for (size_t i = 0; i < size; ++i)
+        {
+            _cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    template<typename Setter>
+    bool write(Setter&& set_message)
+    {
+        Cell* cell;
+        size_t pos = _enqueue_pos.load(std::memory_order_relaxed);
+        while (true)
+        {
+            cell = &_cells[pos & MASK];
+            size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            auto diff = static_cast<std::intptr_t>(sequence) - static_cast<std::intptr_t>(pos);
+            if (diff == 0)
+            {
+                if (_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    break;
+                }
+            }
+            else if (diff < 0)
+            {
+                return false; // full queue
+            }
+            else
+            {
+                // Another producer claimed the cell, try the next one
+                pos = _enqueue_pos.load(std::memory_order_relaxed);
+            }
+        }
+        set_message(cell->message);
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    struct ThreadBinding {};
+
+    ThreadBinding bind_thread()
+    {
+        return {};
+    }
+
+    template<typename Setter>
+    bool write(const ThreadBinding& /*binding*/, Setter&& set_message)
+    {
+        return write(set_message);
+    }
+
+    Message* peek()
+    {
+        Cell& cell = _cells[_dequeue_pos & MASK];
+        if (cell.sequence.load(std::memory_order_acquire) != _dequeue_pos + 1)
+        {
+            return nullptr; // empty queue or the message is not yet set
+        }
+        return &cell.message;
+    }
+
+    void release()
+    {
+        _cells[_dequeue_pos & MASK].sequence.store(_dequeue_pos + size, std::memory_order_release);
+        _dequeue_pos++;
+    }
+
+    size_t pop_bulk(Message* items, size_t max_count)
+    {
+        size_t count = 0;
+        while (count < max_count)
+        {
+            auto message = peek();
+            if (message == nullptr)
+            {
+                break;
+            }
+            items[count++] = *message;
+            release();
+        }
+        return count;
+    }
+
+    template<typename Function>
+    void for_each_buffer(Function&& /*function*/)
+    {}
+
+private:
+    static constexpr size_t MASK = size - 1;
+
+    struct alignas(ASSUMED_CACHE_LINE_SIZE) Cell
+    {
+        std::atomic<size_t> sequence;
+        Message message;
+    };
+
+    alignas(ASSUMED_CACHE_LINE_SIZE) std::atomic<size_t> _enqueue_pos {0};
+    alignas(ASSUMED_CACHE_LINE_SIZE) size_t _dequeue_pos {0};
+    std::array<Cell, size> _cells;
+};
+
+} // namespace elklog
+
+#endif // ELKLOG_RTLOGQUEUE_H
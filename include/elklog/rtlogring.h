@@ -0,0 +1,352 @@
+/*
+ * Copyright 2020-2023 Elk Audio AB
+ * ElkLog is free software: you can redistribute it and/or modify it under the terms
+ * of the GNU General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * Twine is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with Twine.
+ * If not, see http://www.gnu.org/licenses/ .
+ */
+
+/**
+ * @brief Variable-length record ring buffer, wait free for 1 consumer/ 1 producer.
+ *
+ *        Records are stored as a small header followed by the payload and are
+ *        always contiguous in memory. If a record does not fit at the end of
+ *        the buffer, a wrap marker is written and the record is placed at the
+ *        start instead. Memory use is proportional to the actual record size.
+ *
+ * @copyright Copyright 2020-2023 Elk Audio AB, Stockholm
+ */
+
+#ifndef ELKLOG_RTLOGRING_H
+#define ELKLOG_RTLOGRING_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+
+#include "rtlogmessage.h"
+
+namespace elklog {
+
+template<size_t size_bytes>
+class RtByteRing
+{
+public:
+    static constexpr size_t ALIGNMENT = 8;
+
+    static_assert(size_bytes % ALIGNMENT == 0, "Ring size must be a multiple of 8 bytes");
+
+    RtByteRing() = default;
+
+    /**
+     * @brief Reserve space for a record of up to max_len bytes. Called from
+     *        the producer thread only.
+     * @return A pointer to the payload area or nullptr if there is not enough
+     *         space. The record is not visible to the consumer until commit()
+     *         is called.
+     */
+    void* try_reserve(size_t max_len)
+    {
+        const size_t needed = _record_size(max_len);
+        const size_t write_pos = _write.load(std::memory_order_relaxed);
+        const size_t read_pos = _read.load(std::memory_order_acquire);
+
+        _wrapped = false;
+        if (write_pos >= read_pos)
+        {
+            const size_t space_at_end = size_bytes - write_pos;
+            // Ending exactly at the buffer end is only allowed if that
+            // doesn't make the write index catch up with the read index
+            if (needed < space_at_end || (needed == space_at_end && read_pos != 0))
+            {
+                _reserved_pos = write_pos;
+            }
+            else if (needed < read_pos)
+            {
+                _reserved_pos = 0;
+                _wrapped = true;
+            }
+            else
+            {
+                return nullptr;
+            }
+        }
+        else if (needed < read_pos - write_pos)
+        {
+            _reserved_pos = write_pos;
+        }
+        else
+        {
+            return nullptr;
+        }
+        return _data + _reserved_pos + sizeof(Header);
+    }
+
+    /**
+     * @brief Make a previously reserved record visible to the consumer.
+     * @param len The actual length of the record, must be less or equal
+     *        to the length passed to try_reserve()
+     */
+    void commit(size_t len)
+    {
+        if (_wrapped)
+        {
+            const size_t write_pos = _write.load(std::memory_order_relaxed);
+            _header_at(write_pos)->size = WRAP_MARKER;
+        }
+        _header_at(_reserved_pos)->size = static_cast<uint32_t>(len);
+        _write.store(_advance(_reserved_pos, len), std::memory_order_release);
+    }
+
+    /**
+     * @brief Access the oldest record without removing it. Called from
+     *        the consumer thread only.
+     * @param len Set to the length of the record as passed to commit()
+     * @return A pointer to the record payload or nullptr if the ring is empty.
+     */
+    void* peek(size_t& len)
+    {
+        size_t read_pos = _read.load(std::memory_order_relaxed);
+        if (read_pos == _write.load(std::memory_order_acquire))
+        {
+            return nullptr;
+        }
+        if (_header_at(read_pos)->size == WRAP_MARKER)
+        {
+            read_pos = 0;
+        }
+        _peeked_pos = read_pos;
+        len = _header_at(read_pos)->size;
+        return _data + read_pos + sizeof(Header);
+    }
+
+    /**
+     * @brief Remove the record returned by the last call to peek()
+     */
+    void release()
+    {
+        size_t len = _header_at(_peeked_pos)->size;
+        _read.store(_advance(_peeked_pos, len), std::memory_order_release);
+    }
+
+    /**
+     * @brief Pass up to max_count records to function, called as
+     *        function(const void* data, size_t len), and remove them with a
+     *        single update of the read index. Called from the consumer only.
+     * @return The number of records consumed
+     */
+    template<typename Function>
+    size_t consume(size_t max_count, Function&& function)
+    {
+        size_t read_pos = _read.load(std::memory_order_relaxed);
+        const size_t write_pos = _write.load(std::memory_order_acquire);
+        size_t count = 0;
+        while (read_pos != write_pos && count < max_count)
+        {
+            if (_header_at(read_pos)->size == WRAP_MARKER)
+            {
+                read_pos = 0;
+            }
+            size_t len = _header_at(read_pos)->size;
+            function(static_cast<const void*>(_data + read_pos + sizeof(Header)), len);
+            read_pos = _advance(read_pos, len);
+            count++;
+        }
+        if (count > 0)
+        {
+            _read.store(read_pos, std::memory_order_release);
+        }
+        return count;
+    }
+
+    bool was_empty() const
+    {
+        return _read.load() == _write.load();
+    }
+
+    static constexpr size_t capacity()
+    {
+        return size_bytes;
+    }
+
+private:
+    struct Header
+    {
+        uint32_t size;
+        uint32_t padding;
+    };
+    static_assert(sizeof(Header) == ALIGNMENT);
+
+    static constexpr uint32_t WRAP_MARKER = UINT32_MAX;
+
+    static constexpr size_t _record_size(size_t len)
+    {
+        return (sizeof(Header) + len + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+    }
+
+    static size_t _advance(size_t pos, size_t len)
+    {
+        size_t new_pos = pos + _record_size(len);
+        if (new_pos >= size_bytes)
+        {
+            new_pos = 0;
+        }
+        return new_pos;
+    }
+
+    Header* _header_at(size_t pos)
+    {
+        return reinterpret_cast<Header*>(_data + pos);
+    }
+
+    std::atomic<size_t> _write {0};
+    size_t _reserved_pos {0};
+    bool _wrapped {false};
+
+    alignas(ALIGNMENT) char _data[size_bytes];
+
+    std::atomic<size_t> _read {0};
+    size_t _peeked_pos {0};
+};
+
+/**
+ * @brief Queue of RtLogMessages backed by an RtByteRing, where each message
+ *        only takes up as much space as its formatted text. Has the same
+ *        push()/pop() and try_reserve()/commit()/peek()/release() interface
+ *        as CircularFifo so it can be used in its place, except that commit()
+ *        returns false if the message was dropped.
+ *
+ *        Messages are set in place when there is contiguous space for one of
+ *        max length. When there is less, they are set in a message kept
+ *        outside of the ring and copied in with their actual size by commit(),
+ *        so that short messages still fit.
+ */
+template<size_t message_len, size_t size_bytes>
+class RtLogMessageRing
+{
+public:
+    using Message = RtLogMessage<message_len>;
+
+    static_assert(alignof(Message) <= RtByteRing<size_bytes>::ALIGNMENT);
+    static_assert(size_bytes > 2 * sizeof(Message), "Ring must be able to hold at least 2 messages of max length");
+
+    /**
+     * @brief Reserve space for a message of max length, the message can be
+     *        set in place and is then truncated to its actual size by commit()
+     * @return nullptr if there is not even room for an empty message
+     */
+    Message* try_reserve()
+    {
+        void* data = _ring.try_reserve(sizeof(Message));
+        if (data)
+        {
+            _reserved = new (data) Message();
+        }
+        else if (_ring.try_reserve(EMPTY_MESSAGE_SIZE))
+        {
+            _reserved = new (&_overflow_message) Message();
+        }
+        else
+        {
+            return nullptr;
+        }
+        return _reserved;
+    }
+
+    /**
+     * @brief Make the reserved message visible to the consumer
+     * @return false if it was set outside of the ring and did not fit
+     */
+    bool commit()
+    {
+        if (_reserved == &_overflow_message)
+        {
+            return push(_overflow_message);
+        }
+        _ring.commit(_reserved->storage_size());
+        return true;
+    }
+
+    /**
+     * @brief Access the oldest message in place. Only the first storage_size()
+     *        bytes of the returned message may be accessed, which is the case
+     *        for all public members of RtLogMessage.
+     */
+    Message* peek()
+    {
+        size_t len;
+        void* data = _ring.peek(len);
+        if (data == nullptr)
+        {
+            return nullptr;
+        }
+        return std::launder(reinterpret_cast<Message*>(data));
+    }
+
+    void release()
+    {
+        _ring.release();
+    }
+
+    bool push(const Message& message)
+    {
+        size_t len = message.storage_size();
+        void* data = _ring.try_reserve(len);
+        if (data == nullptr)
+        {
+            return false;
+        }
+        std::memcpy(data, static_cast<const void*>(&message), len);
+        _ring.commit(len);
+        return true;
+    }
+
+    bool pop(Message& message)
+    {
+        size_t len;
+        void* data = _ring.peek(len);
+        if (data == nullptr)
+        {
+            return false;
+        }
+        // Only the first storage_size() bytes of the stored message are accessed
+        message = *std::launder(reinterpret_cast<const Message*>(data));
+        _ring.release();
+        return true;
+    }
+
+    size_t pop_bulk(Message* items, size_t max_count)
+    {
+        size_t count = 0;
+        return _ring.consume(max_count, [&](const void* data, size_t /*len*/)
+        {
+            items[count++] = *std::launder(reinterpret_cast<const Message*>(data));
+        });
+    }
+
+    bool wasEmpty() const
+    {
+        return _ring.was_empty();
+    }
+
+private:
+    // Header and null terminator
+    static constexpr size_t EMPTY_MESSAGE_SIZE = sizeof(Message) - message_len + 1;
+
+    RtByteRing<size_bytes> _ring;
+    Message* _reserved {nullptr};
+    // Only used by the producer, for messages set when the ring is almost full
+    Message _overflow_message;
+};
+
+} // namespace elklog
+
+#endif // ELKLOG_RTLOGRING_H
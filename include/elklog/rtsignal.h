@@ -0,0 +1,90 @@
+/*
+ * Copyright 2020-2023 Elk Audio AB
+ * ElkLog is free software: you can redistribute it and/or modify it under the terms
+ * of the GNU General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * Twine is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with Twine.
+ * If not, see http://www.gnu.org/licenses/ .
+ */
+
+/**
+ * @brief Lightweight signal for waking up a waiting non-rt thread from an rt
+ *        thread. Built on a futex on Linux, and notify() only makes a system
+ *        call for the first notification after each wakeup.
+ *
+ *        Note that on Xenomai/Cobalt, the system call made by a notifying rt
+ *        thread will cause a mode switch.
+ *
+ * @copyright Copyright 2020-2023 Elk Audio AB, Stockholm
+ */
+
+#ifndef ELKLOG_RTSIGNAL_H
+#define ELKLOG_RTSIGNAL_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <ctime>
+#endif
+
+namespace elklog {
+
+class RtSignal
+{
+public:
+    RtSignal() = default;
+
+    /**
+     * @brief Wake up the waiting thread. Safe to call from multiple threads.
+     */
+    void notify()
+    {
+        if (_flag.exchange(1, std::memory_order_release) == 0)
+        {
+#ifdef __linux__
+            syscall(SYS_futex, reinterpret_cast<uint32_t*>(&_flag), FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+#endif
+        }
+    }
+
+    /**
+     * @brief Wait until notified or until the timeout expires
+     * @return true if woken up by notify(), false on timeout
+     */
+    bool wait_for(std::chrono::nanoseconds timeout)
+    {
+#ifdef __linux__
+        if (_flag.load(std::memory_order_acquire) == 0)
+        {
+            auto secs = std::chrono::duration_cast<std::chrono::seconds>(timeout);
+            timespec ts = {static_cast<time_t>(secs.count()), static_cast<long>((timeout - secs).count())};
+            syscall(SYS_futex, reinterpret_cast<uint32_t*>(&_flag), FUTEX_WAIT_PRIVATE, 0, &ts, nullptr, 0);
+        }
+#else
+        std::this_thread::sleep_for(timeout);
+#endif
+        return _flag.exchange(0, std::memory_order_acquire) != 0;
+    }
+
+private:
+    RtSignal(const RtSignal&) = delete;
+    RtSignal& operator=(const RtSignal&) = delete;
+
+    static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t));
+    std::atomic<uint32_t> _flag {0};
+};
+
+} // namespace elklog
+
+#endif // ELKLOG_RTSIGNAL_H
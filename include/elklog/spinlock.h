@@ -20,13 +20,13 @@
 #ifndef ELKLOG_SPINLOCK_H
 #define ELKLOG_SPINLOCK_H
 
+// since std::hardware_destructive_interference_size is not yet supported in GCC 11
+constexpr int ASSUMED_CACHE_LINE_SIZE = 64;
+
 #ifdef ELKLOG_MULTI_THREADED_RT_LOGGING
 
 #include <atomic>
 
-// since std::hardware_destructive_interference_size is not yet supported in GCC 11
-constexpr int ASSUMED_CACHE_LINE_SIZE = 64;
-
 namespace elklog {
 /**
  * @brief Simple rt-safe test-and-set spinlock
@@ -30,6 +30,18 @@
  * Write to the logger using the ELKLOG_LOG_XXX macros with cppformat style
  * ie: ELKLOG_LOG_INFO("Setting x to {} and y to {}", x, y);
  *
+ * The level of each module can be changed at runtime with
+ * ElkLogger::set_module_level(), using the name given to
+ * ELKLOG_GET_LOGGER_WITH_MODULE_NAME().
+ *
+ * Format strings are checked against the arguments at compile time, see
+ * format_string.h.
+ *
+ * With -DELKLOG_CACHE_THREAD_HANDLES the macros log through a handle cached
+ * for each thread, so that whether the thread is realtime, and its rt queue,
+ * is only looked up on its first log call. Rt threads must then be marked as
+ * realtime before they first log.
+ *
  * spdlog supports ostream style too, but that doesn't work with
  * ELKLOG_DISABLE_LOGGING unfortunately
  *
@@ -39,7 +51,11 @@
 #ifndef STATIC_LOGGER_H
 #define STATIC_LOGGER_H
 
+#include <atomic>
+#include <cstdint>
+
 #include "elk_logger.h"
+#include "rate_limit.h"
 
 /* log macros */
 #ifndef ELKLOG_DISABLE_LOGGING
@@ -49,36 +65,98 @@
 //#define ELKLOG_ENABLE_DEBUG_FILE_AND_LINE_NUM
 
 /* Use this macro  at the top of a source file to declare a local logger */
-#define ELKLOG_GET_LOGGER_WITH_MODULE_NAME(prefix) constexpr char local_log_prefix[] = "[" prefix "] "
+#define ELKLOG_GET_LOGGER_WITH_MODULE_NAME(prefix) constexpr char local_log_prefix[] = "[" prefix "] "; \
+                                                   static const elklog::LogModule local_log_module(prefix)
 
-#define ELKLOG_GET_LOGGER constexpr char local_log_prefix[] = ""
+#define ELKLOG_GET_LOGGER constexpr char local_log_prefix[] = ""; \
+                          static const elklog::LogModule local_log_module("")
 
 /*
  * Use these macros to log messages. Use cppformat style, ie:
  * ELKLOG_LOG_INFO("Setting x to {} and y to {}", x, y);
  *
+ * Calls below ELKLOG_ACTIVE_LEVEL are removed at compile time, arguments
+ * included. The arguments of other calls are only evaluated if the level
+ * is enabled at runtime. CRITICAL messages are logged as errors.
+ *
  * spdlog supports ostream style, but that doesn't work with
  * -DDISABLE_MACROS unfortunately
  */
-#ifdef ELKLOG_ENABLE_DEBUG_FILE_AND_LINE_NUM
-#define ELKLOG_LOG_DEBUG(msg, ...) elklog::Logger::public_instance->debug("{}" msg " - [@{} #{}]", ##__VA_ARGS__, __FILE__ , __LINE__)
+#ifdef ELKLOG_CACHE_THREAD_HANDLES
+/* Log through a handle cached for each thread, see StaticLogger::thread_handle() */
+#define ELKLOG_STATIC_LOGGER               elklog::StaticLogger::thread_handle()
 #else
-#define ELKLOG_LOG_DEBUG(msg, ...)         elklog::StaticLogger::logger_instance->debug("{}" msg, local_log_prefix, ##__VA_ARGS__)
+#define ELKLOG_STATIC_LOGGER               (*elklog::StaticLogger::public_instance)
 #endif
-#define ELKLOG_LOG_INFO(msg, ...)          elklog::StaticLogger::public_instance->info("{}" msg, local_log_prefix, ##__VA_ARGS__)
-#define ELKLOG_LOG_WARNING(msg, ...)       elklog::StaticLogger::public_instance->warning("{}" msg, local_log_prefix, ##__VA_ARGS__)
-#define ELKLOG_LOG_ERROR(msg, ...)         elklog::StaticLogger::public_instance->error("{}" msg, local_log_prefix, ##__VA_ARGS__)
-#define ELKLOG_LOG_CRITICAL(msg, ...)      elklog::StaticLogger::public_instance->critical("{}" msg, local_log_prefix, ##__VA_ARGS__)
 
+#define ELKLOG_LOG_AT_LEVEL(level, msg, ...) do { auto& elklog_logger = ELKLOG_STATIC_LOGGER; \
+                                                  if (ELKLOG_LIKELY(elklog_logger.should_log(&local_log_module, level))) \
+                                                  { elklog_logger.template log<level>(&local_log_module, ELKLOG_FORMAT("{}" msg), local_log_prefix, ##__VA_ARGS__); } } while (0)
+
+#define ELKLOG_LOG_ELIDED                  do {} while (0)
+
+/*
+ * Rate limited versions, with a limit for each call site, ie:
+ * ELKLOG_LOG_WARNING_EVERY_N(100, "Buffer underrun");    logs every 100th call
+ * ELKLOG_LOG_WARNING_EVERY_MS(1000, "Buffer underrun");  logs at most once per second
+ */
+#define ELKLOG_LOG_RATE_LIMITED(limiter, limit, log_macro, msg, ...) do { static elklog::limiter elklog_rate_limit((limit)); \
+                                                                          if (elklog_rate_limit.should_log()) { log_macro(msg, ##__VA_ARGS__); } } while (0)
+
+#if ELKLOG_ACTIVE_LEVEL >= ELKLOG_LEVEL_DEBUG
 #ifdef ELKLOG_ENABLE_DEBUG_FILE_AND_LINE_NUM
-#define ELKLOG_LOG_DEBUG_IF(condition, msg, ...) if (condition) { elklog::StaticLogger::public_instance->debug_if(condition, "{}" msg " - [@{} #{}]", ##__VA_ARGS__, __FILE__ , __LINE__); }
+#define ELKLOG_LOG_DEBUG(msg, ...)         ELKLOG_LOG_AT_LEVEL(elklog::RtLogLevel::DEBUG, msg " - [@{} #{}]", ##__VA_ARGS__, __FILE__, __LINE__)
+#else
+#define ELKLOG_LOG_DEBUG(msg, ...)         ELKLOG_LOG_AT_LEVEL(elklog::RtLogLevel::DEBUG, msg, ##__VA_ARGS__)
+#endif
+#define ELKLOG_LOG_DEBUG_IF(condition, msg, ...)   do { if (condition) { ELKLOG_LOG_DEBUG(msg, ##__VA_ARGS__); } } while (0)
+#define ELKLOG_LOG_DEBUG_EVERY_N(n, msg, ...)      ELKLOG_LOG_RATE_LIMITED(EveryN, n, ELKLOG_LOG_DEBUG, msg, ##__VA_ARGS__)
+#define ELKLOG_LOG_DEBUG_EVERY_MS(ms, msg, ...)    ELKLOG_LOG_RATE_LIMITED(EveryInterval, std::chrono::milliseconds(ms), ELKLOG_LOG_DEBUG, msg, ##__VA_ARGS__)
+#else
+#define ELKLOG_LOG_DEBUG(...)              ELKLOG_LOG_ELIDED
+#define ELKLOG_LOG_DEBUG_IF(...)           ELKLOG_LOG_ELIDED
+#define ELKLOG_LOG_DEBUG_EVERY_N(...)      ELKLOG_LOG_ELIDED
+#define ELKLOG_LOG_DEBUG_EVERY_MS(...)     ELKLOG_LOG_ELIDED
+#endif
+
+#if ELKLOG_ACTIVE_LEVEL >= ELKLOG_LEVEL_INFO
+#define ELKLOG_LOG_INFO(msg, ...)          ELKLOG_LOG_AT_LEVEL(elklog::RtLogLevel::INFO, msg, ##__VA_ARGS__)
+#define ELKLOG_LOG_INFO_IF(condition, msg, ...)    do { if (condition) { ELKLOG_LOG_INFO(msg, ##__VA_ARGS__); } } while (0)
+#define ELKLOG_LOG_INFO_EVERY_N(n, msg, ...)       ELKLOG_LOG_RATE_LIMITED(EveryN, n, ELKLOG_LOG_INFO, msg, ##__VA_ARGS__)
+#define ELKLOG_LOG_INFO_EVERY_MS(ms, msg, ...)     ELKLOG_LOG_RATE_LIMITED(EveryInterval, std::chrono::milliseconds(ms), ELKLOG_LOG_INFO, msg, ##__VA_ARGS__)
 #else
-#define ELKLOG_LOG_DEBUG_IF(condition, msg, ...)    if (condition) { elklog::StaticLogger::public_instance->debug(condition, "{}" msg, local_log_prefix, ##__VA_ARGS__); }
+#define ELKLOG_LOG_INFO(...)               ELKLOG_LOG_ELIDED
+#define ELKLOG_LOG_INFO_IF(...)            ELKLOG_LOG_ELIDED
+#define ELKLOG_LOG_INFO_EVERY_N(...)       ELKLOG_LOG_ELIDED
+#define ELKLOG_LOG_INFO_EVERY_MS(...)      ELKLOG_LOG_ELIDED
 #endif
-#define ELKLOG_LOG_INFO_IF(condition, msg, ...)     if (condition) { elklog::StaticLogger::public_instance->info("{}" msg, local_log_prefix, ##__VA_ARGS__); }
-#define ELKLOG_LOG_WARNING_IF(condition, msg, ...)  if (condition) { elklog::StaticLogger::public_instance->warning("{}" msg, local_log_prefix, ##__VA_ARGS__); }
-#define ELKLOG_LOG_ERROR_IF(condition, msg, ...)    if (condition) { elklog::StaticLogger::public_instance->error("{}" msg, local_log_prefix, ##__VA_ARGS__); }
-#define ELKLOG_LOG_CRITICAL_IF(condition, msg, ...) if (condition) { elklog::StaticLogger::public_instance->critical("{}" msg, local_log_prefix, ##__VA_ARGS__); }
+
+#if ELKLOG_ACTIVE_LEVEL >= ELKLOG_LEVEL_WARNING
+#define ELKLOG_LOG_WARNING(msg, ...)       ELKLOG_LOG_AT_LEVEL(elklog::RtLogLevel::WARNING, msg, ##__VA_ARGS__)
+#define ELKLOG_LOG_WARNING_IF(condition, msg, ...) do { if (condition) { ELKLOG_LOG_WARNING(msg, ##__VA_ARGS__); } } while (0)
+#define ELKLOG_LOG_WARNING_EVERY_N(n, msg, ...)    ELKLOG_LOG_RATE_LIMITED(EveryN, n, ELKLOG_LOG_WARNING, msg, ##__VA_ARGS__)
+#define ELKLOG_LOG_WARNING_EVERY_MS(ms, msg, ...)  ELKLOG_LOG_RATE_LIMITED(EveryInterval, std::chrono::milliseconds(ms), ELKLOG_LOG_WARNING, msg, ##__VA_ARGS__)
+#else
+#define ELKLOG_LOG_WARNING(...)            ELKLOG_LOG_ELIDED
+#define ELKLOG_LOG_WARNING_IF(...)         ELKLOG_LOG_ELIDED
+#define ELKLOG_LOG_WARNING_EVERY_N(...)    ELKLOG_LOG_ELIDED
+#define ELKLOG_LOG_WARNING_EVERY_MS(...)   ELKLOG_LOG_ELIDED
+#endif
+
+#if ELKLOG_ACTIVE_LEVEL >= ELKLOG_LEVEL_ERROR
+#define ELKLOG_LOG_ERROR(msg, ...)         ELKLOG_LOG_AT_LEVEL(elklog::RtLogLevel::ERROR, msg, ##__VA_ARGS__)
+#define ELKLOG_LOG_ERROR_IF(condition, msg, ...)   do { if (condition) { ELKLOG_LOG_ERROR(msg, ##__VA_ARGS__); } } while (0)
+#define ELKLOG_LOG_ERROR_EVERY_N(n, msg, ...)      ELKLOG_LOG_RATE_LIMITED(EveryN, n, ELKLOG_LOG_ERROR, msg, ##__VA_ARGS__)
+#define ELKLOG_LOG_ERROR_EVERY_MS(ms, msg, ...)    ELKLOG_LOG_RATE_LIMITED(EveryInterval, std::chrono::milliseconds(ms), ELKLOG_LOG_ERROR, msg, ##__VA_ARGS__)
+#else
+#define ELKLOG_LOG_ERROR(...)              ELKLOG_LOG_ELIDED
+#define ELKLOG_LOG_ERROR_IF(...)           ELKLOG_LOG_ELIDED
+#define ELKLOG_LOG_ERROR_EVERY_N(...)      ELKLOG_LOG_ELIDED
+#define ELKLOG_LOG_ERROR_EVERY_MS(...)     ELKLOG_LOG_ELIDED
+#endif
+
+#define ELKLOG_LOG_CRITICAL(msg, ...)                ELKLOG_LOG_ERROR(msg, ##__VA_ARGS__)
+#define ELKLOG_LOG_CRITICAL_IF(condition, msg, ...)  ELKLOG_LOG_ERROR_IF(condition, msg, ##__VA_ARGS__)
 
 namespace elklog {
 
@@ -118,17 +196,40 @@ public:
         internal_instance = std::make_shared<ElkLogger>(min_log_level, logger_type);
         auto res = internal_instance->initialize(file_name, logger_name, log_flush_interval, drop_logger_if_duplicate, max_files);
 
-        if (res == Status::OK)
+        // The previous logger is destroyed, so on failure there is none
+        public_instance = res == Status::OK ? internal_instance.get() : nullptr;
+        _generation.fetch_add(1, std::memory_order_release);
+        return res;
+    }
+
+    /**
+     * @brief The logging handle of the calling thread, created on its first
+     *        call and again if the logger has been initialized since. Used by
+     *        the ELKLOG_LOG_* macros with ELKLOG_CACHE_THREAD_HANDLES, in which
+     *        case rt threads must be marked realtime before they first log.
+     *        Messages logged through it are dropped if init_logger() has not
+     *        succeeded.
+     */
+    static ElkLogger::ThreadHandle& thread_handle()
+    {
+        thread_local ElkLogger::ThreadHandle handle;
+        thread_local uint64_t handle_generation = 0;
+
+        auto generation = _generation.load(std::memory_order_acquire);
+        if (handle_generation != generation)
         {
-            public_instance = internal_instance.get();
+            handle = public_instance ? public_instance->thread_handle() : ElkLogger::ThreadHandle();
+            handle_generation = generation;
         }
-        return res;
+        return handle;
     }
 
     static ElkLogger* public_instance;
 
 private:
     StaticLogger() = default;
+
+    static inline std::atomic<uint64_t> _generation {0};
 };
 
 }
@@ -147,6 +248,14 @@ private:
 #define ELKLOG_LOG_WARNING_IF(...)
 #define ELKLOG_LOG_ERROR_IF(...)
 #define ELKLOG_LOG_CRITICAL_IF(...)
+#define ELKLOG_LOG_DEBUG_EVERY_N(...)
+#define ELKLOG_LOG_INFO_EVERY_N(...)
+#define ELKLOG_LOG_WARNING_EVERY_N(...)
+#define ELKLOG_LOG_ERROR_EVERY_N(...)
+#define ELKLOG_LOG_DEBUG_EVERY_MS(...)
+#define ELKLOG_LOG_INFO_EVERY_MS(...)
+#define ELKLOG_LOG_WARNING_EVERY_MS(...)
+#define ELKLOG_LOG_ERROR_EVERY_MS(...)
 
 namespace elklog {
 
@@ -156,17 +265,28 @@ public:
     static elklog::Status init_logger([[maybe_unused]] const std::string& file_name,
                                       [[maybe_unused]] const std::string& logger_name,
                                       [[maybe_unused]] const std::string& min_log_level,
-                                      [[maybe_unused]] const std::chrono::seconds log_flush_interval,
+                                      [[maybe_unused]] std::chrono::seconds log_flush_interval = std::chrono::seconds(0),
+                                      [[maybe_unused]] ElkLogger::Type logger_type = ElkLogger::Type::TEXT,
                                       [[maybe_unused]] bool drop_logger_if_duplicate = false,
-                                      [[maybe_unused]] int max_files = 1))
+                                      [[maybe_unused]] int max_files = 1)
     {
         return Status::OK;
     }
 
+    static ElkLogger::ThreadHandle& thread_handle()
+    {
+        thread_local ElkLogger::ThreadHandle handle;
+        return handle;
+    }
+
+    static ElkLogger* public_instance;
+
 private:
-    Logger() = default;
+    StaticLogger() = default;
 };
 
+} // namespace elklog
+
 #endif
 
 #endif //STATIC_LOGGER_H
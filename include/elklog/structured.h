@@ -0,0 +1,287 @@
+/*
+ * Copyright 2020-2023 Elk Audio AB
+ * ElkLog is free software: you can redistribute it and/or modify it under the terms
+ * of the GNU General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * Twine is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with Twine.
+ * If not, see http://www.gnu.org/licenses/ .
+ */
+
+/**
+ * @brief Typed key/value fields for structured log messages, i.e.
+ *        logger.info("Buffer processed", kv("cpu", load), kv("xruns", n)).
+ *        A message is either a format string with arguments, or a plain
+ *        message followed only by fields.
+ *
+ *        FieldEncoder writes the message and its fields in a single pass,
+ *        as a JSON object for ElkLogger::Type::JSON, with all strings
+ *        escaped, or as key=value pairs after the message for text logs.
+ *
+ *        Keys are stored as pointers and must outlive the message, which is
+ *        normally the case for string literals. Values are numbers, bools,
+ *        enums or strings.
+ *
+ * @copyright Copyright 2020-2023 Elk Audio AB, Stockholm
+ */
+
+#ifndef ELKLOG_STRUCTURED_H
+#define ELKLOG_STRUCTURED_H
+
+#include <cmath>
+#include <cstdint>
+#include <iterator>
+#include <string_view>
+#include <type_traits>
+
+#include <spdlog/fmt/bundled/format.h>
+
+#include "binary_format.h"
+#include "format_string.h"
+
+namespace elklog {
+
+enum class FieldEncoding
+{
+    TEXT,
+    JSON
+};
+
+template<typename T>
+struct Field
+{
+    using value_type = T;
+
+    const char* key;
+    T value;
+};
+
+/**
+ * @brief Create a field, strings are captured as string views
+ */
+template<typename T>
+constexpr auto kv(const char* key, const T& value)
+{
+    if constexpr (binary::is_string_arg<T>() || std::is_array_v<T>)
+    {
+        return Field<std::string_view> {key, std::string_view(value)};
+    }
+    else
+    {
+        static_assert(binary::numeric_arg_type<T>() != binary::ArgType::NONE, "Unsupported type for a log field");
+        return Field<T> {key, value};
+    }
+}
+
+template<typename T>
+struct is_field : std::false_type {};
+
+template<typename T>
+struct is_field<Field<T>> : std::true_type {};
+
+/**
+ * @brief Returns true if Args are log fields. Fields can not be mixed with
+ *        format arguments.
+ */
+template<typename... Args>
+constexpr bool are_fields()
+{
+    constexpr bool any = (is_field<std::decay_t<Args>>::value || ...);
+    constexpr bool all = (is_field<std::decay_t<Args>>::value && ...);
+    static_assert(any == false || all, "Log fields can not be mixed with format arguments");
+    return any;
+}
+
+/**
+ * @brief Compile time check of a static format against its arguments, or
+ *        that a message with fields has no arguments to format
+ */
+template<typename Format, typename... Args>
+constexpr void check_message()
+{
+    if constexpr (are_fields<Args...>())
+    {
+        check_format<Format>();
+    }
+    else
+    {
+        check_format<Format, Args...>();
+    }
+}
+
+/**
+ * @brief Writes a message and its fields to a fmt buffer in a single pass.
+ *        Call field() for each field, then end().
+ */
+template<typename Buffer>
+class FieldEncoder
+{
+public:
+    FieldEncoder(Buffer& out, FieldEncoding encoding, std::string_view message) :
+        _out(out),
+        _encoding(encoding)
+    {
+        if (_encoding == FieldEncoding::JSON)
+        {
+            _out.push_back('{');
+            // An empty message is left out, i.e. for status entries
+            if (message.empty() == false)
+            {
+                _key("message");
+                _string(message);
+            }
+        }
+        else
+        {
+            _out.append(message.data(), message.data() + message.size());
+            _first = message.empty();
+        }
+    }
+
+    template<typename T>
+    void field(const char* key, const T& value)
+    {
+        if constexpr (std::is_enum_v<T>)
+        {
+            field(key, static_cast<std::underlying_type_t<T>>(value));
+        }
+        else
+        {
+            _key(key);
+            _value(value);
+        }
+    }
+
+    void end()
+    {
+        if (_encoding == FieldEncoding::JSON)
+        {
+            _out.push_back('}');
+        }
+    }
+
+private:
+    template<typename T>
+    void _value(const T& value)
+    {
+        if constexpr (std::is_same_v<T, std::string_view>)
+        {
+            if (_encoding == FieldEncoding::JSON)
+            {
+                _string(value);
+            }
+            else
+            {
+                _out.append(value.data(), value.data() + value.size());
+            }
+        }
+        else if constexpr (std::is_same_v<T, bool>)
+        {
+            _literal(value ? "true" : "false");
+        }
+        else if constexpr (std::is_same_v<T, char>)
+        {
+            _encoding == FieldEncoding::JSON ? _string(std::string_view(&value, 1)) : _out.push_back(value);
+        }
+        else if constexpr (std::is_floating_point_v<T>)
+        {
+            // Not representable in JSON
+            if (_encoding == FieldEncoding::JSON && std::isfinite(value) == false)
+            {
+                _literal("null");
+            }
+            else
+            {
+                fmt::format_to(std::back_inserter(_out), "{}", value);
+            }
+        }
+        else
+        {
+            fmt::format_to(std::back_inserter(_out), "{}", value);
+        }
+    }
+
+    void _key(const char* key)
+    {
+        if (_encoding == FieldEncoding::JSON)
+        {
+            _literal(_first ? "\"" : ", \"");
+            _escaped(key);
+            _literal("\": ");
+        }
+        else
+        {
+            if (_first == false)
+            {
+                _out.push_back(' ');
+            }
+            _literal(key);
+            _out.push_back('=');
+        }
+        _first = false;
+    }
+
+    void _string(std::string_view str)
+    {
+        _out.push_back('"');
+        _escaped(str);
+        _out.push_back('"');
+    }
+
+    void _escaped(std::string_view str)
+    {
+        static constexpr char HEX[] = "0123456789abcdef";
+        for (char c : str)
+        {
+            switch (c)
+            {
+                case '"':  _literal("\\\""); break;
+                case '\\': _literal("\\\\"); break;
+                case '\n': _literal("\\n"); break;
+                case '\r': _literal("\\r"); break;
+                case '\t': _literal("\\t"); break;
+                case '\b': _literal("\\b"); break;
+                case '\f': _literal("\\f"); break;
+                default:
+                    if (static_cast<unsigned char>(c) < 0x20)
+                    {
+                        _literal("\\u00");
+                        _out.push_back(HEX[c >> 4]);
+                        _out.push_back(HEX[c & 0xf]);
+                    }
+                    else
+                    {
+                        _out.push_back(c);
+                    }
+            }
+        }
+    }
+
+    void _literal(std::string_view str)
+    {
+        _out.append(str.data(), str.data() + str.size());
+    }
+
+    Buffer& _out;
+    FieldEncoding _encoding;
+    bool _first {true};
+};
+
+/**
+ * @brief Encode a message with fields in one call
+ */
+template<typename Buffer, typename... Fields>
+void encode_fields(Buffer& out, FieldEncoding encoding, std::string_view message, const Fields&... fields)
+{
+    FieldEncoder<Buffer> encoder(out, encoding, message);
+    (encoder.field(fields.key, fields.value), ...);
+    encoder.end();
+}
+
+} // namespace elklog
+
+#endif // ELKLOG_STRUCTURED_H
@@ -0,0 +1,119 @@
+/*
+ * Copyright 2020-2023 Elk Audio AB
+ * ElkLog is free software: you can redistribute it and/or modify it under the terms
+ * of the GNU General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * Twine is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with Twine.
+ * If not, see http://www.gnu.org/licenses/ .
+ */
+
+/**
+ * @brief Settings for the non-rt threads of the logger, i.e. to pin the
+ *        consumer and writer threads to housekeeping cores, so that they do
+ *        not compete with rt threads on isolated cores. Threads otherwise
+ *        inherit the affinity and scheduling of the thread that creates them.
+ *
+ * @copyright Copyright 2020-2023 Elk Audio AB, Stockholm
+ */
+
+#ifndef ELKLOG_THREAD_CONFIG_H
+#define ELKLOG_THREAD_CONFIG_H
+
+#include <optional>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "log_return_code.h"
+
+namespace elklog {
+
+struct ThreadConfig
+{
+    // Cpus the thread may run on, empty to keep the inherited affinity
+    std::vector<int> cpus;
+    // i.e. SCHED_OTHER or SCHED_FIFO, with sched_priority
+    std::optional<int> sched_policy;
+    int sched_priority {0};
+    // Only used with non-realtime policies
+    std::optional<int> nice;
+    // Truncated to 15 characters on Linux
+    std::string name;
+
+    bool empty() const
+    {
+        return cpus.empty() && !sched_policy && !nice && name.empty();
+    }
+};
+
+/**
+ * @brief Apply config to the calling thread. All settings are attempted
+ *        even if one of them fails.
+ * @return FAILED_TO_CONFIGURE_THREAD if any setting could not be applied,
+ *         i.e. because of missing permissions or an invalid cpu
+ */
+inline Status apply_thread_config(const ThreadConfig& config)
+{
+    if (config.empty())
+    {
+        return Status::OK;
+    }
+#ifdef __linux__
+    bool ok = true;
+    auto thread = pthread_self();
+    if (config.name.empty() == false)
+    {
+        static constexpr size_t MAX_NAME_LENGTH = 15;
+        ok = pthread_setname_np(thread, config.name.substr(0, MAX_NAME_LENGTH).c_str()) == 0 && ok;
+    }
+
+    if (config.cpus.empty() == false)
+    {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        for (int cpu : config.cpus)
+        {
+            if (cpu < 0 || cpu >= CPU_SETSIZE)
+            {
+                ok = false;
+                continue;
+            }
+            CPU_SET(cpu, &cpus);
+        }
+        ok = pthread_setaffinity_np(thread, sizeof(cpus), &cpus) == 0 && ok;
+    }
+
+    if (config.sched_policy)
+    {
+        sched_param param {};
+        param.sched_priority = config.sched_priority;
+        ok = pthread_setschedparam(thread, *config.sched_policy, &param) == 0 && ok;
+    }
+
+    if (config.nice)
+    {
+        // The nice value is per thread on Linux
+        auto tid = static_cast<id_t>(::syscall(SYS_gettid));
+        ok = ::setpriority(PRIO_PROCESS, tid, *config.nice) == 0 && ok;
+    }
+    return ok ? Status::OK : Status::FAILED_TO_CONFIGURE_THREAD;
+#else
+    return Status::FAILED_TO_CONFIGURE_THREAD;
+#endif
+}
+
+} // namespace elklog
+
+#endif // ELKLOG_THREAD_CONFIG_H
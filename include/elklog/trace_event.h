@@ -0,0 +1,192 @@
+/*
+ * Copyright 2020-2023 Elk Audio AB
+ * ElkLog is free software: you can redistribute it and/or modify it under the terms
+ * of the GNU General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * Twine is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with Twine.
+ * If not, see http://www.gnu.org/licenses/ .
+ */
+
+/**
+ * @brief Trace events for profiling, i.e. the begin and end of a span,
+ *        instant events and counter values. Events are small fixed size
+ *        records with a static name id and the raw rt timestamp, queued by
+ *        RtLogger and written by TraceWriter in the Chrome trace JSON format,
+ *        which can be opened in chrome://tracing or Perfetto.
+ *
+ *        Names are created with ELKLOG_TRACE_NAME("...") and share the ids of
+ *        the static format strings in format_string.h.
+ *
+ * @copyright Copyright 2020-2023 Elk Audio AB, Stockholm
+ */
+
+#ifndef ELKLOG_TRACE_EVENT_H
+#define ELKLOG_TRACE_EVENT_H
+
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <string>
+
+#include <unistd.h>
+
+#include "format_string.h"
+
+#define ELKLOG_TRACE_NAME(name) ELKLOG_FORMAT(name)
+
+namespace elklog {
+
+enum class TraceEventType : uint8_t
+{
+    BEGIN,
+    END,
+    INSTANT,
+    COUNTER
+};
+
+struct TraceEvent
+{
+    std::chrono::nanoseconds timestamp;
+    int64_t value;
+    uint32_t name_id;
+    uint32_t thread_id;
+    TraceEventType type;
+};
+
+static_assert(sizeof(TraceEvent) <= 32);
+
+/**
+ * @brief Ends a span when going out of scope, returned by RtLogger::trace_scope()
+ */
+template<typename Tracer>
+class TraceScope
+{
+public:
+    TraceScope(Tracer& tracer, uint32_t name_id) : _tracer(tracer), _name_id(name_id)
+    {
+        _tracer.trace_event(TraceEventType::BEGIN, _name_id);
+    }
+
+    ~TraceScope()
+    {
+        _tracer.trace_event(TraceEventType::END, _name_id);
+    }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+    Tracer& _tracer;
+    uint32_t _name_id;
+};
+
+/**
+ * @brief Writes trace events to a file in the JSON array format of Chrome
+ *        traces. The closing bracket is written when the writer is destroyed,
+ *        but is optional in this format, so the file of a crashed process can
+ *        still be opened. Not thread safe.
+ */
+class TraceWriter
+{
+public:
+    explicit TraceWriter(const std::string& path) : _file(path, std::ios::trunc), _process_id(::getpid())
+    {
+        _file << "[\n";
+    }
+
+    ~TraceWriter()
+    {
+        if (_file.is_open())
+        {
+            _file << "\n]\n";
+        }
+    }
+
+    bool is_open() const
+    {
+        return _file.is_open();
+    }
+
+    void write(const TraceEvent* events, size_t count)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            _write(events[i]);
+        }
+    }
+
+    void flush()
+    {
+        _file.flush();
+    }
+
+private:
+    static char _phase(TraceEventType type)
+    {
+        switch (type)
+        {
+            case TraceEventType::BEGIN:
+                return 'B';
+            case TraceEventType::END:
+                return 'E';
+            case TraceEventType::INSTANT:
+                return 'i';
+            case TraceEventType::COUNTER:
+            default:
+                return 'C';
+        }
+    }
+
+    void _write(const TraceEvent& event)
+    {
+        const char* name = FormatRegistry::lookup(event.name_id);
+        if (_first == false)
+        {
+            _file << ",\n";
+        }
+        _first = false;
+
+        // Timestamps are in microseconds
+        auto ns = event.timestamp.count();
+        _file << R"({"name": ")";
+        _write_escaped(name != nullptr ? name : "unknown");
+        _file << R"(", "ph": ")" << _phase(event.type) << R"(", "ts": )" << ns / 1000 << "."
+              << static_cast<char>('0' + ns / 100 % 10) << static_cast<char>('0' + ns / 10 % 10)
+              << static_cast<char>('0' + ns % 10)
+              << R"(, "pid": )" << _process_id << R"(, "tid": )" << event.thread_id;
+        if (event.type == TraceEventType::COUNTER)
+        {
+            _file << R"(, "args": {"value": )" << event.value << "}";
+        }
+        else if (event.type == TraceEventType::INSTANT)
+        {
+            _file << R"(, "s": "t")";
+        }
+        _file << "}";
+    }
+
+    void _write_escaped(const char* str)
+    {
+        for (; *str != '\0'; ++str)
+        {
+            if (*str == '"' || *str == '\\')
+            {
+                _file << '\\';
+            }
+            _file << *str;
+        }
+    }
+
+    std::ofstream _file;
+    int _process_id;
+    bool _first {true};
+};
+
+} // namespace elklog
+
+#endif // ELKLOG_TRACE_EVENT_H
@@ -0,0 +1,357 @@
+/**
+ * @brief Benchmarks of the realtime logging path, built on Google Benchmark.
+ *        Run with --benchmark_repetitions and --benchmark_out for
+ *        reproducible numbers that can be compared between releases.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+
+#include "elklog/elk_logger.h"
+
+using namespace elklog;
+
+namespace {
+
+constexpr size_t BENCH_FIFO_SIZE = 1024;
+constexpr size_t BENCH_MESSAGE_SIZE = 256;
+constexpr int LATENCY_SAMPLES = 100000;
+constexpr int MAX_BENCH_THREADS = 8;
+constexpr auto DRAIN_TIMEOUT = std::chrono::milliseconds(5000);
+
+using BenchMessage = RtLogMessage<BENCH_MESSAGE_SIZE>;
+using BenchLogger = RtLogger<RTLOG_MESSAGE_SIZE, RTLOG_QUEUE_SIZE, RTLOG_ERROR_QUEUE_SIZE>;
+
+void add_log_stats(benchmark::State& state, const LogStats& stats)
+{
+    state.counters["dropped"] = static_cast<double>(stats.total_dropped());
+    state.counters["high_water_mark"] = static_cast<double>(stats.queue_high_water_mark);
+}
+
+// Consumer that only looks at the messages, so that the producer side is measured
+std::unique_ptr<BenchLogger> make_null_logger(std::chrono::milliseconds poll_period, int wakeup_threshold)
+{
+    return std::make_unique<BenchLogger>(poll_period,
+                                         [](const RtLogBatch<RTLOG_MESSAGE_SIZE>& batch)
+                                         {
+                                             benchmark::DoNotOptimize(batch.size());
+                                         },
+                                         "info",
+                                         wakeup_threshold);
+}
+
+/*
+ * Queues
+ */
+
+template<typename Fifo>
+void BM_FifoPushPop(benchmark::State& state)
+{
+    auto fifo = std::make_unique<Fifo>();
+    BenchMessage message;
+    message.set_message(RtLogLevel::INFO, std::chrono::nanoseconds(0), "Message");
+    for (auto _ : state)
+    {
+        fifo->push(message);
+        fifo->pop(message);
+        benchmark::DoNotOptimize(message);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_TEMPLATE(BM_FifoPushPop, memory_relaxed_aquire_release::CircularFifo<BenchMessage, BENCH_FIFO_SIZE>);
+BENCHMARK_TEMPLATE(BM_FifoPushPop, memory_relaxed_aquire_release::CircularFifo<BenchMessage, BENCH_FIFO_SIZE,
+                                                                               memory_relaxed_aquire_release::CACHE_LINE_SIZE>);
+
+// One thread pushes and one pops, full and empty attempts are counted separately
+template<typename Fifo>
+void BM_FifoProducerConsumer(benchmark::State& state)
+{
+    static Fifo fifo;
+    BenchMessage message;
+    message.set_message(RtLogLevel::INFO, std::chrono::nanoseconds(0), "Message");
+    int64_t done = 0;
+    int64_t failed = 0;
+    for (auto _ : state)
+    {
+        bool ok = state.thread_index() == 0 ? fifo.push(message) : fifo.pop(message);
+        ok ? done++ : failed++;
+    }
+    state.SetItemsProcessed(done);
+    state.counters["failed"] = benchmark::Counter(static_cast<double>(failed), benchmark::Counter::kAvgThreads);
+}
+BENCHMARK_TEMPLATE(BM_FifoProducerConsumer, memory_relaxed_aquire_release::CircularFifo<BenchMessage, BENCH_FIFO_SIZE>)
+    ->Threads(2)->UseRealTime();
+
+// The queue backend selected by the build configuration
+void BM_RtLogQueueWriteRead(benchmark::State& state)
+{
+    auto queue = std::make_unique<RtLogQueue<BENCH_MESSAGE_SIZE, BENCH_FIFO_SIZE>>();
+    for (auto _ : state)
+    {
+        queue->write([](BenchMessage& message)
+        {
+            message.set_message(RtLogLevel::INFO, std::chrono::nanoseconds(0), "Message");
+        });
+        benchmark::DoNotOptimize(queue->peek());
+        queue->release();
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_RtLogQueueWriteRead);
+
+/*
+ * Message formatting
+ */
+
+void BM_SetMessageNoArgs(benchmark::State& state)
+{
+    BenchMessage message;
+    for (auto _ : state)
+    {
+        message.set_message(RtLogLevel::INFO, std::chrono::nanoseconds(0), "Plain message without arguments");
+        benchmark::DoNotOptimize(message);
+    }
+}
+BENCHMARK(BM_SetMessageNoArgs);
+
+void BM_SetMessageInt(benchmark::State& state)
+{
+    BenchMessage message;
+    int value = 12345;
+    for (auto _ : state)
+    {
+        message.set_message(RtLogLevel::INFO, std::chrono::nanoseconds(0), "Int value {}", value);
+        benchmark::DoNotOptimize(message);
+    }
+}
+BENCHMARK(BM_SetMessageInt);
+
+void BM_SetMessageFloat(benchmark::State& state)
+{
+    BenchMessage message;
+    float value = 1.2345f;
+    for (auto _ : state)
+    {
+        message.set_message(RtLogLevel::INFO, std::chrono::nanoseconds(0), "Float value {}", value);
+        benchmark::DoNotOptimize(message);
+    }
+}
+BENCHMARK(BM_SetMessageFloat);
+
+void BM_SetMessageMixed(benchmark::State& state)
+{
+    BenchMessage message;
+    const char* name = "thread_0001";
+    int one = 1;
+    float two = 2.0f;
+    for (auto _ : state)
+    {
+        message.set_message(RtLogLevel::INFO, std::chrono::nanoseconds(0), "Logging rt from thread {}, {}, {}", name, one, two);
+        benchmark::DoNotOptimize(message);
+    }
+}
+BENCHMARK(BM_SetMessageMixed);
+
+// String argument of state.range(0) characters, truncated at the message size
+void BM_SetMessageString(benchmark::State& state)
+{
+    BenchMessage message;
+    std::string value(state.range(0), 'x');
+    for (auto _ : state)
+    {
+        message.set_message(RtLogLevel::INFO, std::chrono::nanoseconds(0), "String value {}", value.c_str());
+        benchmark::DoNotOptimize(message);
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_SetMessageString)->RangeMultiplier(4)->Range(8, 1024);
+
+// As above, without the strlen, and truncated before formatting
+void BM_SetMessageStringView(benchmark::State& state)
+{
+    BenchMessage message;
+    std::string value(state.range(0), 'x');
+    for (auto _ : state)
+    {
+        message.set_message(RtLogLevel::INFO, std::chrono::nanoseconds(0), "String value {}", std::string_view(value));
+        benchmark::DoNotOptimize(message);
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_SetMessageStringView)->RangeMultiplier(4)->Range(8, 1024);
+
+// A buffer of state.range(0) samples, truncated at capture to what fits in the message
+void BM_SetMessageSpan(benchmark::State& state)
+{
+    BenchMessage message;
+    std::vector<float> samples(state.range(0), 0.5f);
+    for (auto _ : state)
+    {
+        message.set_message(RtLogLevel::INFO, std::chrono::nanoseconds(0), "Samples {:.3f}", span(samples));
+        benchmark::DoNotOptimize(message);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_SetMessageSpan)->RangeMultiplier(8)->Range(8, 4096);
+
+void BM_SetMessageHexDump(benchmark::State& state)
+{
+    BenchMessage message;
+    std::vector<uint8_t> bytes(state.range(0), 0xab);
+    for (auto _ : state)
+    {
+        message.set_message(RtLogLevel::INFO, std::chrono::nanoseconds(0), "Bytes {}", hex_dump(bytes.data(), bytes.size()));
+        benchmark::DoNotOptimize(message);
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_SetMessageHexDump)->RangeMultiplier(8)->Range(8, 4096);
+
+void BM_SetDeferredMessage(benchmark::State& state)
+{
+    BenchMessage message;
+    int one = 1;
+    float two = 2.0f;
+    double three = 3.0;
+    for (auto _ : state)
+    {
+        message.set_deferred_message(RtLogLevel::INFO, std::chrono::nanoseconds(0), "Values {}, {}, {}", one, two, three);
+        benchmark::DoNotOptimize(message);
+    }
+}
+BENCHMARK(BM_SetDeferredMessage);
+
+void BM_SetDeferredStringView(benchmark::State& state)
+{
+    BenchMessage message;
+    std::string_view name = "thread_0001";
+    int one = 1;
+    for (auto _ : state)
+    {
+        message.set_deferred_message(RtLogLevel::INFO, std::chrono::nanoseconds(0), "Thread {}, {}", name, one);
+        benchmark::DoNotOptimize(message);
+    }
+}
+BENCHMARK(BM_SetDeferredStringView);
+
+/*
+ * RtLogger
+ */
+
+// Logging from 1 to N threads into the same logger
+void BM_RtLoggerContention(benchmark::State& state)
+{
+    static std::unique_ptr<BenchLogger> logger;
+    if (state.thread_index() == 0)
+    {
+        logger = make_null_logger(std::chrono::milliseconds(1), RT_CONSUMER_WAKEUP_THRESHOLD);
+    }
+    int value = 0;
+    for (auto _ : state)
+    {
+        logger->log<RtLogLevel::INFO>("Value {}", value++);
+    }
+    state.SetItemsProcessed(state.iterations());
+    if (state.thread_index() == 0)
+    {
+        add_log_stats(state, logger->stats());
+        logger.reset();
+    }
+}
+BENCHMARK(BM_RtLoggerContention)->ThreadRange(1, MAX_BENCH_THREADS)->UseRealTime();
+
+// The queue is full and the consumer never runs, so every message is dropped
+void BM_RtLoggerDropped(benchmark::State& state)
+{
+    auto logger = make_null_logger(std::chrono::milliseconds(1000000), 0);
+    while (logger->stats().total_dropped() == 0)
+    {
+        logger->log<RtLogLevel::INFO>("Filling up the queue");
+    }
+    for (auto _ : state)
+    {
+        logger->log<RtLogLevel::INFO>("Dropped {}", 1);
+    }
+    state.SetItemsProcessed(state.iterations());
+    add_log_stats(state, logger->stats());
+}
+BENCHMARK(BM_RtLoggerDropped);
+
+// Distribution of the time of single log calls, with an active consumer
+void BM_RtLoggerLatency(benchmark::State& state)
+{
+    auto logger = make_null_logger(std::chrono::milliseconds(1), RT_CONSUMER_WAKEUP_THRESHOLD);
+    std::vector<int64_t> latencies;
+    latencies.reserve(LATENCY_SAMPLES);
+    int value = 0;
+    for (auto _ : state)
+    {
+        auto start = std::chrono::steady_clock::now();
+        logger->log<RtLogLevel::INFO>("Latency {} {}", value++, 1.5f);
+        auto time = std::chrono::steady_clock::now() - start;
+        latencies.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(time).count());
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&](double p)
+    {
+        return static_cast<double>(latencies[static_cast<size_t>(p * (latencies.size() - 1))]);
+    };
+    state.counters["p50_ns"] = percentile(0.5);
+    state.counters["p99_ns"] = percentile(0.99);
+    state.counters["p99.9_ns"] = percentile(0.999);
+    state.counters["max_ns"] = static_cast<double>(latencies.back());
+    add_log_stats(state, logger->stats());
+}
+BENCHMARK(BM_RtLoggerLatency)->Iterations(LATENCY_SAMPLES);
+
+/*
+ * Consumer
+ */
+
+// Messages per second from the queue to a log file, the rt side only fills the queue
+void BM_ConsumerToFile(benchmark::State& state)
+{
+    const std::string path = "./rt_log_benchmark.txt";
+    std::remove(path.c_str());
+    auto file_logger = spdlog::basic_logger_st("rt_log_benchmark", path, true);
+    auto logger = std::make_unique<BenchLogger>(std::chrono::milliseconds(1),
+                                                [&](const RtLogBatch<RTLOG_MESSAGE_SIZE>& batch)
+                                                {
+                                                    for (size_t i = 0; i < batch.size(); ++i)
+                                                    {
+                                                        file_logger->info(batch[i].message());
+                                                    }
+                                                },
+                                                "info",
+                                                RT_CONSUMER_WAKEUP_THRESHOLD);
+    // Less than fits in the queue per round, so that nothing is dropped
+    const int messages = RT_CONSUMER_WAKEUP_THRESHOLD;
+    for (auto _ : state)
+    {
+        for (int i = 0; i < messages; ++i)
+        {
+            logger->log<RtLogLevel::INFO>("Message {} to file", i);
+        }
+        logger->drain(DRAIN_TIMEOUT);
+    }
+    state.SetItemsProcessed(state.iterations() * messages);
+    add_log_stats(state, logger->stats());
+    logger.reset();
+    spdlog::drop("rt_log_benchmark");
+}
+BENCHMARK(BM_ConsumerToFile)->UseRealTime();
+
+} // namespace
+
+BENCHMARK_MAIN();
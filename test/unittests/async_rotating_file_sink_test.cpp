@@ -0,0 +1,212 @@
+#include <cstdio>
+#include <fstream>
+#include <thread>
+
+#ifdef ELKLOG_WITH_COMPRESSION
+#include <zlib.h>
+#endif
+
+#include "gtest/gtest.h"
+
+#include "elklog/async_rotating_file_sink.h"
+#include "elklog/elk_logger.h"
+
+#include "test_utils.h"
+
+using namespace elklog;
+using namespace test_utils;
+
+constexpr auto ROTATION_TIMEOUT = std::chrono::milliseconds(2000);
+
+namespace {
+
+void remove_logs(const std::string& path, int max_files)
+{
+    for (int i = 0; i <= max_files + 1; ++i)
+    {
+        std::remove(rotated_file_name(path, i, Compression::NONE).c_str());
+        std::remove(rotated_file_name(path, i, Compression::GZIP).c_str());
+    }
+}
+
+void wait_for_rotations(async_rotating_file_sink_st& sink)
+{
+    auto deadline = std::chrono::steady_clock::now() + ROTATION_TIMEOUT;
+    while (sink.pending_rotations() > 0 && std::chrono::steady_clock::now() < deadline)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+} // namespace
+
+TEST(AsyncRotatingFileSinkTest, TestFileNames)
+{
+    EXPECT_EQ("log.txt", rotated_file_name("log.txt", 0, Compression::GZIP));
+    EXPECT_EQ("log.3.txt", rotated_file_name("log.txt", 3, Compression::NONE));
+    EXPECT_EQ("dir/log.1.txt.gz", rotated_file_name("dir/log.txt", 1, Compression::GZIP));
+}
+
+TEST(AsyncRotatingFileSinkTest, TestSizeRotation)
+{
+    const std::string path = "./rotation_test.txt";
+    remove_logs(path, 2);
+    RotationConfig config;
+    // Room for 2 messages of 10 bytes in each file
+    config.max_file_size = 20;
+    config.max_files = 2;
+    auto sink = std::make_shared<async_rotating_file_sink_st>(path, config);
+    spdlog::logger logger("rotation_test", sink);
+    logger.set_pattern("%v");
+    for (int i = 0; i < 8; ++i)
+    {
+        logger.info("Message {}", i);
+    }
+    logger.flush();
+    wait_for_rotations(*sink);
+
+    EXPECT_EQ("Message 6\nMessage 7\n", read_file(path));
+    EXPECT_EQ("Message 4\nMessage 5\n", read_file(rotated_file_name(path, 1, Compression::NONE)));
+    EXPECT_EQ("Message 2\nMessage 3\n", read_file(rotated_file_name(path, 2, Compression::NONE)));
+    EXPECT_FALSE(file_exists(rotated_file_name(path, 3, Compression::NONE)));
+}
+
+TEST(AsyncRotatingFileSinkTest, TestPendingFileNotOverwritten)
+{
+    const std::string path = "./rotation_test.txt";
+    const std::string pending = path + ".1.rotated";
+    remove_logs(path, 1);
+    // As left by a process that stopped before storing its rotated file
+    std::ofstream(pending) << "Earlier process\n";
+    RotationConfig config;
+    config.max_file_size = 20;
+    auto sink = std::make_shared<async_rotating_file_sink_st>(path, config);
+    spdlog::logger logger("rotation_test", sink);
+    logger.set_pattern("%v");
+    for (int i = 0; i < 3; ++i)
+    {
+        logger.info("Message {}", i);
+    }
+    logger.flush();
+    wait_for_rotations(*sink);
+
+    EXPECT_EQ("Earlier process\n", read_file(pending));
+    EXPECT_EQ("Message 0\nMessage 1\n", read_file(rotated_file_name(path, 1, Compression::NONE)));
+    std::remove(pending.c_str());
+}
+
+TEST(AsyncRotatingFileSinkTest, TestTimeRotation)
+{
+    const std::string path = "./rotation_test.txt";
+    remove_logs(path, 1);
+    RotationConfig config;
+    config.max_file_size = 0;
+    config.rotation_interval = std::chrono::milliseconds(50);
+    auto sink = std::make_shared<async_rotating_file_sink_st>(path, config);
+    spdlog::logger logger("rotation_test", sink);
+    logger.set_pattern("%v");
+    logger.info("Before");
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    logger.info("After");
+    logger.flush();
+    wait_for_rotations(*sink);
+
+    EXPECT_EQ("After\n", read_file(path));
+    EXPECT_EQ("Before\n", read_file(rotated_file_name(path, 1, Compression::NONE)));
+}
+
+#ifdef ELKLOG_WITH_COMPRESSION
+TEST(AsyncRotatingFileSinkTest, TestCompression)
+{
+    const std::string path = "./rotation_test.txt";
+    remove_logs(path, 1);
+    RotationConfig config;
+    config.max_file_size = 20;
+    config.compression = Compression::GZIP;
+    {
+        auto sink = std::make_shared<async_rotating_file_sink_st>(path, config);
+        spdlog::logger logger("rotation_test", sink);
+        logger.set_pattern("%v");
+        for (int i = 0; i < 3; ++i)
+        {
+            logger.info("Message {}", i);
+        }
+        // Pending rotations are finished when the sink is destroyed
+    }
+
+    auto compressed = rotated_file_name(path, 1, Compression::GZIP);
+    gzFile file = gzopen(compressed.c_str(), "rb");
+    ASSERT_NE(nullptr, file);
+    char buffer[64] = {};
+    int read = gzread(file, buffer, sizeof(buffer));
+    gzclose(file);
+    EXPECT_EQ("Message 0\nMessage 1\n", std::string(buffer, std::max(read, 0)));
+    EXPECT_FALSE(file_exists(rotated_file_name(path, 1, Compression::NONE)));
+}
+
+TEST(AsyncRotatingFileSinkTest, TestUncompressedFilesShifted)
+{
+    const std::string path = "./rotation_test.txt";
+    remove_logs(path, 2);
+    // As left when compression has failed
+    std::ofstream(rotated_file_name(path, 1, Compression::NONE)) << "Uncompressed\n";
+    RotationConfig config;
+    config.max_file_size = 20;
+    config.max_files = 2;
+    config.compression = Compression::GZIP;
+    auto sink = std::make_shared<async_rotating_file_sink_st>(path, config);
+    spdlog::logger logger("rotation_test", sink);
+    logger.set_pattern("%v");
+    for (int i = 0; i < 3; ++i)
+    {
+        logger.info("Message {}", i);
+    }
+    logger.flush();
+    wait_for_rotations(*sink);
+
+    EXPECT_FALSE(file_exists(rotated_file_name(path, 1, Compression::NONE)));
+    EXPECT_TRUE(file_exists(rotated_file_name(path, 1, Compression::GZIP)));
+    EXPECT_EQ("Uncompressed\n", read_file(rotated_file_name(path, 2, Compression::NONE)));
+
+    // Pruned as the oldest file
+    for (int i = 3; i < 5; ++i)
+    {
+        logger.info("Message {}", i);
+    }
+    logger.flush();
+    wait_for_rotations(*sink);
+    EXPECT_FALSE(file_exists(rotated_file_name(path, 2, Compression::NONE)));
+    EXPECT_TRUE(file_exists(rotated_file_name(path, 2, Compression::GZIP)));
+}
+#else
+TEST(AsyncRotatingFileSinkTest, TestCompressionNotBuilt)
+{
+    RotationConfig config;
+    config.compression = Compression::GZIP;
+    ElkLogger logger("info");
+    logger.set_rotation_config(config);
+    EXPECT_EQ(Status::FAILED_TO_START_LOGGER, logger.initialize("./rotation_test.txt", "rotation_test", std::chrono::seconds(0), true));
+}
+#endif
+
+TEST(AsyncRotatingFileSinkTest, TestElkLoggerRotation)
+{
+    const std::string path = "./rotation_log.txt";
+    remove_logs(path, 3);
+    RotationConfig config;
+    config.max_file_size = 200;
+    config.max_files = 3;
+    {
+        ElkLogger logger("info");
+        logger.set_rotation_config(config);
+        ASSERT_EQ(Status::OK, logger.initialize(path, "rotation_log", std::chrono::seconds(0), true));
+        for (int i = 0; i < 10; ++i)
+        {
+            logger.info("Message {}", i);
+        }
+        // The sink finishes the pending rotations when the logger is destroyed
+    }
+
+    EXPECT_TRUE(file_exists(rotated_file_name(path, 1, Compression::NONE)));
+    EXPECT_NE(std::string::npos, read_file(path).find("Message 9"));
+}
@@ -0,0 +1,104 @@
+#include "gtest/gtest.h"
+
+#include "elklog/binary_format.h"
+#include "elklog/rtlogmessage.h"
+
+using namespace elklog;
+using namespace elklog::binary;
+
+TEST(BinaryFormatTest, TestEncodeAndDecode)
+{
+    std::string buffer;
+    Encoder encoder(buffer);
+    encoder.header(1234, "test_logger");
+    encoder.format(0, "Values {} {} {:.2f} {}");
+    encoder.message(2, 123456789, 0, 42, 'x', 1.2345, std::string("text"));
+
+    Decoder decoder(buffer.data(), buffer.size());
+    uint32_t process_id;
+    std::string name;
+    ASSERT_TRUE(decoder.header(process_id, name));
+    EXPECT_EQ(1234u, process_id);
+    EXPECT_EQ("test_logger", name);
+
+    DecodedMessage message;
+    ASSERT_TRUE(decoder.next(message));
+    EXPECT_EQ(2, message.level);
+    EXPECT_EQ(123456789, message.timestamp);
+    ASSERT_EQ(4u, message.args.size());
+    EXPECT_EQ(ArgType::INT32, message.args[0].type);
+    EXPECT_EQ(ArgType::CHAR, message.args[1].type);
+    EXPECT_EQ(ArgType::DOUBLE, message.args[2].type);
+    EXPECT_EQ(ArgType::STRING, message.args[3].type);
+    EXPECT_EQ("Values 42 x 1.23 text", format_message(decoder.format(message.format_id), message.args));
+
+    EXPECT_FALSE(decoder.next(message));
+}
+
+TEST(BinaryFormatTest, TestPackedRtMessage)
+{
+    RtLogMessage<128> rt_message;
+    rt_message.set_deferred_message(RtLogLevel::INFO, std::chrono::nanoseconds(5), "Rt {} {} {}", 1, 2.5f, true);
+    ASSERT_TRUE(rt_message.is_deferred());
+
+    std::string buffer;
+    Encoder encoder(buffer);
+    encoder.header(0, "");
+    encoder.format(3, rt_message.format_str());
+    encoder.packed_message(2, rt_message.timestamp().count(), 3, rt_message.arg_types(),
+                           rt_message.packed_args(), rt_message.length());
+
+    Decoder decoder(buffer.data(), buffer.size());
+    uint32_t process_id;
+    std::string name;
+    ASSERT_TRUE(decoder.header(process_id, name));
+    DecodedMessage message;
+    ASSERT_TRUE(decoder.next(message));
+    EXPECT_EQ(5, message.timestamp);
+    EXPECT_EQ("Rt 1 2.5 true", format_message(decoder.format(message.format_id), message.args));
+}
+
+TEST(BinaryFormatTest, TestPackedRtString)
+{
+    RtLogMessage<128> rt_message;
+    rt_message.set_deferred_message(RtLogLevel::INFO, std::chrono::nanoseconds(5), "Rt {} {}",
+                                    std::string_view("name"), 7);
+    ASSERT_TRUE(rt_message.is_deferred());
+    EXPECT_EQ(ArgType::STRING, rt_message.arg_types()[0]);
+
+    std::string buffer;
+    Encoder encoder(buffer);
+    encoder.header(0, "");
+    encoder.format(3, rt_message.format_str());
+    encoder.packed_message(2, rt_message.timestamp().count(), 3, rt_message.arg_types(),
+                           rt_message.packed_args(), rt_message.length());
+
+    Decoder decoder(buffer.data(), buffer.size());
+    uint32_t process_id;
+    std::string name;
+    ASSERT_TRUE(decoder.header(process_id, name));
+    DecodedMessage message;
+    ASSERT_TRUE(decoder.next(message));
+    EXPECT_EQ("Rt name 7", format_message(decoder.format(message.format_id), message.args));
+}
+
+TEST(BinaryFormatTest, TestFormatMessage)
+{
+    std::vector<DecodedArg> args(2);
+    args[0].type = ArgType::INT64;
+    args[0].int_value = -3;
+    args[1].type = ArgType::STRING;
+    args[1].string_value = "str";
+
+    EXPECT_EQ("{escaped} str -3", format_message("{{escaped}} {1} {0}", args));
+    EXPECT_EQ("-03 str {}", format_message("{:03} {} {}", args));
+}
+
+TEST(BinaryFormatTest, TestCorruptStream)
+{
+    std::string buffer = "not a log";
+    Decoder decoder(buffer.data(), buffer.size());
+    uint32_t process_id;
+    std::string name;
+    EXPECT_FALSE(decoder.header(process_id, name));
+}
@@ -0,0 +1,95 @@
+#include <cstdint>
+#include <memory>
+#include <thread>
+
+#include "gtest/gtest.h"
+
+#include "fifo/circularfifo_memory_relaxed_aquire_release.h"
+
+using namespace memory_relaxed_aquire_release;
+
+using TestFifo = CircularFifo<int, 8>;
+using AlignedTestFifo = CircularFifo<int, 8, CACHE_LINE_SIZE>;
+
+TEST(CircularFifoTest, TestFillAndEmpty)
+{
+    TestFifo module_under_test;
+    int value;
+    EXPECT_FALSE(module_under_test.pop(value));
+
+    // Interleaved in several rounds, so that the cached indices go stale and
+    // the indices wrap around the end
+    int written = 0;
+    int read = 0;
+    for (int round = 0; round < 5; ++round)
+    {
+        while (module_under_test.push(written))
+        {
+            written++;
+        }
+        EXPECT_TRUE(module_under_test.wasFull());
+        for (int i = 0; i < 3; ++i)
+        {
+            ASSERT_TRUE(module_under_test.pop(value));
+            EXPECT_EQ(read++, value);
+        }
+        EXPECT_TRUE(module_under_test.push(written++));
+        while (module_under_test.pop(value))
+        {
+            EXPECT_EQ(read++, value);
+        }
+        EXPECT_TRUE(module_under_test.wasEmpty());
+    }
+    EXPECT_EQ(written, read);
+}
+
+TEST(CircularFifoTest, TestSlotAlignment)
+{
+    AlignedTestFifo module_under_test;
+    EXPECT_EQ(0u, alignof(AlignedTestFifo) % CACHE_LINE_SIZE);
+
+    for (int i = 0; i < 3; ++i)
+    {
+        auto slot = module_under_test.try_reserve();
+        ASSERT_NE(nullptr, slot);
+        EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(slot) % CACHE_LINE_SIZE);
+        *slot = i;
+        module_under_test.commit();
+    }
+    for (int i = 0; i < 3; ++i)
+    {
+        auto slot = module_under_test.peek();
+        ASSERT_NE(nullptr, slot);
+        EXPECT_EQ(i, *slot);
+        module_under_test.release();
+    }
+    EXPECT_EQ(nullptr, module_under_test.peek());
+}
+
+TEST(CircularFifoTest, TestProducerAndConsumerThreads)
+{
+    constexpr int MESSAGES = 100000;
+    auto module_under_test = std::make_unique<TestFifo>();
+
+    std::thread producer([&]()
+    {
+        for (int i = 0; i < MESSAGES; ++i)
+        {
+            while (module_under_test->push(i) == false)
+            {
+                std::this_thread::yield();
+            }
+        }
+    });
+
+    int value;
+    for (int i = 0; i < MESSAGES; ++i)
+    {
+        while (module_under_test->pop(value) == false)
+        {
+            std::this_thread::yield();
+        }
+        ASSERT_EQ(i, value);
+    }
+    producer.join();
+}
@@ -1,8 +1,23 @@
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+#include <iomanip>
+#include <new>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include <sys/syscall.h>
+#include <unistd.h>
+
 #include "gtest/gtest.h"
 
 #include "elklog/elk_logger.h"
 
+#include "test_utils.h"
+
 using namespace elklog;
+using namespace test_utils;
 
 // A more complex test case where tests can be grouped
 // And setup and teardown functions added.
@@ -39,3 +54,443 @@ TEST_F(InitLogTest, TestCreation)
     status = logger_3.initialize("log_3.txt", "log_1");
     ASSERT_EQ(Status::INVALID_LOG_LEVEL, status);
 }
+
+TEST(LogLevelTest, TestSetLevel)
+{
+    ElkLogger logger("warning");
+    EXPECT_TRUE(logger.should_log(nullptr, RtLogLevel::WARNING));
+    EXPECT_FALSE(logger.should_log(nullptr, RtLogLevel::INFO));
+
+    logger.set_level(RtLogLevel::DEBUG);
+    EXPECT_TRUE(logger.should_log(nullptr, RtLogLevel::DEBUG));
+
+    EXPECT_EQ(Status::OK, logger.set_level("error"));
+    EXPECT_FALSE(logger.should_log(nullptr, RtLogLevel::WARNING));
+    EXPECT_EQ(Status::INVALID_LOG_LEVEL, logger.set_level("verbose"));
+    EXPECT_FALSE(logger.should_log(nullptr, RtLogLevel::WARNING));
+}
+
+TEST(LogLevelTest, TestModuleLevel)
+{
+    static const LogModule module("level_test_module");
+    static const LogModule other_module("other_test_module");
+
+    ElkLogger logger("warning");
+    ASSERT_EQ(Status::OK, logger.set_module_level("level_test_module", "debug"));
+    EXPECT_TRUE(logger.should_log(&module, RtLogLevel::DEBUG));
+    EXPECT_FALSE(logger.should_log(&other_module, RtLogLevel::INFO));
+    EXPECT_FALSE(logger.should_log(nullptr, RtLogLevel::INFO));
+
+    // Module levels can be less verbose than the logger too
+    ASSERT_EQ(Status::OK, logger.set_module_level("level_test_module", "error"));
+    EXPECT_FALSE(logger.should_log(&module, RtLogLevel::WARNING));
+    EXPECT_TRUE(logger.should_log(&other_module, RtLogLevel::WARNING));
+    EXPECT_EQ(Status::INVALID_LOG_LEVEL, logger.set_module_level("level_test_module", "verbose"));
+
+    logger.clear_module_level("level_test_module");
+    EXPECT_TRUE(logger.should_log(&module, RtLogLevel::WARNING));
+    EXPECT_FALSE(logger.should_log(&module, RtLogLevel::DEBUG));
+}
+
+TEST(LogLevelTest, TestLevelChangeAfterInit)
+{
+    static const LogModule module("level_change_module");
+    std::remove("./level_log.txt");
+    ElkLogger logger("warning");
+    ASSERT_EQ(Status::OK, logger.initialize("./level_log.txt", "level_log", std::chrono::seconds(0), true));
+    logger.info("Filtered message");
+    logger.set_level(RtLogLevel::INFO);
+    logger.info("Info message");
+    logger.set_level(RtLogLevel::ERROR);
+    logger.set_module_level("level_change_module", "debug");
+    logger.log<RtLogLevel::DEBUG>(&module, "Module debug message");
+    logger.debug("Filtered debug message");
+    ASSERT_EQ(Status::OK, logger.flush(std::chrono::milliseconds(1000)));
+
+    auto content = read_file("./level_log.txt");
+    EXPECT_EQ(std::string::npos, content.find("Filtered"));
+    EXPECT_NE(std::string::npos, content.find("Info message"));
+    EXPECT_NE(std::string::npos, content.find("Module debug message"));
+}
+
+TEST(LogLevelTest, TestSetLevelFromRtThread)
+{
+    std::remove("./level_log.txt");
+    ElkLogger logger("warning");
+    ASSERT_EQ(Status::OK, logger.initialize("./level_log.txt", "level_log", std::chrono::seconds(0), true));
+    std::thread rt_thread([&]()
+    {
+        twine::ThreadRtFlag rt_flag;
+        logger.set_level(RtLogLevel::DEBUG);
+    });
+    rt_thread.join();
+    EXPECT_TRUE(logger.should_log(nullptr, RtLogLevel::DEBUG));
+
+    // The level of the spdlog logger is updated when passing this on
+    logger.debug("Debug message");
+    ASSERT_EQ(Status::OK, logger.flush(std::chrono::milliseconds(1000)));
+    EXPECT_EQ(1, count_lines_with("./level_log.txt", "Debug message"));
+}
+
+TEST(LogOrderTest, TestNonRtMessagesInOrder)
+{
+    // More messages than fit in the rt queue, which non-rt messages go
+    // through if ELKLOG_SINGLE_WRITER_THREAD is defined
+    constexpr int MESSAGES = 2 * ELKLOG_RT_QUEUE_SIZE;
+    std::remove("./order_log.txt");
+    ElkLogger logger("info");
+    ASSERT_EQ(Status::OK, logger.initialize("./order_log.txt", "order_log", std::chrono::seconds(0), true));
+    for (int i = 0; i < MESSAGES; ++i)
+    {
+        logger.info("Message {}", i);
+    }
+    ASSERT_EQ(Status::OK, logger.flush(std::chrono::milliseconds(1000)));
+
+    int expected = 0;
+    for (const auto& line : read_lines("./order_log.txt"))
+    {
+        if (line.find("Message ") != std::string::npos)
+        {
+            EXPECT_NE(std::string::npos, line.find(fmt::format("Message {}", expected)));
+            expected++;
+        }
+    }
+    EXPECT_EQ(MESSAGES, expected);
+}
+
+TEST(RtMemoryLogTest, TestCallerProvidedMemory)
+{
+    std::remove("./rt_memory_log.txt");
+    void* memory = ::operator new(ElkLogger::rt_memory_size(), std::align_val_t(ElkLogger::rt_memory_alignment()));
+    {
+        ElkLogger logger("info", ElkLogger::Type::TEXT, RT_CONSUMER_POLL_PERIOD, RT_CONSUMER_MAX_IDLE_PERIOD,
+                         RT_CONSUMER_WAKEUP_THRESHOLD, false, memory);
+        ASSERT_EQ(Status::OK, logger.initialize("./rt_memory_log.txt", "rt_memory_log", std::chrono::seconds(0), true));
+        logger.info("Message in caller memory");
+#ifndef ELKLOG_RT_LOCK_MEMORY
+        EXPECT_FALSE(logger.rt_memory_locked());
+#endif
+        ASSERT_EQ(Status::OK, logger.flush(std::chrono::milliseconds(1000)));
+        EXPECT_EQ(1, count_lines_with("./rt_memory_log.txt", "Message in caller memory"));
+    }
+    ::operator delete(memory, std::align_val_t(ElkLogger::rt_memory_alignment()));
+}
+
+TEST(RepeatedLogTest, TestCollapseIsOptIn)
+{
+    auto log_repeated = [](ElkLogger& logger)
+    {
+        std::thread rt_thread([&]()
+        {
+            twine::ThreadRtFlag rt_flag;
+            for (int i = 0; i < 3; ++i)
+            {
+                logger.info("Repeated message");
+            }
+            logger.info("Other message");
+        });
+        rt_thread.join();
+        ASSERT_EQ(Status::OK, logger.flush(std::chrono::milliseconds(1000)));
+    };
+
+    std::remove("./repeated_log.txt");
+    {
+        ElkLogger logger("info");
+        ASSERT_EQ(Status::OK, logger.initialize("./repeated_log.txt", "repeated_log", std::chrono::seconds(0), true));
+        log_repeated(logger);
+        EXPECT_EQ(3, count_lines_with("./repeated_log.txt", "Repeated message"));
+        EXPECT_EQ(0, count_lines_with("./repeated_log.txt", "repeated 2 times"));
+    }
+
+    std::remove("./repeated_log.txt");
+    {
+        ElkLogger logger("info", ElkLogger::Type::TEXT, RT_CONSUMER_POLL_PERIOD, RT_CONSUMER_MAX_IDLE_PERIOD,
+                         RT_CONSUMER_WAKEUP_THRESHOLD, true);
+        ASSERT_EQ(Status::OK, logger.initialize("./repeated_log.txt", "repeated_log", std::chrono::seconds(0), true));
+        log_repeated(logger);
+        EXPECT_EQ(1, count_lines_with("./repeated_log.txt", "Repeated message"));
+        EXPECT_EQ(1, count_lines_with("./repeated_log.txt", "Last message repeated 2 times"));
+    }
+}
+
+TEST(ThreadHandleLogTest, TestHandles)
+{
+    std::remove("./thread_handle_log.txt");
+    ElkLogger logger("info");
+    ASSERT_EQ(Status::OK, logger.initialize("./thread_handle_log.txt", "thread_handle_log", std::chrono::seconds(0), true));
+    auto handle = logger.thread_handle();
+    EXPECT_FALSE(handle.is_realtime());
+    EXPECT_EQ(&logger, handle.logger());
+    handle.info("Non-rt handle message {}", 1);
+    handle.debug("Filtered");
+
+    std::thread rt_thread([&]()
+    {
+        twine::ThreadRtFlag rt_flag;
+        auto rt_handle = logger.thread_handle();
+        EXPECT_TRUE(rt_handle.is_realtime());
+        rt_handle.warning("Rt handle message {}", 2);
+    });
+    rt_thread.join();
+    ASSERT_EQ(Status::OK, logger.flush(std::chrono::milliseconds(1000)));
+
+    auto content = read_file("./thread_handle_log.txt");
+    EXPECT_NE(std::string::npos, content.find("Non-rt handle message 1"));
+    EXPECT_NE(std::string::npos, content.find("Rt handle message 2"));
+    EXPECT_EQ(std::string::npos, content.find("Filtered"));
+}
+
+TEST(SharedBackendLogTest, TestLoggersWithOwnLevels)
+{
+    std::remove("./backend_log_1.txt");
+    std::remove("./backend_log_2.txt");
+    auto backend = std::make_shared<LogBackend>(1, 1, std::chrono::milliseconds(1), std::chrono::milliseconds(10));
+    ElkLogger logger_1("debug", ElkLogger::Type::TEXT, RT_CONSUMER_POLL_PERIOD, RT_CONSUMER_MAX_IDLE_PERIOD,
+                       RT_CONSUMER_WAKEUP_THRESHOLD, false, nullptr, backend);
+    ElkLogger logger_2("warning", ElkLogger::Type::TEXT, RT_CONSUMER_POLL_PERIOD, RT_CONSUMER_MAX_IDLE_PERIOD,
+                       RT_CONSUMER_WAKEUP_THRESHOLD, false, nullptr, backend);
+    ASSERT_EQ(Status::OK, logger_1.initialize("./backend_log_1.txt", "backend_log_1", std::chrono::seconds(1), true));
+    ASSERT_EQ(Status::OK, logger_2.initialize("./backend_log_2.txt", "backend_log_2", std::chrono::seconds(1), true));
+
+    logger_1.debug("Debug to logger 1");
+    logger_2.debug("Debug to logger 2");
+    logger_2.warning("Warning to logger 2");
+    std::thread rt_thread([&]()
+    {
+        twine::ThreadRtFlag rt_flag;
+        logger_1.info("Rt message to logger 1");
+        logger_2.error("Rt message to logger 2");
+    });
+    rt_thread.join();
+    ASSERT_EQ(Status::OK, logger_1.flush(std::chrono::milliseconds(1000)));
+    ASSERT_EQ(Status::OK, logger_2.flush(std::chrono::milliseconds(1000)));
+
+    auto content_1 = read_file("./backend_log_1.txt");
+    auto content_2 = read_file("./backend_log_2.txt");
+    EXPECT_NE(std::string::npos, content_1.find("Debug to logger 1"));
+    EXPECT_NE(std::string::npos, content_1.find("Rt message to logger 1"));
+    EXPECT_EQ(std::string::npos, content_2.find("Debug to logger 2"));
+    EXPECT_NE(std::string::npos, content_2.find("Warning to logger 2"));
+    EXPECT_NE(std::string::npos, content_2.find("Rt message to logger 2"));
+    EXPECT_EQ(std::string::npos, content_1.find("logger 2"));
+}
+
+TEST(JsonLogTest, TestStructuredFields)
+{
+    std::remove("./json_log.txt");
+    {
+        ElkLogger logger("info", ElkLogger::Type::JSON);
+        ASSERT_EQ(Status::OK, logger.initialize("./json_log.txt", "json_log", std::chrono::seconds(0), true));
+        logger.info("Buffer \"processed\"", kv("cpu", 0.5), kv("xruns", 3));
+        // Writes the last entry and flushes
+        logger.close_log();
+    }
+
+    auto lines = read_lines("./json_log.txt");
+    ASSERT_EQ(3u, lines.size());
+    EXPECT_NE(std::string::npos, lines[0].find(R"("data": {"status": "Started"}})"));
+    EXPECT_NE(std::string::npos, lines[1].find(R"("data": {"message": "Buffer \"processed\"", "cpu": 0.5, "xruns": 3}})"));
+    EXPECT_NE(std::string::npos, lines[2].find(R"("data": {"status": "Finished"}})"));
+}
+
+TEST(BinaryLogTest, TestBinaryLogging)
+{
+    {
+        ElkLogger logger("info", ElkLogger::Type::BINARY);
+        auto status = logger.initialize("./binary_log.bin", "binary_log");
+        ASSERT_EQ(Status::OK, status);
+
+        logger.info("Message {} {}", 1, "with string");
+        logger.debug("Filtered message {}", 2);
+        logger.warning("Message {:.1f}", 2.25);
+        for (int i = 0; i < 2; ++i)
+        {
+            logger.info(ELKLOG_FORMAT("Static message {}"), i);
+        }
+        ASSERT_EQ(Status::OK, logger.flush(std::chrono::milliseconds(1000)));
+    }
+
+    auto data = read_file("./binary_log.bin");
+    binary::Decoder decoder(data.data(), data.size());
+
+    uint32_t process_id;
+    std::string name;
+    ASSERT_TRUE(decoder.header(process_id, name));
+    EXPECT_EQ("binary_log", name);
+
+    std::vector<std::string> messages;
+    binary::DecodedMessage message;
+    while (decoder.next(message))
+    {
+        messages.push_back(binary::format_message(decoder.format(message.format_id), message.args));
+    }
+    ASSERT_EQ(5u, messages.size());
+    EXPECT_EQ("Started logger: binary_log.", messages[0]);
+    EXPECT_EQ("Message 1 with string", messages[1]);
+    EXPECT_EQ("Message 2.2", messages[2]);
+    EXPECT_EQ("Static message 0", messages[3]);
+    EXPECT_EQ("Static message 1", messages[4]);
+}
+
+TEST(SharedBackendLogTest, TestThreadConfig)
+{
+    ThreadConfig config;
+    config.name = "elk_backend";
+    LogBackend backend(1, 2, std::chrono::milliseconds(1), std::chrono::milliseconds(10),
+                       LogBackend::DEFAULT_WRITER_QUEUE_SIZE, config);
+    EXPECT_EQ(Status::OK, backend.thread_config_status());
+
+    config.cpus = {-1};
+    LogBackend invalid_backend(1, 1, std::chrono::milliseconds(1), std::chrono::milliseconds(10),
+                               LogBackend::DEFAULT_WRITER_QUEUE_SIZE, config);
+    EXPECT_EQ(Status::FAILED_TO_CONFIGURE_THREAD, invalid_backend.thread_config_status());
+}
+
+namespace {
+
+constexpr int OVERFLOW_TEST_MESSAGES = 10000;
+constexpr size_t OVERFLOW_TEST_QUEUE_SIZE = 4;
+
+} // namespace
+
+TEST(OverflowPolicyLogTest, TestDiscardNew)
+{
+    std::remove("./overflow_log.txt");
+    LogStats stats;
+    {
+        ElkLogger logger("info");
+        ASSERT_EQ(Status::OK, logger.initialize("./overflow_log.txt", "overflow_log", std::chrono::seconds(0), true, 1, 0,
+                                                ElkLogger::OverflowPolicy::DISCARD_NEW, OVERFLOW_TEST_QUEUE_SIZE));
+        for (int i = 0; i < OVERFLOW_TEST_MESSAGES; ++i)
+        {
+            logger.info("Message {}", i);
+        }
+        ASSERT_EQ(Status::OK, logger.flush(std::chrono::milliseconds(1000)));
+        stats = logger.stats();
+    }
+
+    // The writer can not keep up with a queue this small
+    EXPECT_GT(stats.dropped[static_cast<int>(RtLogLevel::INFO)], 0u);
+    EXPECT_EQ(0u, stats.overrun);
+    EXPECT_EQ(OVERFLOW_TEST_MESSAGES - static_cast<int>(stats.total_dropped()),
+              count_lines_with("./overflow_log.txt", "Message "));
+}
+
+#ifndef ELKLOG_SINGLE_WRITER_THREAD
+TEST(OverflowPolicyLogTest, TestOverrunOldest)
+{
+    std::remove("./overflow_log.txt");
+    LogStats stats;
+    {
+        ElkLogger logger("info");
+        ASSERT_EQ(Status::OK, logger.initialize("./overflow_log.txt", "overflow_log", std::chrono::seconds(0), true, 1, 0,
+                                                ElkLogger::OverflowPolicy::OVERRUN_OLDEST, OVERFLOW_TEST_QUEUE_SIZE));
+        for (int i = 0; i < OVERFLOW_TEST_MESSAGES; ++i)
+        {
+            logger.info("Message {}", i);
+        }
+        ASSERT_EQ(Status::OK, logger.flush(std::chrono::milliseconds(1000)));
+        stats = logger.stats();
+    }
+
+    EXPECT_GT(stats.overrun, 0u);
+    EXPECT_EQ(stats.overrun, stats.total_dropped());
+    // The newest message is never overwritten
+    EXPECT_LT(count_lines_with("./overflow_log.txt", "Message "), OVERFLOW_TEST_MESSAGES);
+    EXPECT_EQ(1, count_lines_with("./overflow_log.txt", fmt::format("Message {}", OVERFLOW_TEST_MESSAGES - 1)));
+}
+#endif
+
+namespace {
+
+// Long enough that messages are only written in time if they are flushed
+constexpr auto FLUSH_TEST_POLL_PERIOD = std::chrono::milliseconds(10000);
+
+void log_from_rt_thread(ElkLogger& logger, const std::string& message)
+{
+    std::thread rt_thread([&]()
+    {
+        twine::ThreadRtFlag rt_flag;
+        logger.info("{}", message);
+    });
+    rt_thread.join();
+}
+
+} // namespace
+
+TEST(FlushLogTest, TestFlush)
+{
+    std::remove("./flush_log.txt");
+    ElkLogger logger("info", ElkLogger::Type::TEXT, FLUSH_TEST_POLL_PERIOD, FLUSH_TEST_POLL_PERIOD, 0);
+    EXPECT_EQ(Status::FAILED_TO_FLUSH, logger.flush(std::chrono::milliseconds(100)));
+    ASSERT_EQ(Status::OK, logger.initialize("./flush_log.txt", "flush_log", std::chrono::seconds(0), true));
+
+    log_from_rt_thread(logger, "Rt message");
+    logger.info("Non-rt message");
+    EXPECT_EQ(Status::OK, logger.flush(std::chrono::milliseconds(1000)));
+    EXPECT_EQ(1, count_lines_with("./flush_log.txt", "Rt message"));
+    EXPECT_EQ(1, count_lines_with("./flush_log.txt", "Non-rt message"));
+}
+
+TEST(FlushLogTest, TestDrainedOnDestruction)
+{
+    std::remove("./flush_log.txt");
+    auto start = std::chrono::steady_clock::now();
+    {
+        ElkLogger logger("info", ElkLogger::Type::TEXT, FLUSH_TEST_POLL_PERIOD, FLUSH_TEST_POLL_PERIOD, 0);
+        ASSERT_EQ(Status::OK, logger.initialize("./flush_log.txt", "flush_log", std::chrono::seconds(0), true));
+        log_from_rt_thread(logger, "Last rt message");
+    }
+    // The consumer is woken up instead of finishing its poll period
+    EXPECT_LT(std::chrono::steady_clock::now() - start, FLUSH_TEST_POLL_PERIOD / 10);
+    EXPECT_EQ(1, count_lines_with("./flush_log.txt", "Last rt message"));
+}
+
+namespace {
+
+// The local time at the start of a text log line, i.e. "[2023-05-04 12:00:00.123] "
+std::chrono::system_clock::time_point parse_line_time(const std::string& line)
+{
+    std::tm time = {};
+    int milliseconds = 0;
+    char separator;
+    std::istringstream stream(line.substr(1));
+    stream >> std::get_time(&time, "%Y-%m-%d %H:%M:%S") >> separator >> milliseconds;
+    time.tm_isdst = -1;
+    return std::chrono::system_clock::from_time_t(std::mktime(&time)) + std::chrono::milliseconds(milliseconds);
+}
+
+} // namespace
+
+TEST(ThreadIdentityLogTest, TestTimeAndThreadOfRtMessages)
+{
+    constexpr auto CONSUMER_DELAY = std::chrono::milliseconds(500);
+    std::remove("./thread_identity_log.txt");
+    // Only consumed when flushed, well after the message was logged
+    ElkLogger logger("info", ElkLogger::Type::TEXT, FLUSH_TEST_POLL_PERIOD, FLUSH_TEST_POLL_PERIOD, 0);
+    ASSERT_EQ(Status::OK, logger.initialize("./thread_identity_log.txt", "thread_identity_log", std::chrono::seconds(0), true));
+
+    std::chrono::system_clock::time_point logged_at;
+    long rt_thread_id = 0;
+    std::thread rt_thread([&]()
+    {
+        twine::ThreadRtFlag rt_flag;
+        rt_thread_id = ::syscall(SYS_gettid);
+        logged_at = std::chrono::system_clock::now();
+        logger.info("Rt message");
+    });
+    rt_thread.join();
+    logger.info("Non-rt message");
+    std::this_thread::sleep_for(CONSUMER_DELAY);
+    ASSERT_EQ(Status::OK, logger.flush(std::chrono::milliseconds(1000)));
+
+    auto lines = read_lines("./thread_identity_log.txt");
+    auto rt_line = std::find_if(lines.begin(), lines.end(), [](const auto& line) { return line.find("Rt message") != std::string::npos; });
+    ASSERT_NE(lines.end(), rt_line);
+    EXPECT_NE(std::string::npos, rt_line->find(fmt::format("[info] [{}] Rt message", rt_thread_id)));
+    // The time of the rt thread, not of the consumer
+    EXPECT_LT(std::chrono::abs(parse_line_time(*rt_line) - logged_at), CONSUMER_DELAY / 2);
+
+    EXPECT_EQ(1, count_lines_with("./thread_identity_log.txt",
+                                  fmt::format("[info] [{}] Non-rt message", ::syscall(SYS_gettid))));
+}
@@ -0,0 +1,96 @@
+#include "gtest/gtest.h"
+
+#include "elklog/format_string.h"
+#include "elklog/rtlogmessage.h"
+
+using namespace elklog;
+
+static_assert(is_valid_format<>("No args"));
+static_assert(is_valid_format<>("Escaped {{}}"));
+static_assert(is_valid_format<int, const char*>("{} and {}"));
+static_assert(is_valid_format<int, float>("{1} and {0}"));
+static_assert(is_valid_format<int, std::string>("{:>8d} {:s}"));
+static_assert(is_valid_format<double, int>("{:.{}f}"));
+static_assert(is_valid_format<double, int>("{0:{1}}"));
+static_assert(is_valid_format<double, int, int>("{0:{2}.{1}f} {0}"));
+static_assert(is_valid_format<int, double>("{:L} {:.2Lf}"));
+static_assert(is_valid_format<int>("{:Ld}"));
+static_assert(is_valid_format<int, int>("{}"));  // Unused args are allowed, as in fmt
+
+static_assert(is_valid_format<int>("{:x}"));
+static_assert(is_valid_format<char>("{:c}"));
+static_assert(is_valid_format<bool>("{:s}"));
+static_assert(is_valid_format<void*>("{:p}"));
+
+static_assert(is_valid_format<int>("{} {}") == false);
+static_assert(is_valid_format<int>("{1}") == false);
+static_assert(is_valid_format<int, int>("{} {1}") == false);
+static_assert(is_valid_format<int>("{") == false);
+static_assert(is_valid_format<int>("}") == false);
+static_assert(is_valid_format<int>("{:d") == false);
+static_assert(is_valid_format<int>("{:f}") == false);
+static_assert(is_valid_format<float>("{:d}") == false);
+static_assert(is_valid_format<const char*>("{:d}") == false);
+static_assert(is_valid_format<double>("{:.{}f}") == false);
+static_assert(is_valid_format<double, int>("{0:{}}") == false);
+static_assert(is_valid_format<double, int>("{:{1}}") == false);
+static_assert(is_valid_format<double, int>("{0:{2}}") == false);
+static_assert(is_valid_format<float>("{:Ld}") == false);
+
+static_assert(is_static_format_v<const char*> == false);
+
+TEST(FormatStringTest, TestStaticFormat)
+{
+    auto format = ELKLOG_FORMAT("Value {}");
+    static_assert(is_static_format_v<decltype(format)>);
+    EXPECT_STREQ("Value {}", format_c_str(format));
+    EXPECT_STREQ("Plain {}", format_c_str("Plain {}"));
+
+    auto id = format_id(format);
+    ASSERT_NE(NO_FORMAT_ID, id);
+    EXPECT_EQ(id, format_id(format));
+    EXPECT_STREQ("Value {}", FormatRegistry::lookup(id));
+    EXPECT_EQ(NO_FORMAT_ID, format_id("Plain {}"));
+
+    // Each call site gets its own id
+    auto other = ELKLOG_FORMAT("Value {}");
+    EXPECT_NE(id, format_id(other));
+}
+
+TEST(FormatStringTest, TestCompiledFormat)
+{
+    auto format = ELKLOG_FORMAT("{:>6.2f}|{:x}|{}");
+    static_assert(fmt::detail::is_compiled_string<decltype(fmt_format(format))>::value);
+    EXPECT_EQ(fmt::format("{:>6.2f}|{:x}|{}", 1.234, 255, "str"), fmt::format(fmt_format(format), 1.234, 255, "str"));
+    EXPECT_EQ("Plain 1", fmt::format(fmt_format("Plain {}"), 1));
+
+    // Specs that fmt accepts are accepted as static formats
+    RtLogMessage<64> specs;
+    specs.set_message(RtLogLevel::INFO, std::chrono::nanoseconds(0), ELKLOG_FORMAT("{0:{1}}|{1:L}"), 1.5, 6);
+    EXPECT_EQ(fmt::format("{0:{1}}|{1:L}", 1.5, 6), specs.message());
+    specs.set_message(RtLogLevel::INFO, std::chrono::nanoseconds(0), ELKLOG_FORMAT("{:L}|{:.1Lf}"), 12, 1.25);
+    EXPECT_EQ(fmt::format("{:L}|{:.1Lf}", 12, 1.25), specs.message());
+
+    // Including the formatters of log arguments, and truncation
+    const float samples[] = {0.5f, 2.5f};
+    RtLogMessage<16> message;
+    message.set_message(RtLogLevel::INFO, std::chrono::nanoseconds(0), ELKLOG_FORMAT("Samples {:.2f}"), span(samples));
+    EXPECT_STREQ("Samples [0.50, ", message.message());
+}
+
+TEST(FormatStringTest, TestRtMessageFormatId)
+{
+    RtLogMessage<128> message;
+    auto format = ELKLOG_FORMAT("Rt {} {}");
+    message.set_deferred_message(RtLogLevel::INFO, std::chrono::nanoseconds(0), format, 1, 2.5f);
+    EXPECT_EQ(format_id(format), message.format_id());
+    EXPECT_STREQ("Rt {} {}", message.format_str());
+
+    message.format_deferred();
+    EXPECT_EQ(NO_FORMAT_ID, message.format_id());
+    EXPECT_STREQ("Rt 1 2.5", message.message());
+
+    message.set_message(RtLogLevel::INFO, std::chrono::nanoseconds(0), ELKLOG_FORMAT("Text {}"), "message");
+    EXPECT_EQ(NO_FORMAT_ID, message.format_id());
+    EXPECT_STREQ("Text message", message.message());
+}
@@ -0,0 +1,116 @@
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "elklog/log_telemetry.h"
+#include "elklog/rtlogger.h"
+
+using namespace elklog;
+
+constexpr auto TEST_POLL_PERIOD = std::chrono::milliseconds(1);
+constexpr auto TEST_WAIT_TIME = std::chrono::milliseconds(50);
+#ifdef ELKLOG_RT_VARIABLE_LENGTH_QUEUE
+constexpr size_t TEST_QUEUE_SIZE = 2048; // In bytes
+#else
+constexpr size_t TEST_QUEUE_SIZE = 16;
+#endif
+
+TEST(LogHistogramTest, TestBuckets)
+{
+    // Exact below the number of sub buckets
+    for (uint64_t value = 0; value < HISTOGRAM_SUB_BUCKETS; ++value)
+    {
+        EXPECT_EQ(static_cast<int>(value), histogram_bucket(value));
+    }
+    for (uint64_t value : {8u, 9u, 15u, 16u, 17u, 100u, 1000u, 123456u, 1000000007u})
+    {
+        int bucket = histogram_bucket(value);
+        EXPECT_LE(histogram_bucket_min(bucket), value);
+        EXPECT_GE(histogram_bucket_max(bucket), value);
+        // At most 12.5% wide
+        EXPECT_LE(histogram_bucket_max(bucket) - histogram_bucket_min(bucket), histogram_bucket_min(bucket) / 8);
+    }
+    EXPECT_EQ(histogram_bucket(16) + 1, histogram_bucket(18));
+    EXPECT_EQ(HISTOGRAM_BUCKETS - 1, histogram_bucket(uint64_t(1) << 50));
+}
+
+TEST(LogHistogramTest, TestSnapshot)
+{
+    LogHistogram module_under_test;
+    EXPECT_EQ(0u, module_under_test.snapshot().percentile(50));
+
+    for (uint64_t value = 1; value <= 100; ++value)
+    {
+        module_under_test.record(value);
+    }
+    auto snapshot = module_under_test.snapshot();
+    EXPECT_EQ(100u, snapshot.count);
+    EXPECT_EQ(5050u, snapshot.sum);
+    EXPECT_EQ(100u, snapshot.max);
+    EXPECT_DOUBLE_EQ(50.5, snapshot.mean());
+    // The upper bound of the bucket of the 50th value
+    EXPECT_EQ(histogram_bucket_max(histogram_bucket(50)), snapshot.percentile(50));
+    EXPECT_EQ(100u, snapshot.percentile(99));
+    EXPECT_EQ(1u, snapshot.percentile(0));
+    EXPECT_EQ("count 100, mean 50.5, p50 51, p90 95, p99 100, max 100", snapshot.summary());
+
+    module_under_test.reset();
+    EXPECT_EQ(0u, module_under_test.snapshot().count);
+    EXPECT_EQ(0u, module_under_test.snapshot().max);
+}
+
+#ifdef ELKLOG_RT_TELEMETRY
+TEST(LogTelemetryTest, TestRtLoggerTelemetry)
+{
+    std::mutex mutex;
+    std::vector<std::string> received;
+    RtLogger<256, TEST_QUEUE_SIZE> logger(TEST_POLL_PERIOD, [&](const RtLogMessage<256>& msg)
+    {
+        std::scoped_lock lock(mutex);
+        received.emplace_back(msg.message());
+    }, "info");
+
+    logger.log_info("12345");
+    logger.log_info("1234567890");
+    ASSERT_TRUE(logger.drain(std::chrono::milliseconds(1000)));
+
+    auto telemetry = logger.telemetry();
+    EXPECT_EQ(2u, telemetry.producer_cost.count);
+    EXPECT_GT(telemetry.producer_cost.max, 0u);
+    EXPECT_EQ(2u, telemetry.message_size.count);
+    EXPECT_EQ(15u, telemetry.message_size.sum);
+    EXPECT_EQ(10u, telemetry.message_size.max);
+    EXPECT_EQ(2u, telemetry.queue_latency.count);
+
+    logger.set_telemetry_report_period(TEST_POLL_PERIOD);
+    logger.log_info("Wake up");
+    ASSERT_TRUE(logger.drain(std::chrono::milliseconds(1000)));
+    std::this_thread::sleep_for(TEST_WAIT_TIME);
+    logger.set_telemetry_report_period(std::chrono::milliseconds(0));
+    {
+        std::scoped_lock lock(mutex);
+        auto report = std::find_if(received.begin(), received.end(), [](const std::string& message)
+        {
+            return message.find("Rt message size (bytes): count 3") == 0;
+        });
+        EXPECT_NE(received.end(), report);
+    }
+
+    logger.reset_telemetry();
+    EXPECT_EQ(0u, logger.telemetry().message_size.count);
+}
+#else
+TEST(LogTelemetryTest, TestCompiledOut)
+{
+    RtLogger<256, TEST_QUEUE_SIZE> logger(TEST_POLL_PERIOD, [](const RtLogMessage<256>& /*msg*/) {}, "info");
+    logger.log_info("Not recorded");
+    ASSERT_TRUE(logger.drain(std::chrono::milliseconds(1000)));
+    EXPECT_EQ(0u, logger.telemetry().producer_cost.count);
+    EXPECT_EQ(0u, logger.telemetry().message_size.count);
+}
+#endif
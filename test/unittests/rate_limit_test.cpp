@@ -0,0 +1,39 @@
+#include <thread>
+
+#include "gtest/gtest.h"
+
+#include "elklog/rate_limit.h"
+
+using namespace elklog;
+
+TEST(RateLimitTest, TestEveryN)
+{
+    EveryN limiter(3);
+    int passed = 0;
+    for (int i = 0; i < 10; ++i)
+    {
+        if (limiter.should_log())
+        {
+            passed++;
+            EXPECT_EQ(0, i % 3);
+        }
+    }
+    EXPECT_EQ(4, passed);
+
+    // 0 is treated as 1, i.e. no limit
+    EveryN no_limit(0);
+    EXPECT_TRUE(no_limit.should_log());
+    EXPECT_TRUE(no_limit.should_log());
+}
+
+TEST(RateLimitTest, TestEveryInterval)
+{
+    EveryInterval limiter(std::chrono::milliseconds(50));
+    EXPECT_TRUE(limiter.should_log());
+    EXPECT_FALSE(limiter.should_log());
+    EXPECT_FALSE(limiter.should_log());
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(60));
+    EXPECT_TRUE(limiter.should_log());
+    EXPECT_FALSE(limiter.should_log());
+}
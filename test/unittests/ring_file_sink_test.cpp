@@ -0,0 +1,120 @@
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+#include "gtest/gtest.h"
+
+#include "elklog/ring_file_sink.h"
+#include "elklog/elk_logger.h"
+
+using namespace elklog;
+
+constexpr size_t TEST_RING_SIZE = 1024;
+
+std::vector<std::string> split_lines(const std::string& content)
+{
+    std::vector<std::string> lines;
+    std::istringstream stream(content);
+    std::string line;
+    while (std::getline(stream, line))
+    {
+        lines.push_back(line);
+    }
+    return lines;
+}
+
+std::shared_ptr<spdlog::logger> make_ring_logger(const std::string& path)
+{
+    auto logger = std::make_shared<spdlog::logger>("ring_test", std::make_shared<ring_file_sink_st>(path, TEST_RING_SIZE));
+    logger->set_pattern("%v");
+    return logger;
+}
+
+TEST(RingFileSinkTest, TestWriteAndRead)
+{
+    std::remove("./ring_test.ring");
+    {
+        auto logger = make_ring_logger("./ring_test.ring");
+        for (int i = 0; i < 5; ++i)
+        {
+            logger->info("Message {}", i);
+        }
+    }
+
+    std::string content;
+    ASSERT_TRUE(read_ring_file("./ring_test.ring", content));
+    EXPECT_EQ("Message 0\nMessage 1\nMessage 2\nMessage 3\nMessage 4\n", content);
+}
+
+TEST(RingFileSinkTest, TestWrapAround)
+{
+    std::remove("./ring_test.ring");
+    constexpr int MESSAGES = 200;
+    {
+        auto logger = make_ring_logger("./ring_test.ring");
+        for (int i = 0; i < MESSAGES; ++i)
+        {
+            logger->info("Message number {}", i);
+        }
+    }
+
+    std::string content;
+    ASSERT_TRUE(read_ring_file("./ring_test.ring", content));
+    EXPECT_LE(content.size(), TEST_RING_SIZE);
+    auto lines = split_lines(content);
+    ASSERT_GT(lines.size(), 10u);
+    // Only whole lines, and the newest ones
+    for (size_t i = 0; i < lines.size(); ++i)
+    {
+        EXPECT_EQ(fmt::format("Message number {}", MESSAGES - lines.size() + i), lines[i]);
+    }
+}
+
+TEST(RingFileSinkTest, TestReopen)
+{
+    std::remove("./ring_test.ring");
+    {
+        auto logger = make_ring_logger("./ring_test.ring");
+        logger->info("Before restart");
+    }
+    {
+        auto logger = make_ring_logger("./ring_test.ring");
+        logger->info("After restart");
+    }
+
+    std::string content;
+    ASSERT_TRUE(read_ring_file("./ring_test.ring", content));
+    EXPECT_EQ("Before restart\nAfter restart\n", content);
+}
+
+TEST(RingFileSinkTest, TestInvalidFile)
+{
+    std::string content;
+    EXPECT_FALSE(read_ring_file("./no_such_file.ring", content));
+    {
+        std::ofstream file("./not_a_ring.txt");
+        file << std::string(RING_FILE_HEADER_SIZE + 16, 'x');
+    }
+    EXPECT_FALSE(read_ring_file("./not_a_ring.txt", content));
+}
+
+TEST(RingFileSinkTest, TestElkLoggerRingFile)
+{
+    std::remove("./elk_ring_log.ring");
+    {
+        ElkLogger logger("info");
+        ASSERT_EQ(Status::OK, logger.initialize("./elk_ring_log.ring", "elk_ring_log", std::chrono::seconds(0),
+                                                true, 1, 64 * 1024));
+        logger.info("Ring message {}", 1);
+        ASSERT_EQ(Status::OK, logger.flush(std::chrono::milliseconds(1000)));
+    }
+
+    std::string content;
+    ASSERT_TRUE(read_ring_file("./elk_ring_log.ring", content));
+    EXPECT_NE(std::string::npos, content.find("Started logger: elk_ring_log."));
+    EXPECT_NE(std::string::npos, content.find("Ring message 1"));
+
+    ElkLogger binary_logger("info", ElkLogger::Type::BINARY);
+    EXPECT_EQ(Status::FAILED_TO_START_LOGGER, binary_logger.initialize("./elk_ring_log.bin", "elk_ring_binary",
+                                                                       std::chrono::seconds(0), true, 1, 64 * 1024));
+}
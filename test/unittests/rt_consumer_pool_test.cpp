@@ -0,0 +1,87 @@
+#include <pthread.h>
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "gtest/gtest.h"
+
+#include "elklog/rt_consumer_pool.h"
+
+using namespace elklog;
+
+constexpr auto TEST_POLL_PERIOD = std::chrono::milliseconds(1);
+constexpr auto TEST_WAIT_TIME = std::chrono::milliseconds(50);
+
+TEST(RtConsumerPoolTest, TestAddAndRemove)
+{
+    RtConsumerPool module_under_test(2, TEST_POLL_PERIOD, TEST_POLL_PERIOD);
+    EXPECT_EQ(2, module_under_test.threads());
+
+    std::atomic<int> calls_1 {0};
+    std::atomic<int> calls_2 {0};
+    auto registration_1 = module_under_test.add([&]() { calls_1++; return size_t(0); });
+    auto registration_2 = module_under_test.add([&]() { calls_2++; return size_t(0); });
+
+    // Spread over the workers
+    EXPECT_NE(registration_1.worker, registration_2.worker);
+    EXPECT_EQ(1, module_under_test.load()[0]);
+    EXPECT_EQ(1, module_under_test.load()[1]);
+    ASSERT_NE(nullptr, registration_1.wakeup);
+
+    std::this_thread::sleep_for(TEST_WAIT_TIME);
+    EXPECT_GT(calls_1, 0);
+    EXPECT_GT(calls_2, 0);
+
+    module_under_test.remove(registration_1);
+    int calls_after_remove = calls_1;
+    std::this_thread::sleep_for(TEST_WAIT_TIME);
+    EXPECT_EQ(calls_after_remove, calls_1);
+    EXPECT_EQ(0, module_under_test.load()[registration_1.worker]);
+
+    module_under_test.remove(registration_2);
+}
+
+TEST(RtConsumerPoolTest, TestWakeup)
+{
+    // Only the wakeup should trigger a pass within the test
+    RtConsumerPool module_under_test(1, std::chrono::milliseconds(10000), std::chrono::milliseconds(10000));
+    std::atomic<int> calls {0};
+    auto registration = module_under_test.add([&]() { calls++; return size_t(0); });
+    std::this_thread::sleep_for(TEST_WAIT_TIME);
+
+    int calls_before = calls;
+    std::this_thread::sleep_for(TEST_WAIT_TIME);
+    EXPECT_EQ(calls_before, calls);
+    registration.wakeup->notify();
+    std::this_thread::sleep_for(TEST_WAIT_TIME);
+    EXPECT_EQ(calls_before + 1, calls);
+
+    module_under_test.remove(registration);
+}
+
+TEST(RtConsumerPoolTest, TestThreadConfig)
+{
+    ThreadConfig config;
+    config.name = "elk_pool";
+    RtConsumerPool module_under_test(1, TEST_POLL_PERIOD, TEST_POLL_PERIOD, config);
+    EXPECT_EQ(Status::OK, module_under_test.thread_config_status());
+
+    std::mutex mutex;
+    std::string name;
+    auto registration = module_under_test.add([&]()
+    {
+        char buffer[16] = {};
+        pthread_getname_np(pthread_self(), buffer, sizeof(buffer));
+        std::scoped_lock lock(mutex);
+        name = buffer;
+        return size_t(0);
+    });
+    std::this_thread::sleep_for(TEST_WAIT_TIME);
+    module_under_test.remove(registration);
+
+    std::scoped_lock lock(mutex);
+    EXPECT_EQ("elk_pool", name);
+}
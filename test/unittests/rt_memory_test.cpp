@@ -0,0 +1,40 @@
+#include <new>
+#include <numeric>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "elklog/rt_memory.h"
+
+using namespace elklog;
+
+TEST(RtMemoryTest, TestPrefaultKeepsContent)
+{
+    // Several pages, not a multiple of the page size
+    std::vector<uint8_t> buffer(3 * 4096 + 100);
+    std::iota(buffer.begin(), buffer.end(), 0);
+    auto expected = buffer;
+
+    prefault_memory(buffer.data(), buffer.size());
+    EXPECT_EQ(expected, buffer);
+
+    // Empty ranges are ignored
+    prefault_memory(buffer.data(), 0);
+    EXPECT_EQ(expected, buffer);
+}
+
+TEST(RtMemoryTest, TestLockMemory)
+{
+    // A page of its own, as unlocking also unlocks anything else on the page
+    constexpr size_t SIZE = 4096;
+    auto buffer = static_cast<uint8_t*>(::operator new(SIZE, std::align_val_t(SIZE)));
+    // May fail depending on RLIMIT_MEMLOCK, but must not change the content
+    bool locked = lock_memory(buffer, SIZE);
+    buffer[0] = 1;
+    if (locked)
+    {
+        unlock_memory(buffer, SIZE);
+    }
+    EXPECT_EQ(1, buffer[0]);
+    ::operator delete(buffer, std::align_val_t(SIZE));
+}
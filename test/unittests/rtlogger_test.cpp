@@ -0,0 +1,379 @@
+#include <pthread.h>
+
+#include <algorithm>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "elklog/rtlogger.h"
+
+using namespace elklog;
+
+constexpr auto TEST_POLL_PERIOD = std::chrono::milliseconds(1);
+constexpr auto TEST_WAIT_TIME = std::chrono::milliseconds(50);
+#ifdef ELKLOG_RT_VARIABLE_LENGTH_QUEUE
+constexpr size_t TEST_QUEUE_SIZE = 2048; // In bytes
+constexpr size_t TEST_ERROR_QUEUE_SIZE = 2048;
+constexpr size_t TEST_BATCH_QUEUE_SIZE = 16384;
+#else
+constexpr size_t TEST_QUEUE_SIZE = 16;
+constexpr size_t TEST_ERROR_QUEUE_SIZE = 4;
+constexpr size_t TEST_BATCH_QUEUE_SIZE = 64;
+#endif
+
+class RtLoggerTest : public ::testing::Test
+{
+protected:
+    void SetUp()
+    {
+        _module_under_test = std::make_unique<RtLogger<256, TEST_QUEUE_SIZE>>(TEST_POLL_PERIOD,
+                [this](const RtLogMessage<256>& msg) { _callback(msg); },
+                "info");
+    }
+
+    void _callback(const RtLogMessage<256>& msg)
+    {
+        std::scoped_lock lock(_mutex);
+        _received.emplace_back(msg.message());
+        _levels.push_back(msg.level());
+        _thread_ids.push_back(msg.thread_id());
+    }
+
+    std::vector<std::string> _wait_for_messages()
+    {
+        std::this_thread::sleep_for(TEST_WAIT_TIME);
+        std::scoped_lock lock(_mutex);
+        return _received;
+    }
+
+    std::mutex _mutex;
+    std::vector<std::string> _received;
+    std::vector<RtLogLevel> _levels;
+    std::vector<uint32_t> _thread_ids;
+    std::unique_ptr<RtLogger<256, TEST_QUEUE_SIZE>> _module_under_test;
+};
+
+TEST_F(RtLoggerTest, TestLogging)
+{
+    _module_under_test->log_info("Message {} {}", 1, "with string");
+    _module_under_test->log_warning("Message {}", 2.5f);
+    // Below the minimum level and should be filtered
+    _module_under_test->log_debug("Message {}", 3);
+
+    auto messages = _wait_for_messages();
+    ASSERT_EQ(2u, messages.size());
+    EXPECT_EQ("Message 1 with string", messages[0]);
+    EXPECT_EQ("Message 2.5", messages[1]);
+    EXPECT_EQ(RtLogLevel::INFO, _levels[0]);
+    EXPECT_EQ(RtLogLevel::WARNING, _levels[1]);
+
+    auto stats = _module_under_test->stats();
+    EXPECT_EQ(2u, stats.pushed);
+    EXPECT_EQ(2u, stats.consumed);
+    EXPECT_EQ(1u, stats.filtered);
+    EXPECT_EQ(0u, stats.total_dropped());
+}
+
+TEST_F(RtLoggerTest, TestThreadIdentity)
+{
+    std::thread thread_1([&]() { _module_under_test->log_info("Thread 1"); });
+    thread_1.join();
+    std::thread thread_2([&]() { _module_under_test->log_info("Thread 2"); });
+    thread_2.join();
+
+    auto messages = _wait_for_messages();
+    ASSERT_EQ(2u, messages.size());
+    EXPECT_NE(0u, _thread_ids[0]);
+    EXPECT_NE(0u, _thread_ids[1]);
+    EXPECT_NE(_thread_ids[0], _thread_ids[1]);
+}
+
+TEST_F(RtLoggerTest, TestBoundLogging)
+{
+    std::thread thread_1([&]()
+    {
+        auto binding = _module_under_test->bind_thread();
+        _module_under_test->log_bound<RtLogLevel::INFO>(binding, "Bound {}", 1);
+        _module_under_test->log_bound<RtLogLevel::DEBUG>(binding, "Bound {}", 2);
+        _module_under_test->log_bound<RtLogLevel::WARNING>(binding, "Bound {}", 3);
+    });
+    thread_1.join();
+
+    auto messages = _wait_for_messages();
+    ASSERT_EQ(2u, messages.size());
+    EXPECT_EQ("Bound 1", messages[0]);
+    EXPECT_EQ("Bound 3", messages[1]);
+    EXPECT_EQ(RtLogLevel::WARNING, _levels[1]);
+    EXPECT_EQ(_thread_ids[0], _thread_ids[1]);
+    EXPECT_EQ(1u, _module_under_test->stats().filtered);
+}
+
+TEST_F(RtLoggerTest, TestCollapseRepeated)
+{
+    _module_under_test = std::make_unique<RtLogger<256, TEST_QUEUE_SIZE>>(TEST_POLL_PERIOD,
+            [this](const RtLogMessage<256>& msg) { _callback(msg); },
+            "info", 0, std::chrono::milliseconds(0), true, true);
+
+    _module_under_test->log_warning("Message {}", 1);
+    for (int i = 0; i < 5; ++i)
+    {
+        _module_under_test->log_warning("Repeated message {}", 2);
+    }
+    _module_under_test->log_warning("Message {}", 3);
+    // Same text but different level is not a repeat
+    _module_under_test->log_error("Message {}", 3);
+
+    auto messages = _wait_for_messages();
+    ASSERT_EQ(5u, messages.size());
+    EXPECT_EQ("Message 1", messages[0]);
+    EXPECT_EQ("Repeated message 2", messages[1]);
+    EXPECT_EQ("Last message repeated 4 times", messages[2]);
+    EXPECT_EQ(RtLogLevel::WARNING, _levels[2]);
+    EXPECT_EQ("Message 3", messages[3]);
+    EXPECT_EQ("Message 3", messages[4]);
+    EXPECT_EQ(RtLogLevel::ERROR, _levels[4]);
+    EXPECT_EQ(8u, _module_under_test->stats().consumed);
+}
+
+TEST_F(RtLoggerTest, TestQueueFull)
+{
+    // More messages than the queue can hold before the consumer runs. Those
+    // that don't fit are dropped but the ones in the queue are kept in order.
+    for (int i = 0; i < 100; ++i)
+    {
+        _module_under_test->log_error("Message {}", i);
+    }
+
+    auto messages = _wait_for_messages();
+    ASSERT_GE(messages.size(), 1u);
+    ASSERT_LE(messages.size(), 100u);
+    EXPECT_EQ("Message 0", messages[0]);
+
+    auto stats = _module_under_test->stats();
+    EXPECT_EQ(100u, stats.pushed + stats.total_dropped());
+    EXPECT_EQ(stats.total_dropped(), stats.dropped[static_cast<int>(RtLogLevel::ERROR)]);
+    EXPECT_EQ(stats.pushed, stats.consumed);
+    EXPECT_GE(stats.queue_high_water_mark, 1u);
+    EXPECT_LE(stats.queue_high_water_mark, stats.pushed);
+}
+
+TEST_F(RtLoggerTest, TestDropReport)
+{
+    for (int i = 0; i < 100; ++i)
+    {
+        _module_under_test->log_error("Message {}", i);
+    }
+    auto dropped = _module_under_test->stats().total_dropped();
+    // Drops are reported at most once per second
+    std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+
+    std::scoped_lock lock(_mutex);
+    ASSERT_FALSE(_received.empty());
+    EXPECT_EQ(fmt::format("{} log messages dropped, queue full", dropped), _received.back());
+    EXPECT_EQ(RtLogLevel::WARNING, _levels.back());
+}
+
+TEST_F(RtLoggerTest, TestStructuredFields)
+{
+    _module_under_test->log_info("Text fields", kv("cpu", 0.5f), kv("name", "main"));
+    std::this_thread::sleep_for(TEST_WAIT_TIME);
+    _module_under_test->set_field_encoding(FieldEncoding::JSON);
+    _module_under_test->log_info("Json fields", kv("cpu", 0.5f), kv("name", "main"));
+
+    auto received = _wait_for_messages();
+    ASSERT_EQ(2u, received.size());
+    EXPECT_EQ("Text fields cpu=0.5 name=main", received[0]);
+    EXPECT_EQ(R"({"message": "Json fields", "cpu": 0.5, "name": "main"})", received[1]);
+}
+
+TEST(RtLoggerWakeupTest, TestWakeupOnThreshold)
+{
+    std::atomic<int> received = 0;
+    // Long poll period, so messages are only received quickly if the
+    // consumer is woken up by the threshold
+    RtLogger<256, TEST_QUEUE_SIZE> module_under_test(std::chrono::milliseconds(10000),
+            [&](const RtLogMessage<256>& /*msg*/) { received++; },
+            "info", 4);
+
+    // Let the consumer thread start and go to sleep
+    std::this_thread::sleep_for(TEST_WAIT_TIME);
+    for (int i = 0; i < 4; ++i)
+    {
+        module_under_test.log_info("Message {}", i);
+    }
+    std::this_thread::sleep_for(TEST_WAIT_TIME);
+    EXPECT_EQ(4, received);
+}
+
+TEST(RtLoggerErrorQueueTest, TestErrorsNotDropped)
+{
+    std::mutex mutex;
+    std::vector<std::string> received;
+    std::vector<std::chrono::nanoseconds> timestamps;
+    RtLogger<256, TEST_QUEUE_SIZE, TEST_ERROR_QUEUE_SIZE> module_under_test(TEST_POLL_PERIOD, [&](const RtLogMessage<256>& msg)
+    {
+        std::scoped_lock lock(mutex);
+        received.emplace_back(msg.message());
+        timestamps.push_back(msg.timestamp());
+    }, "info");
+
+    // Fill up the main queue so that the rest are dropped
+    module_under_test.log_info("Info {}", 0);
+    for (int i = 1; i < 100; ++i)
+    {
+        module_under_test.log_info("Info {}", i);
+        if (i == 50)
+        {
+            module_under_test.log_error("Error {}", i);
+        }
+    }
+
+    std::this_thread::sleep_for(TEST_WAIT_TIME);
+    std::scoped_lock lock(mutex);
+    ASSERT_GT(received.size(), 1u);
+    EXPECT_LT(received.size(), 100u);
+    EXPECT_EQ("Info 0", received.front());
+    EXPECT_NE(received.end(), std::find(received.begin(), received.end(), "Error 50"));
+    EXPECT_EQ(0u, module_under_test.stats().dropped[static_cast<int>(RtLogLevel::ERROR)]);
+    EXPECT_TRUE(std::is_sorted(timestamps.begin(), timestamps.end()));
+}
+
+TEST(RtLoggerThreadConfigTest, TestConsumerThreadConfig)
+{
+    std::mutex mutex;
+    std::string thread_name;
+    RtLogger<256, TEST_QUEUE_SIZE> module_under_test(TEST_POLL_PERIOD, [&](const RtLogMessage<256>& /*msg*/)
+    {
+        char buffer[16] = {};
+        pthread_getname_np(pthread_self(), buffer, sizeof(buffer));
+        std::scoped_lock lock(mutex);
+        thread_name = buffer;
+    }, "info");
+
+    ThreadConfig config;
+    config.name = "elk_consumer";
+    EXPECT_EQ(Status::OK, module_under_test.set_consumer_thread_config(config));
+    config.cpus = {-1};
+    EXPECT_EQ(Status::FAILED_TO_CONFIGURE_THREAD, module_under_test.set_consumer_thread_config(config));
+
+    module_under_test.log_info("Message");
+    EXPECT_TRUE(module_under_test.drain(std::chrono::milliseconds(1000)));
+    std::scoped_lock lock(mutex);
+    EXPECT_EQ("elk_consumer", thread_name);
+}
+
+TEST(RtLoggerPoolTest, TestSharedConsumer)
+{
+    std::mutex mutex;
+    std::vector<std::string> received;
+    auto callback = [&](const RtLogMessage<256>& msg)
+    {
+        std::scoped_lock lock(mutex);
+        received.emplace_back(msg.message());
+    };
+    RtConsumerPool pool(1, TEST_POLL_PERIOD, TEST_POLL_PERIOD);
+    {
+        RtLogger<256, TEST_QUEUE_SIZE> logger_1(TEST_POLL_PERIOD, callback, "info", 0,
+                                                std::chrono::milliseconds(0), true, false, nullptr, &pool);
+        RtLogger<256, TEST_QUEUE_SIZE> logger_2(TEST_POLL_PERIOD, callback, "info", 0,
+                                                std::chrono::milliseconds(0), true, false, nullptr, &pool);
+        EXPECT_EQ(2, pool.load()[0]);
+
+        logger_1.log_info("From logger {}", 1);
+        logger_2.log_info("From logger {}", 2);
+        EXPECT_TRUE(logger_1.drain(std::chrono::milliseconds(1000)));
+        EXPECT_TRUE(logger_2.drain(std::chrono::milliseconds(1000)));
+    }
+    // Removed from the pool when destroyed
+    EXPECT_EQ(0, pool.load()[0]);
+
+    std::scoped_lock lock(mutex);
+    ASSERT_EQ(2u, received.size());
+    EXPECT_NE(received.end(), std::find(received.begin(), received.end(), "From logger 1"));
+    EXPECT_NE(received.end(), std::find(received.begin(), received.end(), "From logger 2"));
+}
+
+TEST(RtLoggerShutdownTest, TestDrainedOnDestruction)
+{
+    constexpr auto LONG_POLL_PERIOD = std::chrono::milliseconds(10000);
+    std::atomic<int> received = 0;
+    RtConsumerPool pool(1, LONG_POLL_PERIOD, LONG_POLL_PERIOD);
+    auto start = std::chrono::steady_clock::now();
+    {
+        RtLogger<256, TEST_QUEUE_SIZE> logger(LONG_POLL_PERIOD, [&](const RtLogMessage<256>& /*msg*/) { received++; }, "info");
+        RtLogger<256, TEST_QUEUE_SIZE> pool_logger(LONG_POLL_PERIOD, [&](const RtLogMessage<256>& /*msg*/) { received++; },
+                                                   "info", 0, std::chrono::milliseconds(0), true, false, nullptr, &pool);
+        // Let the consumers go to sleep
+        std::this_thread::sleep_for(TEST_WAIT_TIME);
+        logger.log_info("Message");
+        pool_logger.log_info("Message");
+    }
+    EXPECT_EQ(2, received);
+    // Without waiting for the poll period
+    EXPECT_LT(std::chrono::steady_clock::now() - start, LONG_POLL_PERIOD / 10);
+}
+
+TEST(RtLoggerBatchTest, TestBatchCallback)
+{
+    using TestLogger = RtLogger<256, TEST_BATCH_QUEUE_SIZE>;
+    constexpr int MESSAGES = TestLogger::CONSUMER_BATCH_SIZE + 8;
+    std::mutex mutex;
+    std::vector<std::string> received;
+    std::vector<size_t> batch_sizes;
+    // Only woken up by the threshold, so all messages are queued when it runs
+    TestLogger module_under_test(std::chrono::milliseconds(10000), [&](const RtLogBatch<256>& batch)
+    {
+        std::scoped_lock lock(mutex);
+        batch_sizes.push_back(batch.size());
+        for (size_t i = 0; i < batch.size(); ++i)
+        {
+            received.emplace_back(batch[i].message());
+        }
+    }, "info", MESSAGES);
+
+    std::this_thread::sleep_for(TEST_WAIT_TIME);
+    for (int i = 0; i < MESSAGES; ++i)
+    {
+        module_under_test.log_info("Message {}", i);
+    }
+    std::this_thread::sleep_for(TEST_WAIT_TIME);
+
+    std::scoped_lock lock(mutex);
+    ASSERT_EQ(static_cast<size_t>(MESSAGES), received.size());
+    for (int i = 0; i < MESSAGES; ++i)
+    {
+        EXPECT_EQ(fmt::format("Message {}", i), received[i]);
+    }
+    ASSERT_EQ(2u, batch_sizes.size());
+    EXPECT_EQ(TestLogger::CONSUMER_BATCH_SIZE, batch_sizes[0]);
+    EXPECT_EQ(8u, batch_sizes[1]);
+}
+
+TEST(RtLoggerBatchTest, TestCollapseAcrossBatches)
+{
+    using TestLogger = RtLogger<256, TEST_BATCH_QUEUE_SIZE>;
+    constexpr int REPEATS = TestLogger::CONSUMER_BATCH_SIZE + 8;
+    std::mutex mutex;
+    std::vector<std::string> received;
+    TestLogger module_under_test(std::chrono::milliseconds(10000), [&](const RtLogMessage<256>& msg)
+    {
+        std::scoped_lock lock(mutex);
+        received.emplace_back(msg.message());
+    }, "info", REPEATS + 1, std::chrono::milliseconds(0), true, true);
+
+    std::this_thread::sleep_for(TEST_WAIT_TIME);
+    for (int i = 0; i < REPEATS; ++i)
+    {
+        module_under_test.log_info("Repeated {}", 1);
+    }
+    module_under_test.log_info("Message {}", 2);
+    std::this_thread::sleep_for(TEST_WAIT_TIME);
+
+    std::scoped_lock lock(mutex);
+    ASSERT_EQ(3u, received.size());
+    EXPECT_EQ("Repeated 1", received[0]);
+    EXPECT_EQ(fmt::format("Last message repeated {} times", REPEATS - 1), received[1]);
+    EXPECT_EQ("Message 2", received[2]);
+}
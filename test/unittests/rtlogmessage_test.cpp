@@ -1,3 +1,6 @@
+#include <string>
+#include <vector>
+
 #include "gtest/gtest.h"
 
 #include "elklog/rtlogmessage.h"
@@ -50,4 +53,166 @@ TEST(RtLogMessageTest, TestMaxSize)
     EXPECT_EQ(RtLogLevel::WARNING, module_under_test.level());
     EXPECT_EQ(23, module_under_test.length());
     EXPECT_STREQ(module_under_test.message(), msg_2.message());
-}
\ No newline at end of file
+}
+TEST(RtLogMessageTest, TestDeferredFormatting)
+{
+    RtLogMessage<512> module_under_test;
+
+    static_assert(RtLogMessage<512>::is_deferrable<int, float, bool>());
+    static_assert(!RtLogMessage<512>::is_deferrable<int, const char*>());
+
+    module_under_test.set_deferred_message(RtLogLevel::INFO, std::chrono::nanoseconds(123), "Test {}_{}_{}", 1, 2.5f, true);
+    EXPECT_TRUE(module_under_test.is_deferred());
+    EXPECT_EQ(std::chrono::nanoseconds(123), module_under_test.timestamp());
+    EXPECT_EQ(RtLogLevel::INFO, module_under_test.level());
+
+    // Copy before formatting to verify that the packed arguments are copied too
+    RtLogMessage<512> msg_2;
+    msg_2 = module_under_test;
+
+    module_under_test.format_deferred();
+    EXPECT_FALSE(module_under_test.is_deferred());
+    EXPECT_STREQ("Test 1_2.5_true", module_under_test.message());
+    EXPECT_EQ(15, module_under_test.length());
+
+    msg_2.format_deferred();
+    EXPECT_STREQ(module_under_test.message(), msg_2.message());
+}
+
+TEST(RtLogMessageTest, TestDeferredMaxSize)
+{
+    RtLogMessage<24> module_under_test;
+
+    module_under_test.set_deferred_message(RtLogLevel::WARNING, std::chrono::nanoseconds(123), "Test message is too long {}", 12345);
+    module_under_test.format_deferred();
+
+    EXPECT_STREQ("Test message is too lon", module_under_test.message());
+    EXPECT_EQ(23, module_under_test.length());
+}
+
+TEST(RtLogMessageTest, TestDeferredStringView)
+{
+    static_assert(RtLogMessage<512>::is_deferrable<int, std::string_view>());
+
+    RtLogMessage<512> module_under_test;
+    std::string name = "plugin";
+    module_under_test.set_deferred_message(RtLogLevel::INFO, std::chrono::nanoseconds(123), "Test {}_{}",
+                                           std::string_view(name), 2);
+    // Copied when captured
+    name = "changed";
+    module_under_test.format_deferred();
+    EXPECT_STREQ("Test plugin_2", module_under_test.message());
+
+    // Strings are truncated to what fits in the buffer along with the other arguments
+    RtLogMessage<16> short_message;
+    short_message.set_deferred_message(RtLogLevel::INFO, std::chrono::nanoseconds(123), "{}{}",
+                                       std::string_view("A long string that does not fit"), 1);
+    EXPECT_LT(short_message.length(), 16);
+    short_message.format_deferred();
+    EXPECT_STREQ("A long 1", short_message.message());
+}
+
+TEST(RtLogMessageTest, TestDeferredStringFillingBuffer)
+{
+    // The packed arguments must leave room for the null-termination that is
+    // copied by operator= and included in storage_size()
+    const std::string text(16, 'a');
+    RtLogMessage<16> module_under_test;
+    module_under_test.set_deferred_message(RtLogLevel::INFO, std::chrono::nanoseconds(123), "{}",
+                                           std::string_view(text));
+    EXPECT_EQ(15, module_under_test.length());
+    EXPECT_LE(module_under_test.storage_size(), sizeof(module_under_test));
+
+    RtLogMessage<16> copy;
+    copy = module_under_test;
+    copy.format_deferred();
+    EXPECT_STREQ("aaaaaaaaaaa", copy.message());
+
+    module_under_test.set_structured_message(RtLogLevel::INFO, std::chrono::nanoseconds(123), "",
+                                             kv("s", std::string_view(text)));
+    EXPECT_LT(module_under_test.length(), 16);
+    EXPECT_LE(module_under_test.storage_size(), sizeof(module_under_test));
+}
+
+TEST(RtLogMessageTest, TestSpanAndHexDump)
+{
+    RtLogMessage<512> module_under_test;
+    const float samples[] = {1.0f, 2.5f, -0.25f};
+    module_under_test.set_message(RtLogLevel::INFO, std::chrono::nanoseconds(123), "Samples {:.2f}",
+                                  span(samples));
+    EXPECT_STREQ("Samples [1.00, 2.50, -0.25]", module_under_test.message());
+
+    // The fast fixed point path gives the same result as fmt, other specs are formatted by fmt
+    const double values_to_round[] = {0.1234, -12.5678, 1e6, 0.0, -0.0, -0.0001, 123456.789, 1234.5678, 0.000123,
+                                      2.675, 1.005, 0.125, 2.5, 9.9995, 0.45, 1e17};
+    const float floats_to_round[] = {2.675f, 1.005f, 0.125f, -0.0f, 9.9995f, 0.45f, 1234.5678f};
+    for (const char* spec : {"{:.0f}", "{:.2f}", "{:.3f}", "{:.9f}", "{:.3}", "{:.1}"})
+    {
+        auto format = std::string("[") + spec + "]";
+        module_under_test.set_message(RtLogLevel::INFO, std::chrono::nanoseconds(123), spec, span(values_to_round));
+        EXPECT_EQ(fmt::format(fmt::runtime(format), fmt::join(values_to_round, ", ")), module_under_test.message()) << spec;
+        module_under_test.set_message(RtLogLevel::INFO, std::chrono::nanoseconds(123), spec, span(floats_to_round));
+        EXPECT_EQ(fmt::format(fmt::runtime(format), fmt::join(floats_to_round, ", ")), module_under_test.message()) << spec;
+    }
+    module_under_test.set_message(RtLogLevel::INFO, std::chrono::nanoseconds(123), "{:6.1f}", span(samples));
+    EXPECT_STREQ("[   1.0,    2.5,   -0.2]", module_under_test.message());
+
+    std::vector<int> values = {1, 2};
+    module_under_test.set_message(RtLogLevel::INFO, std::chrono::nanoseconds(123), "{} {}",
+                                  span(values), span(values.data(), 0));
+    EXPECT_STREQ("[1, 2] []", module_under_test.message());
+
+    const uint8_t bytes[] = {0x00, 0x7f, 0xff};
+    module_under_test.set_message(RtLogLevel::INFO, std::chrono::nanoseconds(123), "Bytes {}",
+                                  hex_dump(bytes, sizeof(bytes)));
+    EXPECT_STREQ("Bytes 00 7f ff", module_under_test.message());
+}
+
+TEST(RtLogMessageTest, TestSpanTruncatedOnCapture)
+{
+    // Only as many elements as can fit are captured
+    static_assert(capture_arg<32>(span(static_cast<const float*>(nullptr), 1000)).size == 17);
+    std::vector<float> samples(1000, 0.0f);
+    RtLogMessage<32> module_under_test;
+    module_under_test.set_message(RtLogLevel::INFO, std::chrono::nanoseconds(123), "{}", span(samples));
+    EXPECT_STREQ("[0, 0, 0, 0, 0, 0, 0, 0, 0, 0, ", module_under_test.message());
+
+    auto truncated = Span<float>{samples.data(), 2, samples.size()};
+    RtLogMessage<512> long_message;
+    long_message.set_message(RtLogLevel::INFO, std::chrono::nanoseconds(123), "{} {}", truncated,
+                             HexDump{nullptr, 0, 10});
+    EXPECT_STREQ("[0, 0, ...] ...", long_message.message());
+}
+
+TEST(RtLogMessageTest, TestStructuredMessage)
+{
+    RtLogMessage<512> module_under_test;
+    std::string name = "main";
+
+    module_under_test.set_structured_message(RtLogLevel::INFO, std::chrono::nanoseconds(123), "Processed",
+                                             kv("cpu", 0.25), kv("name", name), kv("xruns", 2));
+    EXPECT_TRUE(module_under_test.is_deferred());
+    EXPECT_TRUE(module_under_test.is_structured());
+
+    // The fields are packed and copied with the message
+    RtLogMessage<512> msg_2;
+    msg_2 = module_under_test;
+    name = "changed";
+
+    module_under_test.format_deferred(FieldEncoding::JSON);
+    EXPECT_FALSE(module_under_test.is_structured());
+    EXPECT_STREQ(R"({"message": "Processed", "cpu": 0.25, "name": "main", "xruns": 2})", module_under_test.message());
+
+    msg_2.format_deferred(FieldEncoding::TEXT);
+    EXPECT_STREQ("Processed cpu=0.25 name=main xruns=2", msg_2.message());
+}
+
+TEST(RtLogMessageTest, TestStructuredMaxSize)
+{
+    // Room for the key pointer, length, 11 characters of the string and the null-termination
+    RtLogMessage<sizeof(const char*) + sizeof(uint32_t) + 12> module_under_test;
+    module_under_test.set_structured_message(RtLogLevel::INFO, std::chrono::nanoseconds(0), "",
+                                             kv("s", "string longer than 12"));
+    module_under_test.format_deferred();
+    EXPECT_STREQ("s=string long", module_under_test.message());
+}
@@ -0,0 +1,329 @@
+#include <array>
+#include <future>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "fifo/circularfifo_memory_relaxed_aquire_release.h"
+#include "elklog/rtlogmessage.h"
+#include "elklog/rtlogqueue.h"
+
+using namespace elklog;
+
+using TestMessage = RtLogMessage<64>;
+using TestFifo = memory_relaxed_aquire_release::CircularFifo<TestMessage, 16>;
+
+template<typename Queue>
+bool write_message(Queue& queue, int timestamp)
+{
+    return queue.write([&](TestMessage& msg)
+    {
+        msg.set_message(RtLogLevel::INFO, std::chrono::nanoseconds(timestamp), "Message {}", timestamp);
+    });
+}
+
+TEST(LockedRtLogQueueTest, TestWriteAndRead)
+{
+    LockedRtLogQueue<TestMessage, TestFifo> module_under_test;
+
+    EXPECT_EQ(nullptr, module_under_test.peek());
+    int written = 0;
+    while (write_message(module_under_test, written))
+    {
+        written++;
+    }
+    EXPECT_EQ(16, written);
+
+    for (int i = 0; i < written; ++i)
+    {
+        auto msg = module_under_test.peek();
+        ASSERT_NE(nullptr, msg);
+        EXPECT_EQ(std::chrono::nanoseconds(i), msg->timestamp());
+        module_under_test.release();
+    }
+    EXPECT_EQ(nullptr, module_under_test.peek());
+}
+
+TEST(LockedRtLogQueueTest, TestPopBulk)
+{
+    LockedRtLogQueue<TestMessage, TestFifo> module_under_test;
+    std::array<TestMessage, 10> messages;
+
+    EXPECT_EQ(0u, module_under_test.pop_bulk(messages.data(), messages.size()));
+    // Two rounds so that the second one wraps around the end of the fifo
+    int written = 0;
+    int read = 0;
+    for (int round = 0; round < 2; ++round)
+    {
+        for (int i = 0; i < 12; ++i)
+        {
+            ASSERT_TRUE(write_message(module_under_test, written++));
+        }
+        for (size_t max_count : {10u, 10u})
+        {
+            auto count = module_under_test.pop_bulk(messages.data(), max_count);
+            for (size_t i = 0; i < count; ++i)
+            {
+                EXPECT_EQ(std::chrono::nanoseconds(read++), messages[i].timestamp());
+            }
+        }
+        EXPECT_EQ(written, read);
+    }
+    EXPECT_EQ(nullptr, module_under_test.peek());
+}
+
+TEST(PerThreadRtLogQueueTest, TestMergeInTimestampOrder)
+{
+    PerThreadRtLogQueue<TestMessage, TestFifo, 2> module_under_test;
+    std::promise<void> written_1;
+    std::promise<void> written_2;
+    std::promise<void> finish;
+    std::shared_future<void> done = finish.get_future().share();
+
+    // Interleaved timestamps, written from separate threads that keep their fifos
+    std::thread thread_1([&]()
+    {
+        EXPECT_TRUE(module_under_test.register_thread());
+        for (int t : {1, 4, 5})
+        {
+            EXPECT_TRUE(write_message(module_under_test, t));
+        }
+        written_1.set_value();
+        done.wait();
+    });
+    written_1.get_future().wait();
+
+    std::thread thread_2([&]()
+    {
+        for (int t : {2, 3, 6})
+        {
+            EXPECT_TRUE(write_message(module_under_test, t));
+        }
+        written_2.set_value();
+        done.wait();
+    });
+    written_2.get_future().wait();
+
+    // Both fifos are claimed now, so this should use the shared fifo
+    EXPECT_FALSE(module_under_test.register_thread());
+    EXPECT_TRUE(write_message(module_under_test, 0));
+    finish.set_value();
+    thread_1.join();
+    thread_2.join();
+
+    for (int i = 0; i < 7; ++i)
+    {
+        auto msg = module_under_test.peek();
+        ASSERT_NE(nullptr, msg);
+        EXPECT_EQ(std::chrono::nanoseconds(i), msg->timestamp());
+        module_under_test.release();
+    }
+    EXPECT_EQ(nullptr, module_under_test.peek());
+}
+
+TEST(PerThreadRtLogQueueTest, TestBoundWrite)
+{
+    PerThreadRtLogQueue<TestMessage, TestFifo, 1> module_under_test;
+    std::promise<void> written;
+    std::promise<void> done;
+
+    // Keeps its fifo until it exits
+    std::thread thread_1([&]()
+    {
+        auto binding = module_under_test.bind_thread();
+        for (int t : {1, 3})
+        {
+            EXPECT_TRUE(module_under_test.write(binding, [&](TestMessage& msg)
+            {
+                msg.set_message(RtLogLevel::INFO, std::chrono::nanoseconds(t), "Message {}", t);
+            }));
+        }
+        written.set_value();
+        done.get_future().wait();
+    });
+    written.get_future().wait();
+
+    // Bound after the only fifo was claimed, should use the shared fifo
+    auto binding = module_under_test.bind_thread();
+    EXPECT_TRUE(module_under_test.write(binding, [&](TestMessage& msg)
+    {
+        msg.set_message(RtLogLevel::INFO, std::chrono::nanoseconds(2), "Message {}", 2);
+    }));
+    done.set_value();
+    thread_1.join();
+
+    for (int i = 1; i <= 3; ++i)
+    {
+        auto msg = module_under_test.peek();
+        ASSERT_NE(nullptr, msg);
+        EXPECT_EQ(std::chrono::nanoseconds(i), msg->timestamp());
+        module_under_test.release();
+    }
+    EXPECT_EQ(nullptr, module_under_test.peek());
+}
+
+TEST(PerThreadRtLogQueueTest, TestUnregister)
+{
+    PerThreadRtLogQueue<TestMessage, TestFifo, 1> module_under_test;
+
+    std::thread thread_1([&]()
+    {
+        EXPECT_TRUE(module_under_test.register_thread());
+        module_under_test.unregister_thread();
+    });
+    thread_1.join();
+
+    // The fifo should be free to claim again
+    EXPECT_TRUE(module_under_test.register_thread());
+}
+
+TEST(PerThreadRtLogQueueTest, TestReleasedOnThreadExit)
+{
+    PerThreadRtLogQueue<TestMessage, TestFifo, 1> module_under_test;
+
+    std::thread thread_1([&]()
+    {
+        EXPECT_TRUE(write_message(module_under_test, 1));
+    });
+    thread_1.join();
+
+    EXPECT_TRUE(module_under_test.register_thread());
+    EXPECT_TRUE(write_message(module_under_test, 2));
+    for (int i = 1; i <= 2; ++i)
+    {
+        auto msg = module_under_test.peek();
+        ASSERT_NE(nullptr, msg);
+        EXPECT_EQ(std::chrono::nanoseconds(i), msg->timestamp());
+        module_under_test.release();
+    }
+    module_under_test.unregister_thread();
+}
+
+TEST(PerThreadRtLogQueueTest, TestManyQueuesFromOneThread)
+{
+    // More queues than the thread caches lookups for
+    constexpr int QUEUES = 6;
+    std::array<PerThreadRtLogQueue<TestMessage, TestFifo, 2>, QUEUES> queues;
+    std::array<int, QUEUES> indexes;
+    for (int i = 0; i < QUEUES; ++i)
+    {
+        indexes[i] = queues[i].bind_thread().index;
+    }
+
+    // Should look up the same fifos again instead of claiming new ones
+    for (int round = 0; round < 5; ++round)
+    {
+        for (int i = 0; i < QUEUES; ++i)
+        {
+            EXPECT_EQ(indexes[i], queues[i].bind_thread().index);
+        }
+    }
+
+    std::thread thread_1([&]()
+    {
+        for (auto& queue : queues)
+        {
+            EXPECT_TRUE(queue.register_thread());
+        }
+    });
+    thread_1.join();
+
+    for (auto& queue : queues)
+    {
+        queue.unregister_thread();
+    }
+}
+
+TEST(MpscRtLogQueueTest, TestWriteAndRead)
+{
+    MpscRtLogQueue<TestMessage, 16> module_under_test;
+
+    EXPECT_EQ(nullptr, module_under_test.peek());
+    int written = 0;
+    while (write_message(module_under_test, written))
+    {
+        written++;
+    }
+    EXPECT_EQ(16, written);
+
+    // Read and write again to exercise wrapping of the sequence numbers
+    for (int i = 0; i < 40; ++i)
+    {
+        auto msg = module_under_test.peek();
+        ASSERT_NE(nullptr, msg);
+        EXPECT_EQ(std::chrono::nanoseconds(i), msg->timestamp());
+        module_under_test.release();
+        EXPECT_TRUE(write_message(module_under_test, written++));
+    }
+}
+
+TEST(MpscRtLogQueueTest, TestPopBulk)
+{
+    MpscRtLogQueue<TestMessage, 16> module_under_test;
+    std::array<TestMessage, 16> messages;
+
+    for (int i = 0; i < 10; ++i)
+    {
+        ASSERT_TRUE(write_message(module_under_test, i));
+    }
+    ASSERT_EQ(4u, module_under_test.pop_bulk(messages.data(), 4));
+    ASSERT_EQ(6u, module_under_test.pop_bulk(messages.data() + 4, 12));
+    for (int i = 0; i < 10; ++i)
+    {
+        EXPECT_EQ(std::chrono::nanoseconds(i), messages[i].timestamp());
+    }
+    EXPECT_EQ(0u, module_under_test.pop_bulk(messages.data(), 16));
+    // All cells should be free for writing again
+    for (int i = 0; i < 16; ++i)
+    {
+        EXPECT_TRUE(write_message(module_under_test, i));
+    }
+}
+
+TEST(MpscRtLogQueueTest, TestMultipleProducers)
+{
+    constexpr int MESSAGES_PER_THREAD = 1000;
+    MpscRtLogQueue<TestMessage, 64> module_under_test;
+    std::atomic<bool> running {true};
+    std::vector<int> received(2, 0);
+
+    std::thread consumer([&]()
+    {
+        while (running || module_under_test.peek())
+        {
+            if (auto msg = module_under_test.peek())
+            {
+                // Timestamps encode the thread id, and are increasing per thread
+                int thread = msg->timestamp().count() / MESSAGES_PER_THREAD;
+                EXPECT_EQ(received[thread], msg->timestamp().count() % MESSAGES_PER_THREAD);
+                received[thread]++;
+                module_under_test.release();
+            }
+        }
+    });
+
+    std::vector<std::thread> producers;
+    for (int t = 0; t < 2; ++t)
+    {
+        producers.emplace_back([&, t]()
+        {
+            for (int i = 0; i < MESSAGES_PER_THREAD; ++i)
+            {
+                while (!write_message(module_under_test, t * MESSAGES_PER_THREAD + i))
+                {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+    for (auto& p : producers)
+    {
+        p.join();
+    }
+    running = false;
+    consumer.join();
+
+    EXPECT_EQ(MESSAGES_PER_THREAD, received[0]);
+    EXPECT_EQ(MESSAGES_PER_THREAD, received[1]);
+}
@@ -0,0 +1,201 @@
+#include <array>
+#include <string>
+
+#include "gtest/gtest.h"
+
+#include "elklog/rtlogring.h"
+
+using namespace elklog;
+
+TEST(RtByteRingTest, TestReserveAndCommit)
+{
+    RtByteRing<128> module_under_test;
+    size_t len;
+
+    EXPECT_TRUE(module_under_test.was_empty());
+    EXPECT_EQ(nullptr, module_under_test.peek(len));
+
+    auto data = static_cast<char*>(module_under_test.try_reserve(32));
+    ASSERT_NE(nullptr, data);
+    std::strcpy(data, "message");
+    // Nothing is visible before commit
+    EXPECT_EQ(nullptr, module_under_test.peek(len));
+    module_under_test.commit(8);
+
+    auto read = static_cast<char*>(module_under_test.peek(len));
+    ASSERT_NE(nullptr, read);
+    EXPECT_EQ(8u, len);
+    EXPECT_STREQ("message", read);
+    module_under_test.release();
+    EXPECT_TRUE(module_under_test.was_empty());
+}
+
+TEST(RtByteRingTest, TestWrapAround)
+{
+    RtByteRing<128> module_under_test;
+    size_t len;
+
+    // Records of 8 bytes header + 40 bytes payload, 2 fit at the end
+    for (int i = 0; i < 10; ++i)
+    {
+        auto data = static_cast<int*>(module_under_test.try_reserve(40));
+        ASSERT_NE(nullptr, data);
+        *data = i;
+        module_under_test.commit(40);
+
+        auto read = static_cast<int*>(module_under_test.peek(len));
+        ASSERT_NE(nullptr, read);
+        EXPECT_EQ(40u, len);
+        EXPECT_EQ(i, *read);
+        module_under_test.release();
+    }
+}
+
+TEST(RtByteRingTest, TestFull)
+{
+    RtByteRing<128> module_under_test;
+    size_t len;
+
+    for (int i = 0; i < 2; ++i)
+    {
+        ASSERT_NE(nullptr, module_under_test.try_reserve(40));
+        module_under_test.commit(40);
+    }
+    // Only 32 bytes left and the write index may not catch up with the read index
+    EXPECT_EQ(nullptr, module_under_test.try_reserve(24));
+    ASSERT_NE(nullptr, module_under_test.try_reserve(16));
+    module_under_test.commit(16);
+
+    for (int i = 0; i < 2; ++i)
+    {
+        ASSERT_NE(nullptr, module_under_test.peek(len));
+        module_under_test.release();
+    }
+    // The next record should now wrap to the start
+    ASSERT_NE(nullptr, module_under_test.try_reserve(40));
+    module_under_test.commit(40);
+    ASSERT_NE(nullptr, module_under_test.peek(len));
+    EXPECT_EQ(16u, len);
+    module_under_test.release();
+    ASSERT_NE(nullptr, module_under_test.peek(len));
+    EXPECT_EQ(40u, len);
+    module_under_test.release();
+    ASSERT_NE(nullptr, module_under_test.try_reserve(40));
+    module_under_test.commit(40);
+}
+
+TEST(RtLogMessageRingTest, TestPushAndPop)
+{
+    RtLogMessageRing<512, 4096> module_under_test;
+    RtLogMessage<512> message;
+    RtLogMessage<512> popped;
+
+    EXPECT_FALSE(module_under_test.pop(popped));
+
+    // Short messages should only use a fraction of a full slot each
+    int pushed = 0;
+    message.set_message(RtLogLevel::WARNING, std::chrono::nanoseconds(123), "Message {}", pushed);
+    while (module_under_test.push(message))
+    {
+        message.set_message(RtLogLevel::WARNING, std::chrono::nanoseconds(123), "Message {}", ++pushed);
+    }
+    EXPECT_GT(pushed, static_cast<int>(4 * 4096 / sizeof(RtLogMessage<512>)));
+
+    for (int i = 0; i < pushed; ++i)
+    {
+        ASSERT_TRUE(module_under_test.pop(popped));
+        EXPECT_EQ(RtLogLevel::WARNING, popped.level());
+        EXPECT_EQ(std::chrono::nanoseconds(123), popped.timestamp());
+        EXPECT_EQ(fmt::format("Message {}", i), popped.message());
+    }
+    EXPECT_FALSE(module_under_test.pop(popped));
+}
+
+TEST(RtLogMessageRingTest, TestPopBulk)
+{
+    RtLogMessageRing<128, 1024> module_under_test;
+    RtLogMessage<128> message;
+    std::array<RtLogMessage<128>, 8> popped;
+
+    EXPECT_EQ(0u, module_under_test.pop_bulk(popped.data(), popped.size()));
+    // Several rounds to wrap around the end of the ring
+    int pushed = 0;
+    int read = 0;
+    for (int round = 0; round < 4; ++round)
+    {
+        for (int i = 0; i < 6; ++i)
+        {
+            message.set_message(RtLogLevel::INFO, std::chrono::nanoseconds(pushed), "Message {}", pushed);
+            ASSERT_TRUE(module_under_test.push(message));
+            pushed++;
+        }
+        auto count = module_under_test.pop_bulk(popped.data(), popped.size());
+        ASSERT_EQ(6u, count);
+        for (size_t i = 0; i < count; ++i)
+        {
+            EXPECT_EQ(fmt::format("Message {}", read++), popped[i].message());
+        }
+    }
+    EXPECT_EQ(0u, module_under_test.pop_bulk(popped.data(), popped.size()));
+}
+
+TEST(RtLogMessageRingTest, TestReserveShortMessageWhenAlmostFull)
+{
+    RtLogMessageRing<512, 4096> module_under_test;
+    RtLogMessage<512> message;
+    RtLogMessage<512> popped;
+
+    int pushed = 0;
+    message.set_message(RtLogLevel::INFO, std::chrono::nanoseconds(123), "Message {}", pushed);
+    while (module_under_test.push(message))
+    {
+        message.set_message(RtLogLevel::INFO, std::chrono::nanoseconds(123), "Message {}", ++pushed);
+    }
+    EXPECT_EQ(nullptr, module_under_test.try_reserve());
+
+    // Frees much less than a message of max length
+    ASSERT_TRUE(module_under_test.pop(popped));
+    ASSERT_TRUE(module_under_test.pop(popped));
+    auto reserved = module_under_test.try_reserve();
+    ASSERT_NE(nullptr, reserved);
+    reserved->set_message(RtLogLevel::WARNING, std::chrono::nanoseconds(456), "Short");
+    EXPECT_TRUE(module_under_test.commit());
+
+    // Fits, but not a long message
+    reserved = module_under_test.try_reserve();
+    if (reserved)
+    {
+        reserved->set_message(RtLogLevel::WARNING, std::chrono::nanoseconds(456), std::string(400, 'x').c_str());
+        EXPECT_FALSE(module_under_test.commit());
+    }
+
+    for (int i = 2; i < pushed; ++i)
+    {
+        ASSERT_TRUE(module_under_test.pop(popped));
+        EXPECT_EQ(fmt::format("Message {}", i), popped.message());
+    }
+    ASSERT_TRUE(module_under_test.pop(popped));
+    EXPECT_STREQ("Short", popped.message());
+    EXPECT_EQ(RtLogLevel::WARNING, popped.level());
+    EXPECT_FALSE(module_under_test.pop(popped));
+}
+
+TEST(RtLogMessageRingTest, TestReserveAndPeek)
+{
+    RtLogMessageRing<512, 4096> module_under_test;
+
+    EXPECT_EQ(nullptr, module_under_test.peek());
+
+    auto message = module_under_test.try_reserve();
+    ASSERT_NE(nullptr, message);
+    message->set_message(RtLogLevel::ERROR, std::chrono::nanoseconds(123), "Test {}_{}", "message", 1);
+    EXPECT_EQ(nullptr, module_under_test.peek());
+    module_under_test.commit();
+
+    auto read = module_under_test.peek();
+    ASSERT_NE(nullptr, read);
+    EXPECT_EQ(RtLogLevel::ERROR, read->level());
+    EXPECT_STREQ("Test message_1", read->message());
+    module_under_test.release();
+    EXPECT_EQ(nullptr, module_under_test.peek());
+}
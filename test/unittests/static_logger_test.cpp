@@ -0,0 +1,101 @@
+#include <cstdio>
+
+#include "gtest/gtest.h"
+
+// Compile out debug messages in this file only
+#undef ELKLOG_ACTIVE_LEVEL
+#define ELKLOG_ACTIVE_LEVEL ELKLOG_LEVEL_INFO
+
+#include "elklog/static_logger.h"
+
+#include "test_utils.h"
+
+using namespace elklog;
+
+ELKLOG_GET_LOGGER_WITH_MODULE_NAME("static_test");
+
+namespace {
+
+int evaluated = 0;
+
+int count_evaluation()
+{
+    return ++evaluated;
+}
+
+} // namespace
+
+class StaticLoggerTest : public ::testing::Test
+{
+protected:
+    void SetUp()
+    {
+        std::remove("./static_log.txt");
+        ASSERT_EQ(Status::OK, StaticLogger::init_logger("./static_log.txt", "static_log", "warning",
+                                                        std::chrono::seconds(0), ElkLogger::Type::TEXT, true));
+        evaluated = 0;
+    }
+
+    std::string _read_log()
+    {
+        EXPECT_EQ(Status::OK, StaticLogger::public_instance->flush(std::chrono::milliseconds(1000)));
+        return test_utils::read_file("./static_log.txt");
+    }
+};
+
+TEST_F(StaticLoggerTest, TestLevels)
+{
+    // Compiled out
+    ELKLOG_LOG_DEBUG("Debug {}", count_evaluation());
+    ELKLOG_LOG_DEBUG_IF(true, "Debug if {}", count_evaluation());
+    // Filtered at runtime, before the arguments are evaluated
+    ELKLOG_LOG_INFO("Info {}", count_evaluation());
+    EXPECT_EQ(0, evaluated);
+
+    ELKLOG_LOG_WARNING("Warning {}", count_evaluation());
+    ELKLOG_LOG_WARNING_IF(false, "Not logged");
+    ELKLOG_LOG_ERROR_IF(true, "Error {}", 2);
+    ELKLOG_LOG_CRITICAL("Critical {}", 3);
+    EXPECT_EQ(1, evaluated);
+
+    auto content = _read_log();
+    EXPECT_EQ(std::string::npos, content.find("Debug"));
+    EXPECT_EQ(std::string::npos, content.find("Info"));
+    EXPECT_EQ(std::string::npos, content.find("Not logged"));
+    EXPECT_NE(std::string::npos, content.find("[static_test] Warning 1"));
+    EXPECT_NE(std::string::npos, content.find("[static_test] Error 2"));
+    EXPECT_NE(std::string::npos, content.find("[static_test] Critical 3"));
+}
+
+TEST_F(StaticLoggerTest, TestMacrosAsStatements)
+{
+    bool condition = true;
+    if (condition)
+        ELKLOG_LOG_WARNING("Then branch");
+    else
+        ELKLOG_LOG_WARNING("Else branch");
+
+    for (int i = 0; i < 3; ++i)
+        ELKLOG_LOG_WARNING_EVERY_N(2, "Every second {}", i);
+
+    auto content = _read_log();
+    EXPECT_NE(std::string::npos, content.find("Then branch"));
+    EXPECT_EQ(std::string::npos, content.find("Else branch"));
+    EXPECT_NE(std::string::npos, content.find("Every second 0"));
+    EXPECT_EQ(std::string::npos, content.find("Every second 1"));
+    EXPECT_NE(std::string::npos, content.find("Every second 2"));
+}
+
+TEST_F(StaticLoggerTest, TestThreadHandleWithoutLogger)
+{
+    EXPECT_EQ(StaticLogger::public_instance, StaticLogger::thread_handle().logger());
+
+    // The log file of the fixture is not a directory
+    EXPECT_NE(Status::OK, StaticLogger::init_logger("./static_log.txt/static_log.txt", "static_log", "warning"));
+    EXPECT_EQ(nullptr, StaticLogger::public_instance);
+    // Messages are dropped instead of going to the destroyed logger
+    auto& handle = StaticLogger::thread_handle();
+    EXPECT_EQ(nullptr, handle.logger());
+    EXPECT_FALSE(handle.should_log(nullptr, RtLogLevel::ERROR));
+    handle.error("Dropped");
+}
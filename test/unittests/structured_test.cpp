@@ -0,0 +1,58 @@
+#include <limits>
+#include <string>
+
+#include "gtest/gtest.h"
+
+#include "elklog/structured.h"
+
+using namespace elklog;
+
+enum class TestEnum
+{
+    FIRST,
+    SECOND
+};
+
+template<typename... Fields>
+std::string encode(FieldEncoding encoding, std::string_view message, const Fields&... fields)
+{
+    fmt::memory_buffer buffer;
+    encode_fields(buffer, encoding, message, fields...);
+    return std::string(buffer.data(), buffer.size());
+}
+
+TEST(StructuredTest, TestJsonEncoding)
+{
+    EXPECT_EQ(R"({"message": "Started", "cpu": 0.5, "xruns": 3, "ok": true, "mode": 1, "name": "main"})",
+              encode(FieldEncoding::JSON, "Started", kv("cpu", 0.5f), kv("xruns", 3), kv("ok", true),
+                     kv("mode", TestEnum::SECOND), kv("name", "main")));
+
+    // An empty message is left out
+    EXPECT_EQ(R"({"status": "Finished"})", encode(FieldEncoding::JSON, "", kv("status", "Finished")));
+    EXPECT_EQ(R"({"message": "Only message"})", encode(FieldEncoding::JSON, "Only message"));
+}
+
+TEST(StructuredTest, TestJsonEscaping)
+{
+    EXPECT_EQ(R"({"message": "Quote \" and \\", "path": "a\tb\nc\u0001"})",
+              encode(FieldEncoding::JSON, "Quote \" and \\", kv("path", std::string("a\tb\nc\x01"))));
+
+    // Not representable in JSON
+    EXPECT_EQ(R"({"message": "Values", "nan": null, "inf": null})",
+              encode(FieldEncoding::JSON, "Values", kv("nan", std::numeric_limits<double>::quiet_NaN()),
+                     kv("inf", std::numeric_limits<float>::infinity())));
+}
+
+TEST(StructuredTest, TestTextEncoding)
+{
+    EXPECT_EQ("Started cpu=0.5 xruns=3 name=main",
+              encode(FieldEncoding::TEXT, "Started", kv("cpu", 0.5), kv("xruns", 3u), kv("name", "main")));
+    EXPECT_EQ("status=Finished", encode(FieldEncoding::TEXT, "", kv("status", "Finished")));
+}
+
+TEST(StructuredTest, TestAreFields)
+{
+    EXPECT_TRUE((are_fields<Field<int>, Field<std::string_view>>()));
+    EXPECT_FALSE((are_fields<int, float>()));
+    EXPECT_FALSE(are_fields<>());
+}
@@ -0,0 +1,50 @@
+#ifndef ELKLOG_TEST_UTILS_H
+#define ELKLOG_TEST_UTILS_H
+
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+namespace test_utils {
+
+/**
+ * @brief Read the whole content of a file, empty if it can not be opened.
+ *        Flush the logger writing to it first, i.e. with ElkLogger::flush()
+ *        or close_log(), rather than sleeping.
+ */
+inline std::string read_file(const std::string& path)
+{
+    std::ifstream file(path, std::ios::binary);
+    return std::string((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+}
+
+inline std::vector<std::string> read_lines(const std::string& path)
+{
+    std::ifstream file(path);
+    std::vector<std::string> lines;
+    for (std::string line; std::getline(file, line);)
+    {
+        lines.push_back(line);
+    }
+    return lines;
+}
+
+inline int count_lines_with(const std::string& path, const std::string& text)
+{
+    int count = 0;
+    for (const auto& line : read_lines(path))
+    {
+        count += line.find(text) != std::string::npos ? 1 : 0;
+    }
+    return count;
+}
+
+inline bool file_exists(const std::string& path)
+{
+    return std::ifstream(path).good();
+}
+
+} // namespace test_utils
+
+#endif // ELKLOG_TEST_UTILS_H
@@ -0,0 +1,71 @@
+#include <pthread.h>
+#include <sched.h>
+
+#include <string>
+#include <thread>
+
+#include "gtest/gtest.h"
+
+#include "elklog/thread_config.h"
+
+using namespace elklog;
+
+namespace {
+
+std::string current_thread_name()
+{
+    char name[16] = {};
+    pthread_getname_np(pthread_self(), name, sizeof(name));
+    return name;
+}
+
+} // namespace
+
+TEST(ThreadConfigTest, TestEmptyConfig)
+{
+    ThreadConfig config;
+    EXPECT_TRUE(config.empty());
+    EXPECT_EQ(Status::OK, apply_thread_config(config));
+}
+
+TEST(ThreadConfigTest, TestNameAndAffinity)
+{
+    Status status = Status::OK;
+    std::string name;
+    bool on_cpu_0 = false;
+    int cpu_count = 0;
+    std::thread thread([&]()
+    {
+        ThreadConfig config;
+        config.name = "elklog_test_thread_name";
+        config.cpus = {0};
+        status = apply_thread_config(config);
+        name = current_thread_name();
+
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        sched_getaffinity(0, sizeof(cpus), &cpus);
+        on_cpu_0 = CPU_ISSET(0, &cpus);
+        cpu_count = CPU_COUNT(&cpus);
+    });
+    thread.join();
+
+    EXPECT_EQ(Status::OK, status);
+    // Truncated to the length supported by Linux
+    EXPECT_EQ("elklog_test_thr", name);
+    EXPECT_TRUE(on_cpu_0);
+    EXPECT_EQ(1, cpu_count);
+}
+
+TEST(ThreadConfigTest, TestInvalidCpu)
+{
+    Status status = Status::OK;
+    std::thread thread([&]()
+    {
+        ThreadConfig config;
+        config.cpus = {-1};
+        status = apply_thread_config(config);
+    });
+    thread.join();
+    EXPECT_EQ(Status::FAILED_TO_CONFIGURE_THREAD, status);
+}
@@ -0,0 +1,137 @@
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "elklog/elk_logger.h"
+#include "elklog/rtlogger.h"
+#include "elklog/trace_event.h"
+
+#include "test_utils.h"
+
+using namespace elklog;
+using namespace test_utils;
+
+constexpr auto TEST_POLL_PERIOD = std::chrono::milliseconds(1);
+constexpr auto TEST_WAIT_TIME = std::chrono::milliseconds(50);
+#ifdef ELKLOG_RT_VARIABLE_LENGTH_QUEUE
+constexpr size_t TEST_QUEUE_SIZE = 2048; // In bytes
+#else
+constexpr size_t TEST_QUEUE_SIZE = 16;
+#endif
+
+TEST(TraceEventTest, TestRtLoggerTrace)
+{
+    std::mutex mutex;
+    std::vector<TraceEvent> events;
+    RtLogger<256, TEST_QUEUE_SIZE, 0, 64> module_under_test(TEST_POLL_PERIOD, [](const RtLogMessage<256>& /*msg*/) {},
+                                               "info", 0, std::chrono::milliseconds(0), true, false,
+                                               [&](const TraceEvent* batch, size_t count)
+    {
+        std::scoped_lock lock(mutex);
+        events.insert(events.end(), batch, batch + count);
+    });
+
+    auto span = ELKLOG_TRACE_NAME("span");
+    module_under_test.trace_begin(span);
+    module_under_test.trace_counter(ELKLOG_TRACE_NAME("counter"), 42);
+    module_under_test.trace_end(span);
+    {
+        auto scope = module_under_test.trace_scope(ELKLOG_TRACE_NAME("scope"));
+        module_under_test.trace_instant(ELKLOG_TRACE_NAME("instant"));
+    }
+    ASSERT_TRUE(module_under_test.drain(std::chrono::milliseconds(1000)));
+
+    std::scoped_lock lock(mutex);
+    ASSERT_EQ(6u, events.size());
+    std::vector<TraceEventType> types = {TraceEventType::BEGIN, TraceEventType::COUNTER, TraceEventType::END,
+                                         TraceEventType::BEGIN, TraceEventType::INSTANT, TraceEventType::END};
+    std::vector<std::string> names = {"span", "counter", "span", "scope", "instant", "scope"};
+    for (size_t i = 0; i < events.size(); ++i)
+    {
+        EXPECT_EQ(types[i], events[i].type);
+        EXPECT_EQ(names[i], FormatRegistry::lookup(events[i].name_id));
+        EXPECT_NE(0u, events[i].thread_id);
+        if (i > 0)
+        {
+            EXPECT_LE(events[i - 1].timestamp, events[i].timestamp);
+        }
+    }
+    EXPECT_EQ(42, events[1].value);
+    EXPECT_EQ(6u, module_under_test.stats().traced);
+    EXPECT_EQ(0u, module_under_test.stats().trace_dropped);
+}
+
+TEST(TraceEventTest, TestTraceQueueFull)
+{
+    // Consumer is only woken up when the queue is half full
+    RtLogger<256, TEST_QUEUE_SIZE, 0, 16> module_under_test(std::chrono::milliseconds(10000), [](const RtLogMessage<256>& /*msg*/) {},
+                                               "info");
+    std::this_thread::sleep_for(TEST_WAIT_TIME);
+    for (int i = 0; i < 7; ++i)
+    {
+        module_under_test.trace_instant(ELKLOG_TRACE_NAME("event"));
+    }
+    std::this_thread::sleep_for(TEST_WAIT_TIME);
+    EXPECT_EQ(0u, module_under_test.stats().trace_dropped);
+    EXPECT_EQ(7u, module_under_test.stats().traced);
+}
+
+TEST(TraceEventTest, TestTraceWriter)
+{
+    auto name = ELKLOG_TRACE_NAME("process \"node\"");
+    {
+        TraceWriter writer("./trace_test.json");
+        ASSERT_TRUE(writer.is_open());
+        TraceEvent events[] = {{std::chrono::nanoseconds(1234567), 0, format_id(name), 12, TraceEventType::BEGIN},
+                               {std::chrono::nanoseconds(2000005), 0, format_id(name), 12, TraceEventType::END},
+                               {std::chrono::nanoseconds(3000000), -5, format_id(name), 12, TraceEventType::COUNTER}};
+        writer.write(events, 3);
+    }
+    auto content = read_file("./trace_test.json");
+    EXPECT_NE(std::string::npos, content.find(R"({"name": "process \"node\"", "ph": "B", "ts": 1234.567, "pid": )"));
+    EXPECT_NE(std::string::npos, content.find(R"("ph": "E", "ts": 2000.005, )"));
+    EXPECT_NE(std::string::npos, content.find(R"("tid": 12, "args": {"value": -5}})"));
+    EXPECT_EQ('[', content.front());
+    EXPECT_EQ("]\n", content.substr(content.size() - 2));
+}
+
+TEST(TraceEventTest, TestElkLoggerTrace)
+{
+    ElkLogger logger("info");
+    if (RTLOG_TRACE_QUEUE_SIZE == 0)
+    {
+        EXPECT_EQ(Status::FAILED_TO_START_LOGGER, logger.start_trace("./elk_trace_test.json"));
+        return;
+    }
+    logger.trace_instant(ELKLOG_TRACE_NAME("before start"));
+    ASSERT_EQ(Status::OK, logger.start_trace("./elk_trace_test.json"));
+    {
+        auto scope = logger.trace_scope(ELKLOG_TRACE_NAME("traced scope"));
+    }
+    // Waits for the events to be written
+    logger.stop_trace();
+
+    auto content = read_file("./elk_trace_test.json");
+    EXPECT_EQ(std::string::npos, content.find("before start"));
+    EXPECT_NE(std::string::npos, content.find(R"({"name": "traced scope", "ph": "B")"));
+    EXPECT_NE(std::string::npos, content.find(R"({"name": "traced scope", "ph": "E")"));
+}
+
+TEST(TraceEventTest, TestElkLoggerTraceWrittenOnDestruction)
+{
+    if (RTLOG_TRACE_QUEUE_SIZE == 0)
+    {
+        return;
+    }
+    std::remove("./elk_trace_test.json");
+    {
+        // Polls too seldom to write the events before the logger is destroyed
+        ElkLogger logger("info", ElkLogger::Type::TEXT, std::chrono::milliseconds(10000), std::chrono::milliseconds(10000), 0);
+        ASSERT_EQ(Status::OK, logger.start_trace("./elk_trace_test.json"));
+        logger.trace_instant(ELKLOG_TRACE_NAME("last event"));
+    }
+    EXPECT_NE(std::string::npos, read_file("./elk_trace_test.json").find(R"({"name": "last event")"));
+}
@@ -16,6 +16,17 @@
 
 /**
  * @brief Fifo implementation that is wait free for 1 consumer/ 1 producer.
+ *
+ * The tail index, written by the producer, and the head index, written by the
+ * consumer, are kept on separate cache lines, away from the slots, so that
+ * they do not false-share with each other or with the elements. Each side
+ * also keeps a cached copy of the other side's index on its own line, and
+ * only reloads the shared index when the cached copy says the fifo is full
+ * (producer) or empty (consumer).
+ *
+ * SlotAlignment sets the alignment of each slot, i.e. set to CACHE_LINE_SIZE
+ * so that the slot being written does not share a cache line with the slot
+ * being read.
  */
 
 #ifndef CIRCULARFIFO_AQUIRE_RELEASE_H_
@@ -26,17 +37,25 @@
 #include <array>
 
 namespace memory_relaxed_aquire_release {
-template<typename Element, size_t Size> 
+
+// Assumed, since std::hardware_destructive_interference_size is not
+// supported by all compilers
+constexpr size_t CACHE_LINE_SIZE = 64;
+
+template<typename Element, size_t Size, size_t SlotAlignment = alignof(Element)>
 class CircularFifo{
+  static_assert((SlotAlignment & (SlotAlignment - 1)) == 0, "SlotAlignment must be a power of 2");
+  static_assert(SlotAlignment >= alignof(Element), "SlotAlignment must be at least the alignment of Element");
+
 public:
   enum { Capacity = Size+1 };
 
-  CircularFifo() : _tail(0), _head(0){}
-  CircularFifo(const Element& inializer) : _tail(0), _head(0)
+  CircularFifo() : _tail(0), _cached_head(0), _head(0), _cached_tail(0){}
+  CircularFifo(const Element& inializer) : _tail(0), _cached_head(0), _head(0), _cached_tail(0)
   {
-    for (auto& el : _array)
+    for (auto& slot : _array)
     {
-      el = inializer;
+      slot.element = inializer;
     }
   }
   virtual ~CircularFifo() {}
@@ -44,26 +63,51 @@ public:
   bool push(const Element& item); // pushByMOve?
   bool pop(Element& item);
 
+  // Zero-copy alternatives to push/pop. The element returned by try_reserve()
+  // is written in place and published with commit(), the element returned by
+  // peek() is read in place and handed back with release().
+  Element* try_reserve();
+  void commit();
+  Element* peek();
+  void release();
+  // Pop up to max_count elements with a single update of the head index
+  size_t pop_bulk(Element* items, size_t max_count);
+
   bool wasEmpty() const;
   bool wasFull() const;
   bool isLockFree() const;
 
 private:
-  size_t increment(size_t idx) const; 
+  struct alignas(SlotAlignment) Slot
+  {
+    Element element;
+  };
+
+  size_t increment(size_t idx) const;
+
+  // Producer only reloads the head when the cached copy says it is full
+  bool is_full(size_t next_tail);
+  // Consumer only reloads the tail when the cached copy says it is empty
+  bool is_empty(size_t current_head);
+
+  // Written by the producer
+  alignas(CACHE_LINE_SIZE) std::atomic<size_t> _tail;  // tail(input) index
+  size_t _cached_head;
+  // Written by the consumer
+  alignas(CACHE_LINE_SIZE) std::atomic<size_t> _head; // head(output) index
+  size_t _cached_tail;
 
-  std::atomic <size_t>  _tail;  // tail(input) index
-  Element    _array[Capacity];
-  std::atomic<size_t>   _head; // head(output) index
+  alignas(CACHE_LINE_SIZE) Slot _array[Capacity];
 };
 
-template<typename Element, size_t Size>
-bool CircularFifo<Element, Size>::push(const Element& item)
+template<typename Element, size_t Size, size_t SlotAlignment>
+bool CircularFifo<Element, Size, SlotAlignment>::push(const Element& item)
 {	
-  const auto current_tail = _tail.load(std::memory_order_relaxed); 
-  const auto next_tail = increment(current_tail); 
-  if(next_tail != _head.load(std::memory_order_acquire))                           
-  {	
-    _array[current_tail] = item;
+  const auto current_tail = _tail.load(std::memory_order_relaxed);
+  const auto next_tail = increment(current_tail);
+  if(!is_full(next_tail))
+  {
+    _array[current_tail].element = item;
     _tail.store(next_tail, std::memory_order_release); 
     return true;
   }
@@ -75,20 +119,78 @@ bool CircularFifo<Element, Size>::push(const Element& item)
 
 // Pop by Consumer can only update the head (load with relaxed, store with release)
 //     the tail must be accessed with at least aquire
-template<typename Element, size_t Size>
-bool CircularFifo<Element, Size>::pop(Element& item)
+template<typename Element, size_t Size, size_t SlotAlignment>
+bool CircularFifo<Element, Size, SlotAlignment>::pop(Element& item)
 {
-  const auto current_head = _head.load(std::memory_order_relaxed);  
-  if(current_head == _tail.load(std::memory_order_acquire)) 
+  const auto current_head = _head.load(std::memory_order_relaxed);
+  if(is_empty(current_head))
     return false; // empty queue
 
-  item = _array[current_head]; 
+  item = _array[current_head].element;
   _head.store(increment(current_head), std::memory_order_release); 
   return true;
 }
 
-template<typename Element, size_t Size>
-bool CircularFifo<Element, Size>::wasEmpty() const
+// Reserve by Producer, returns the next free slot without publishing it
+//     the slot is owned by the producer until commit() is called
+template<typename Element, size_t Size, size_t SlotAlignment>
+Element* CircularFifo<Element, Size, SlotAlignment>::try_reserve()
+{
+  const auto current_tail = _tail.load(std::memory_order_relaxed);
+  if(!is_full(increment(current_tail)))
+    return &_array[current_tail].element;
+
+  return nullptr; // full queue
+}
+
+// Commit by Producer, only valid after a successful try_reserve()
+template<typename Element, size_t Size, size_t SlotAlignment>
+void CircularFifo<Element, Size, SlotAlignment>::commit()
+{
+  const auto current_tail = _tail.load(std::memory_order_relaxed);
+  _tail.store(increment(current_tail), std::memory_order_release);
+}
+
+// Peek by Consumer, returns the oldest element without removing it
+template<typename Element, size_t Size, size_t SlotAlignment>
+Element* CircularFifo<Element, Size, SlotAlignment>::peek()
+{
+  const auto current_head = _head.load(std::memory_order_relaxed);
+  if(is_empty(current_head))
+    return nullptr; // empty queue
+
+  return &_array[current_head].element;
+}
+
+// Release by Consumer, only valid after a successful peek()
+template<typename Element, size_t Size, size_t SlotAlignment>
+void CircularFifo<Element, Size, SlotAlignment>::release()
+{
+  const auto current_head = _head.load(std::memory_order_relaxed);
+  _head.store(increment(current_head), std::memory_order_release);
+}
+
+// Bulk pop by Consumer, the tail is loaded once and the head stored once
+//     for all elements, returns the number of elements popped
+template<typename Element, size_t Size, size_t SlotAlignment>
+size_t CircularFifo<Element, Size, SlotAlignment>::pop_bulk(Element* items, size_t max_count)
+{
+  auto current_head = _head.load(std::memory_order_relaxed);
+  const auto current_tail = _tail.load(std::memory_order_acquire);
+  _cached_tail = current_tail;
+  size_t count = 0;
+  while(current_head != current_tail && count < max_count)
+  {
+    items[count++] = _array[current_head].element;
+    current_head = increment(current_head);
+  }
+  if(count > 0)
+    _head.store(current_head, std::memory_order_release);
+  return count;
+}
+
+template<typename Element, size_t Size, size_t SlotAlignment>
+bool CircularFifo<Element, Size, SlotAlignment>::wasEmpty() const
 {
   // snapshot with acceptance of that this comparison operation is not atomic
   return (_head.load() == _tail.load()); 
@@ -96,22 +198,22 @@ bool CircularFifo<Element, Size>::wasEmpty() const
 
 
 // snapshot with acceptance that this comparison is not atomic
-template<typename Element, size_t Size>
-bool CircularFifo<Element, Size>::wasFull() const
+template<typename Element, size_t Size, size_t SlotAlignment>
+bool CircularFifo<Element, Size, SlotAlignment>::wasFull() const
 {
   const auto next_tail = increment(_tail.load()); // aquire, we dont know who call
   return (next_tail == _head.load());
 }
 
 
-template<typename Element, size_t Size>
-bool CircularFifo<Element, Size>::isLockFree() const
+template<typename Element, size_t Size, size_t SlotAlignment>
+bool CircularFifo<Element, Size, SlotAlignment>::isLockFree() const
 {
   return (_tail.is_lock_free() && _head.is_lock_free());
 }
 
-template<typename Element, size_t Size>
-size_t CircularFifo<Element, Size>::increment(size_t idx) const
+template<typename Element, size_t Size, size_t SlotAlignment>
+size_t CircularFifo<Element, Size, SlotAlignment>::increment(size_t idx) const
 {
   auto new_idx = idx + 1;
   // if statement more efficient than modulo
@@ -122,5 +224,25 @@ size_t CircularFifo<Element, Size>::increment(size_t idx) const
   return new_idx;
 }
 
+template<typename Element, size_t Size, size_t SlotAlignment>
+bool CircularFifo<Element, Size, SlotAlignment>::is_full(size_t next_tail)
+{
+  if(next_tail != _cached_head)
+    return false;
+
+  _cached_head = _head.load(std::memory_order_acquire);
+  return next_tail == _cached_head;
+}
+
+template<typename Element, size_t Size, size_t SlotAlignment>
+bool CircularFifo<Element, Size, SlotAlignment>::is_empty(size_t current_head)
+{
+  if(current_head != _cached_tail)
+    return false;
+
+  _cached_tail = _tail.load(std::memory_order_acquire);
+  return current_head == _cached_tail;
+}
+
 } // memory_relaxed_aquire_release
 #endif /* CIRCULARFIFO_AQUIRE_RELEASE_H_ */
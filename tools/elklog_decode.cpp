@@ -0,0 +1,106 @@
+/**
+ * @brief Decode binary logs written with ElkLogger::Type::BINARY into the
+ *        same text or json format as ElkLogger::Type::TEXT and JSON.
+ *
+ * Usage: elklog_decode [--json] <binary log file>
+ */
+
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "spdlog/common.h"
+
+#include "elklog/binary_format.h"
+
+namespace {
+
+std::string format_time(int64_t timestamp_ns, bool iso_8601)
+{
+    time_t seconds = timestamp_ns / 1'000'000'000;
+    int millis = (timestamp_ns / 1'000'000) % 1000;
+    std::tm local_time;
+    localtime_r(&seconds, &local_time);
+
+    char date[64];
+    std::strftime(date, sizeof(date), iso_8601 ? "%Y-%m-%dT%H:%M:%S" : "%Y-%m-%d %T", &local_time);
+    if (iso_8601)
+    {
+        char zone[8];
+        std::strftime(zone, sizeof(zone), "%z", &local_time);
+        return fmt::format("{}.{:03}{}", date, millis, zone);
+    }
+    return fmt::format("{}.{:03}", date, millis);
+}
+
+std::string_view level_name(uint8_t level)
+{
+    auto name = spdlog::level::to_string_view(static_cast<spdlog::level::level_enum>(level));
+    return std::string_view(name.data(), name.size());
+}
+
+} // anonymous namespace
+
+int main(int argc, char* argv[])
+{
+    bool json = false;
+    std::string file_name;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "--json")
+        {
+            json = true;
+        }
+        else
+        {
+            file_name = arg;
+        }
+    }
+
+    if (file_name.empty())
+    {
+        std::cerr << "Usage: " << argv[0] << " [--json] <binary log file>" << std::endl;
+        return 1;
+    }
+
+    std::ifstream file(file_name, std::ios::binary);
+    if (!file)
+    {
+        std::cerr << "Failed to open " << file_name << std::endl;
+        return 1;
+    }
+    std::vector<char> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    elklog::binary::Decoder decoder(data.data(), data.size());
+    uint32_t process_id;
+    std::string name;
+    if (decoder.header(process_id, name) == false)
+    {
+        std::cerr << file_name << " is not a binary elklog file" << std::endl;
+        return 1;
+    }
+
+    elklog::binary::DecodedMessage message;
+    while (decoder.next(message))
+    {
+        auto text = elklog::binary::format_message(decoder.format(message.format_id), message.args);
+        if (json)
+        {
+            // Same layout as the pattern used by ElkLogger::Type::JSON, the
+            // thread id is not recorded in binary logs
+            std::cout << fmt::format(R"({{"time": "{}", "name": "{}", "level": "{}", "process": {}, "thread": 0, "data": {}}})",
+                                     format_time(message.timestamp, true), name, level_name(message.level),
+                                     process_id, text) << "\n";
+        }
+        else
+        {
+            std::cout << "[" << format_time(message.timestamp, false) << "] [" << level_name(message.level)
+                      << "] " << text << "\n";
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,30 @@
+/**
+ * @brief Print the content of a ring file written with the ring_file_size
+ *        option of ElkLogger::initialize(), oldest message first. Can be run
+ *        on the file of a crashed process, or one that is still running.
+ *
+ * Usage: elklog_ring_dump <ring file>
+ */
+
+#include <iostream>
+#include <string>
+
+#include "elklog/ring_file_sink.h"
+
+int main(int argc, char* argv[])
+{
+    if (argc != 2)
+    {
+        std::cerr << "Usage: " << argv[0] << " <ring file>" << std::endl;
+        return 1;
+    }
+
+    std::string content;
+    if (elklog::read_ring_file(argv[1], content) == false)
+    {
+        std::cerr << "Failed to read " << argv[1] << ", or it is not an elklog ring file" << std::endl;
+        return 1;
+    }
+    std::cout << content;
+    return 0;
+}